@@ -29,6 +29,10 @@ typedef std::vector<VVVI> VVVVI;
 // use candidate list optimization for Viterbi parsing
 #define CANDIDATE_LIST                             1
 
+// use column-major copies of the FM matrices and vectorized kernels
+// for the FM2 maximization and summation
+#define COLUMN_MAJOR_FM2                           1
+
 // use caching algorithm for fast helix length scores
 #define FAST_HELIX_LENGTHS                         1
 
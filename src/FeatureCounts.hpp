@@ -0,0 +1,71 @@
+//////////////////////////////////////////////////////////////////////
+// FeatureCounts.hpp
+//
+// Dense accumulator of feature counts and gradients indexed by the
+// features of a FeatureMap.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef FEATURECOUNTS_HPP
+#define FEATURECOUNTS_HPP
+
+#include <vector>
+#include <cstddef>
+
+//////////////////////////////////////////////////////////////////////
+// class FeatureCounts
+//
+// The values are kept in a vector over the whole feature space
+// together with the list of the touched features, so that adding a
+// value needs no hashing and clear() takes time proportional to the
+// number of the touched features.  Iterating over it visits the
+// indices of the touched features in the order of their first touch.
+//////////////////////////////////////////////////////////////////////
+
+template<class T>
+class FeatureCounts
+{
+public:
+    typedef std::vector<size_t>::const_iterator const_iterator;
+
+public:
+    FeatureCounts(size_t n = 0) : vals_(n, T(0)), touched_(n, false), idx_() { }
+
+    T& operator[](size_t i)
+    {
+        if (i >= vals_.size())
+        {
+            vals_.resize(i+1, T(0));
+            touched_.resize(i+1, false);
+        }
+        if (!touched_[i])
+        {
+            touched_[i] = true;
+            idx_.push_back(i);
+        }
+        return vals_[i];
+    }
+
+    T get(size_t i) const { return i < vals_.size() ? vals_[i] : T(0); }
+
+    void clear()
+    {
+        for (auto i : idx_)
+        {
+            vals_[i] = T(0);
+            touched_[i] = false;
+        }
+        idx_.clear();
+    }
+
+    const_iterator begin() const { return idx_.begin(); }
+    const_iterator end() const { return idx_.end(); }
+    size_t size() const { return idx_.size(); }
+    bool empty() const { return idx_.empty(); }
+
+private:
+    std::vector<T> vals_;
+    std::vector<bool> touched_;
+    std::vector<size_t> idx_;
+};
+
+#endif
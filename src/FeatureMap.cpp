@@ -58,8 +58,8 @@ FeatureMap::
 FeatureMap(const char* def_bases,
            const std::vector<std::string>& def_bps)
   : def_bases_(def_bases), NBASES(def_bases_.size()),
-    def_bps_(def_bps), NBPS(def_bps_.size()),
-    hash_(), keys_()
+    def_bps_(def_bps), NBPS(def_bps_.size()), KMER_BITS(0),
+    hash_(), keys_(), new_hash_(), new_keys_(), num_new_keys_(0), mtx_()
 #ifdef USE_CACHE
 #if PARAMS_BASE_PAIR
   , cache_base_pair_(NBPS, -1)
@@ -142,7 +142,11 @@ FeatureMap(const char* def_bases,
   for (size_t i=0; i!=def_bps_.size(); ++i)
     is_complementary_[def_bps_[i][0]][def_bps_[i][1]] = i;
 
+  // number of bits for each letter of the k-mer codes
+  while ((1u<<KMER_BITS) < NBASES) ++KMER_BITS;
+
   initialize_cache();
+  merge();
 }
 
 void
@@ -220,23 +224,156 @@ initialize_cache()
   initialize_cache_external_unpaired();
   initialize_cache_external_paired();
 #endif
+#if PARAMS_HAIRPIN_NUCLEOTIDES || PARAMS_HAIRPIN_3_NUCLEOTIDES || PARAMS_HAIRPIN_4_NUCLEOTIDES
+  initialize_cache_hairpin_nucleotides();
+#endif
+#if PARAMS_INTERNAL_NUCLEOTIDES || PARAMS_BULGE_0x1_NUCLEOTIDES || PARAMS_BULGE_0x2_NUCLEOTIDES || PARAMS_BULGE_0x3_NUCLEOTIDES || PARAMS_INTERNAL_1x1_NUCLEOTIDES || PARAMS_INTERNAL_1x2_NUCLEOTIDES || PARAMS_INTERNAL_2x2_NUCLEOTIDES
+  initialize_cache_internal_nucleotides();
+#endif
+#endif
+}
+
+// register the index of a hairpin or internal loop nucleotides feature
+// in the k-mer tables; other keys are ignored.
+
+void
+FeatureMap::
+update_cache_nucleotides(const std::string& key, size_t i)
+{
+#ifdef USE_CACHE
+#if PARAMS_HAIRPIN_NUCLEOTIDES || PARAMS_HAIRPIN_3_NUCLEOTIDES || PARAMS_HAIRPIN_4_NUCLEOTIDES
+  if (key.find(s_hairpin_nucleotides) == 0)
+  {
+    const uint l = key.size()-s_hairpin_nucleotides.size();
+    const int x = encode_nucleotides(&key[s_hairpin_nucleotides.size()], l, 1);
+    if (l<cache_hairpin_nucleotides_.size() && x>=0)
+      cache_hairpin_nucleotides_[l][x] = i;
+  }
+#endif
+#if PARAMS_INTERNAL_NUCLEOTIDES || PARAMS_BULGE_0x1_NUCLEOTIDES || PARAMS_BULGE_0x2_NUCLEOTIDES || PARAMS_BULGE_0x3_NUCLEOTIDES || PARAMS_INTERNAL_1x1_NUCLEOTIDES || PARAMS_INTERNAL_1x2_NUCLEOTIDES || PARAMS_INTERNAL_2x2_NUCLEOTIDES
+  if (key.find(s_internal_nucleotides) == 0)
+  {
+    const size_t pos = key.find("_", s_internal_nucleotides.size());
+    const uint l = pos-s_internal_nucleotides.size();
+    const uint m = key.size()-pos-1;
+    if (l<cache_internal_nucleotides_.size() && m<cache_internal_nucleotides_[l].size())
+    {
+      const int x1 = encode_nucleotides(&key[s_internal_nucleotides.size()], l, 1);
+      const int x2 = encode_nucleotides(&key[pos+1], m, 1);
+      if (x1>=0 && x2>=0)
+      {
+        cache_internal_nucleotides_[l][m][(x1<<(KMER_BITS*m))+x2] = i;
+        // the symmetric key with both sides reversed
+        const int y1 = encode_nucleotides(&key[pos]-1, l, -1);
+        const int y2 = encode_nucleotides(&key[key.size()-1], m, -1);
+        cache_internal_nucleotides_[m][l][(y2<<(KMER_BITS*l))+y1] = i;
+      }
+    }
+  }
+#endif
 #endif
 }
 
+// look up the index of a hairpin or internal loop nucleotides feature
+// in the k-mer tables; returns -1 if not found there.
+
+int
+FeatureMap::
+find_cache_nucleotides(const std::string& key) const
+{
+#ifdef USE_CACHE
+#if PARAMS_HAIRPIN_NUCLEOTIDES || PARAMS_HAIRPIN_3_NUCLEOTIDES || PARAMS_HAIRPIN_4_NUCLEOTIDES
+  if (key.compare(0, s_hairpin_nucleotides.size(), s_hairpin_nucleotides) == 0)
+  {
+    const uint l = key.size()-s_hairpin_nucleotides.size();
+    const int x = encode_nucleotides(&key[s_hairpin_nucleotides.size()], l, 1);
+    return l<cache_hairpin_nucleotides_.size() && x>=0 ? cache_hairpin_nucleotides_[l][x] : -1;
+  }
+#endif
+#if PARAMS_INTERNAL_NUCLEOTIDES || PARAMS_BULGE_0x1_NUCLEOTIDES || PARAMS_BULGE_0x2_NUCLEOTIDES || PARAMS_BULGE_0x3_NUCLEOTIDES || PARAMS_INTERNAL_1x1_NUCLEOTIDES || PARAMS_INTERNAL_1x2_NUCLEOTIDES || PARAMS_INTERNAL_2x2_NUCLEOTIDES
+  if (key.compare(0, s_internal_nucleotides.size(), s_internal_nucleotides) == 0)
+  {
+    const size_t pos = key.find("_", s_internal_nucleotides.size());
+    if (pos == std::string::npos) return -1;
+    const uint l = pos-s_internal_nucleotides.size();
+    const uint m = key.size()-pos-1;
+    if (l<cache_internal_nucleotides_.size() && m<cache_internal_nucleotides_[l].size())
+    {
+      const int x1 = encode_nucleotides(&key[s_internal_nucleotides.size()], l, 1);
+      const int x2 = encode_nucleotides(&key[pos+1], m, 1);
+      if (x1>=0 && x2>=0)
+        return cache_internal_nucleotides_[l][m][(x1<<(KMER_BITS*m))+x2];
+    }
+  }
+#endif
+#endif
+  return -1;
+}
+
+// pack l letters starting at x and advancing by step into an integer
+// using KMER_BITS bits per letter; returns -1 for a non-standard letter.
+
+int
+FeatureMap::
+encode_nucleotides(const NUCL* x, uint l, int step) const
+{
+  int r = 0;
+  for (uint k=0; k!=l; ++k, x+=step)
+  {
+    const int b = is_base_[static_cast<unsigned char>(*x)];
+    if (b<0) return -1;
+    r = (r<<KMER_BITS) + b;
+  }
+  return r;
+}
+
+// unpack l letters from a k-mer code of encode_nucleotides() into s;
+// returns false if the code includes a letter out of def_bases_.
+
+bool
+FeatureMap::
+decode_nucleotides(int x, uint l, std::string& s) const
+{
+  s.resize(l);
+  for (uint k=l; k!=0; --k, x>>=KMER_BITS)
+  {
+    const size_t b = x & ((1<<KMER_BITS)-1);
+    if (b>=NBASES) return false;
+    s[k-1] = def_bases_[b];
+  }
+  return true;
+}
 
 size_t
 FeatureMap::
 find_key(const std::string& key) const
 {
+  const int c = find_cache_nucleotides(key);
+  if (c>=0) return c;
   auto itr = hash_.find(key);
-  return itr != hash_.end() ? itr->second : -1u;
+  if (itr != hash_.end()) return itr->second;
+  if (num_new_keys_ == 0) return -1u;
+
+  std::lock_guard<std::mutex> lock(mtx_);
+  itr = new_hash_.find(key);
+  return itr != new_hash_.end() ? itr->second : -1u;
 }
 
+// a new key is registered aside from hash_ and keys_, which may be read
+// by other threads at the same time, and is merged into them by merge().
+
 size_t
 FeatureMap::
 insert_key(const std::string& key)
 {
-  auto r = hash_.emplace(key, keys_.size());
+  const int c = find_cache_nucleotides(key);
+  if (c>=0) return c;
+  auto itr = hash_.find(key);
+  if (itr != hash_.end()) return itr->second;
+
+  std::lock_guard<std::mutex> lock(mtx_);
+  const size_t n = keys_.size() + new_keys_.size();
+  auto r = new_hash_.emplace(key, n);
   if (!r.second) return r.first->second;
   auto k = key;
 
@@ -249,7 +386,7 @@ insert_key(const std::string& key)
     std::reverse(nuc1.begin(), nuc1.end());
     std::reverse(nuc2.begin(), nuc2.end());
     std::string key2 = s_internal_nucleotides + nuc2 + '_' + nuc1;
-    hash_[key2] = keys_.size();
+    new_hash_[key2] = n;
     if (k>key2) k = key2;
   }
   else if (key.find(s_base_pair) == 0 && key.size() == s_base_pair.size()+2)
@@ -257,7 +394,7 @@ insert_key(const std::string& key)
     const char nuc1 = key[s_base_pair.size()+0];
     const char nuc2 = key[s_base_pair.size()+1];
     std::string key2 = s_base_pair + nuc2 + nuc1;
-    hash_[key2] = keys_.size();
+    new_hash_[key2] = n;
     if (k>key2) k = key2;
   }
   else if (key.find(s_helix_stacking) == 0)
@@ -267,7 +404,7 @@ insert_key(const std::string& key)
     const char nuc3 = key[s_helix_stacking.size()+2];
     const char nuc4 = key[s_helix_stacking.size()+3];
     std::string key2 = s_helix_stacking + nuc4 + nuc3 + nuc2 + nuc1;
-    hash_[key2] = keys_.size();
+    new_hash_[key2] = n;
     if (k>key2) k = key2;
   }
   else if (key.find(s_internal_explicit) == 0)
@@ -276,7 +413,7 @@ insert_key(const std::string& key)
     std::string l1 = key.substr(s_internal_explicit.size(), pos-s_internal_explicit.size());
     std::string l2 = key.substr(pos+1);
     std::string key2 = s_internal_explicit + l2 + '_' + l1;
-    hash_[key2] = keys_.size();
+    new_hash_[key2] = n;
     if (k>key2) k = key2;
   }
 #ifdef PARAMS_VIENNA_COMPAT
@@ -289,7 +426,7 @@ insert_key(const std::string& key)
     const char nuc5 = key[s_internal_nucleotides_int11.size()+5];
     const char nuc6 = key[s_internal_nucleotides_int11.size()+7];
     std::string key2 = s_internal_nucleotides_int11 + nuc4 + nuc3 + nuc2 + nuc1 + '_' + nuc6 + '_' + nuc5;
-    hash_[key2] = keys_.size();
+    new_hash_[key2] = n;
     if (k>key2) k = key2;
   }
   else if (key.find(s_internal_nucleotides_int21) == 0)
@@ -302,7 +439,7 @@ insert_key(const std::string& key)
     const char nuc6 = key[s_internal_nucleotides_int21.size()+6];
     const char nuc7 = key[s_internal_nucleotides_int21.size()+8];
     std::string key2 = s_internal_nucleotides_int12 + nuc4 + nuc3 + nuc2 + nuc1 + '_' + nuc7 + '_' + nuc6 + nuc5;
-    hash_[key2] = keys_.size();
+    new_hash_[key2] = n;
     if (k>key2) k = key2;
   }
   else if (key.find(s_internal_nucleotides_int12) == 0)
@@ -315,7 +452,7 @@ insert_key(const std::string& key)
     const char nuc6 = key[s_internal_nucleotides_int12.size()+7];
     const char nuc7 = key[s_internal_nucleotides_int12.size()+8];
     std::string key2 = s_internal_nucleotides_int21 + nuc4 + nuc3 + nuc2 + nuc1 + '_' + nuc7 + nuc6 + '_' + nuc5;
-    hash_[key2] = keys_.size();
+    new_hash_[key2] = n;
     if (k>key2) k = key2;
   }
   else if (key.find(s_internal_nucleotides_int22) == 0)
@@ -329,13 +466,65 @@ insert_key(const std::string& key)
     const char nuc7 = key[s_internal_nucleotides_int22.size()+8];
     const char nuc8 = key[s_internal_nucleotides_int22.size()+9];
     std::string key2 = s_internal_nucleotides_int22 + nuc4 + nuc3 + nuc2 + nuc1 + '_' + nuc8 + nuc7 + '_' + nuc6 + nuc5;
-    hash_[key2] = keys_.size();
+    new_hash_[key2] = n;
     if (k>key2) k = key2;
   }
 #endif
 
-  keys_.push_back(k.c_str());
-  return keys_.size()-1;
+  new_keys_.push_back(k);
+  ++num_new_keys_;
+  return n;
+}
+
+// register a key only in keys_, which is looked up by other means than hash_
+
+size_t
+FeatureMap::
+append_key(const std::string& key)
+{
+  std::lock_guard<std::mutex> lock(mtx_);
+  new_keys_.push_back(key);
+  ++num_new_keys_;
+  return keys_.size() + new_keys_.size() - 1;
+}
+
+const std::string&
+FeatureMap::
+name(size_t i) const
+{
+  if (i < keys_.size()) return keys_[i];
+  std::lock_guard<std::mutex> lock(mtx_);
+  return new_keys_[i-keys_.size()];
+}
+
+// move the new keys into hash_ and keys_, which must not be done while
+// other threads are using this map.
+
+void
+FeatureMap::
+merge()
+{
+  std::lock_guard<std::mutex> lock(mtx_);
+  for (const auto& e : new_hash_)
+  {
+    hash_.insert(e);
+    update_cache_nucleotides(e.first, e.second);
+  }
+  keys_.insert(keys_.end(), new_keys_.begin(), new_keys_.end());
+  new_hash_.clear();
+  new_keys_.clear();
+  num_new_keys_ = 0;
+}
+
+void
+FeatureMap::
+clear_keys()
+{
+  hash_.clear();
+  keys_.clear();
+  new_hash_.clear();
+  new_keys_.clear();
+  num_new_keys_ = 0;
 }
 
 size_t
@@ -348,18 +537,18 @@ insert_keyval(const std::string& key, std::vector<param_value_type>& vals, param
   return i;
 }
 
+// the features registered so far are kept, and are given no value
+// unless they are found in the loaded ones.
+
 std::vector<param_value_type>
 FeatureMap::
 load_from_hash(const std::unordered_map<std::string, param_value_type>& h)
 {
   std::vector<param_value_type> vals;
-  hash_.clear();
-  keys_.clear();
-  initialize_cache()  ;
-
   for (auto e: h)
     insert_keyval(e.first, vals, e.second);
 
+  merge();
   return vals;
 }
 
@@ -368,10 +557,6 @@ FeatureMap::
 read_from_file(const std::string& filename)
 {
   std::vector<param_value_type> vals;
-  hash_.clear();
-  keys_.clear();
-  initialize_cache();
-
   std::ifstream is(filename.c_str());
   if (!is) throw std::runtime_error(std::string(strerror(errno)) + ": " + filename);
 
@@ -393,6 +578,7 @@ read_from_file(const std::string& filename)
         insert_keyval(k, vals, v);
   }
 
+  merge();
   return vals;
 }
 
@@ -462,8 +648,7 @@ FeatureMap::
 import_from_vienna_parameters(const std::string& filename)
 {
   std::vector<param_value_type> vals;
-  hash_.clear();
-  keys_.clear();
+  clear_keys();
   std::ifstream is(filename.c_str());
   if (!is) throw std::runtime_error(std::string(strerror(errno)) + ": " + filename);
 
@@ -657,6 +842,7 @@ import_from_vienna_parameters(const std::string& filename)
   }
 
   initialize_cache();
+  merge();
   return vals;
 }
 #endif
@@ -668,13 +854,13 @@ write_to_file(const std::string& filename, const std::vector<param_value_type>&
   std::ofstream os(filename.c_str());
   if (!os) throw std::runtime_error(std::string(strerror(errno)) + ": " + filename);
 
-  std::vector<size_t> idx(keys_.size());
+  std::vector<size_t> idx(size());
   std::iota(idx.begin(), idx.end(), 0);
   std::sort(idx.begin(), idx.end(),
-            [&](size_t i, size_t j) { return keys_[i] < keys_[j]; });
+            [&](size_t i, size_t j) { return name(i) < name(j); });
   for (auto i: idx)
-    if (std::abs(vals[i])>1e-20)
-      os << keys_[i] << " " << vals[i] << std::endl;
+    if (i<vals.size() && std::abs(vals[i])>1e-20)
+      os << name(i) << " " << vals[i] << std::endl;
 }
 
 #if PARAMS_BASE_PAIR
@@ -1125,10 +1311,37 @@ insert_hairpin_length_at_least(uint l)
 #endif
 
 #if PARAMS_HAIRPIN_NUCLEOTIDES || PARAMS_HAIRPIN_3_NUCLEOTIDES || PARAMS_HAIRPIN_4_NUCLEOTIDES
+void
+FeatureMap::
+initialize_cache_hairpin_nucleotides()
+{
+#ifdef USE_CACHE
+  // the dense tables are only used for 2-bit codes, i.e., up to four letters
+  cache_hairpin_nucleotides_.resize(KMER_BITS<=2 ? DEFAULT_C_MAX_HAIRPIN_NUCLEOTIDES_LENGTH+1 : 0);
+  for (size_t l=0; l!=cache_hairpin_nucleotides_.size(); ++l)
+    cache_hairpin_nucleotides_[l].assign(1<<(KMER_BITS*l), -1);
+
+  // register all the k-mers of hairpin loops, which are at least 3 long
+  std::string h;
+  for (size_t l=3; l<cache_hairpin_nucleotides_.size(); ++l)
+    for (size_t x=0; x!=cache_hairpin_nucleotides_[l].size(); ++x)
+      if (decode_nucleotides(x, l, h))
+        cache_hairpin_nucleotides_[l][x] = append_key(s_hairpin_nucleotides + h);
+#endif
+}
+
 size_t
 FeatureMap::
 find_hairpin_nucleotides(const std::vector<NUCL>& s, uint i, uint l) const
 {
+#ifdef USE_CACHE
+  if (l<cache_hairpin_nucleotides_.size())
+  {
+    const int x = encode_nucleotides(&s[i], l, 1);
+    if (x>=0)
+      return cache_hairpin_nucleotides_[l][x]>=0 ? cache_hairpin_nucleotides_[l][x] : -1u;
+  }
+#endif
   std::string h(l, ' ');
   std::copy(&s[i], &s[i]+l, h.begin());
   return find_key(s_hairpin_nucleotides + h);
@@ -1138,6 +1351,14 @@ size_t
 FeatureMap::
 insert_hairpin_nucleotides(const std::vector<NUCL>& s, uint i, uint l)
 {
+#ifdef USE_CACHE
+  if (l<cache_hairpin_nucleotides_.size())
+  {
+    const int x = encode_nucleotides(&s[i], l, 1);
+    if (x>=0 && cache_hairpin_nucleotides_[l][x]>=0)
+      return cache_hairpin_nucleotides_[l][x];
+  }
+#endif
   std::string h(l, ' ');
   std::copy(&s[i], &s[i]+l, h.begin());
   return insert_key(s_hairpin_nucleotides + h);
@@ -1383,10 +1604,55 @@ insert_internal_asymmetry_at_least(uint l)
 #endif
 
 #if PARAMS_INTERNAL_NUCLEOTIDES || PARAMS_BULGE_0x1_NUCLEOTIDES || PARAMS_BULGE_0x2_NUCLEOTIDES || PARAMS_BULGE_0x3_NUCLEOTIDES || PARAMS_INTERNAL_1x1_NUCLEOTIDES || PARAMS_INTERNAL_1x2_NUCLEOTIDES || PARAMS_INTERNAL_2x2_NUCLEOTIDES
+void
+FeatureMap::
+initialize_cache_internal_nucleotides()
+{
+#ifdef USE_CACHE
+  cache_internal_nucleotides_.resize(KMER_BITS<=2 ? DEFAULT_C_MAX_SINGLE_NUCLEOTIDES_LENGTH+1 : 0);
+  for (size_t l=0; l!=cache_internal_nucleotides_.size(); ++l)
+  {
+    cache_internal_nucleotides_[l].resize(DEFAULT_C_MAX_SINGLE_NUCLEOTIDES_LENGTH-l+1);
+    for (size_t m=0; m!=cache_internal_nucleotides_[l].size(); ++m)
+      cache_internal_nucleotides_[l][m].assign(1<<(KMER_BITS*(l+m)), -1);
+  }
+
+  // register all the pairs of k-mers of internal loops and bulges,
+  // named by the smaller of the two symmetric keys as in insert_key()
+  std::string nuc1, nuc2;
+  for (size_t l=0; l!=cache_internal_nucleotides_.size(); ++l)
+    for (size_t m=0; m!=cache_internal_nucleotides_[l].size(); ++m)
+    {
+      if (l+m==0) continue;
+      for (size_t x1=0; x1!=(1u<<(KMER_BITS*l)); ++x1)
+        if (decode_nucleotides(x1, l, nuc1))
+          for (size_t x2=0; x2!=(1u<<(KMER_BITS*m)); ++x2)
+            if (cache_internal_nucleotides_[l][m][(x1<<(KMER_BITS*m))+x2]<0 && decode_nucleotides(x2, m, nuc2))
+            {
+              const auto key1 = s_internal_nucleotides + nuc1 + '_' + nuc2;
+              const auto key2 = s_internal_nucleotides + std::string(nuc2.rbegin(), nuc2.rend()) + '_' + std::string(nuc1.rbegin(), nuc1.rend());
+              update_cache_nucleotides(key1, append_key(std::min(key1, key2)));
+            }
+    }
+#endif
+}
+
 size_t
 FeatureMap::
 find_internal_nucleotides(const std::vector<NUCL>& s, uint i, uint l, uint j, uint m) const
 {
+#ifdef USE_CACHE
+  if (l<cache_internal_nucleotides_.size() && m<cache_internal_nucleotides_[l].size())
+  {
+    const int x1 = encode_nucleotides(&s[i], l, 1);
+    const int x2 = encode_nucleotides(&s[j], m, -1);
+    if (x1>=0 && x2>=0)
+    {
+      const int r = cache_internal_nucleotides_[l][m][(x1<<(KMER_BITS*m))+x2];
+      return r>=0 ? r : -1u;
+    }
+  }
+#endif
   std::string nuc(l+m+1, ' ');
   auto x = std::copy(&s[i], &s[i+l], nuc.begin());
   *(x++) = '_';
@@ -1398,6 +1664,15 @@ size_t
 FeatureMap::
 insert_internal_nucleotides(const std::vector<NUCL>& s, uint i, uint l, uint j, uint m)
 {
+#ifdef USE_CACHE
+  if (l<cache_internal_nucleotides_.size() && m<cache_internal_nucleotides_[l].size())
+  {
+    const int x1 = encode_nucleotides(&s[i], l, 1);
+    const int x2 = encode_nucleotides(&s[j], m, -1);
+    if (x1>=0 && x2>=0 && cache_internal_nucleotides_[l][m][(x1<<(KMER_BITS*m))+x2]>=0)
+      return cache_internal_nucleotides_[l][m][(x1<<(KMER_BITS*m))+x2];
+  }
+#endif
   std::string nuc(l+m+1, ' ');
   auto x = std::copy(&s[i], &s[i+l], nuc.begin());
   *(x++) = '_';
@@ -6,7 +6,10 @@
 #include <string>
 #include <vector>
 #include <unordered_map>
+#include <deque>
 #include <array>
+#include <mutex>
+#include <atomic>
 
 #define USE_CACHE
 
@@ -28,19 +31,27 @@ public:
 
 private:
   void initialize_cache();
+  void clear_keys();
+  void update_cache_nucleotides(const std::string& key, size_t i);
+  int find_cache_nucleotides(const std::string& key) const;
+  size_t append_key(const std::string& key);
+  int encode_nucleotides(const NUCL* x, uint l, int step) const;
+  bool decode_nucleotides(int x, uint l, std::string& s) const;
 
 public:
   size_t find_key(const std::string& key) const;
   size_t insert_key(const std::string& key);
   size_t insert_keyval(const std::string& key, std::vector<param_value_type>& vals, param_value_type v);
-  const std::string& name(size_t i) const { return keys_[i]; }
+  const std::string& name(size_t i) const;
   int is_complementary(NUCL i, NUCL j) const { return is_complementary_[i][j]; }
+  void merge();
 
+  // begin() and end() iterate over the merged keys only
   iterator begin() { return keys_.begin(); }
   iterator end() { return keys_.end(); }
   const_iterator begin() const { return keys_.begin(); }
   const_iterator end() const { return keys_.end(); }
-  size_t size() const { return keys_.size(); }
+  size_t size() const { return keys_.size() + num_new_keys_; }
 
 public:
   // access to parameters
@@ -97,6 +108,7 @@ public:
 #if PARAMS_HAIRPIN_NUCLEOTIDES || PARAMS_HAIRPIN_3_NUCLEOTIDES || PARAMS_HAIRPIN_4_NUCLEOTIDES
   size_t find_hairpin_nucleotides(const std::vector<NUCL>& s, uint i, uint l) const;
   size_t insert_hairpin_nucleotides(const std::vector<NUCL>& s, uint i, uint l);
+  void initialize_cache_hairpin_nucleotides();
 #endif
 #if PARAMS_HELIX_LENGTH
   size_t find_helix_length_at_least(uint l) const;
@@ -136,6 +148,7 @@ public:
 #if PARAMS_INTERNAL_NUCLEOTIDES || PARAMS_BULGE_0x1_NUCLEOTIDES || PARAMS_BULGE_0x2_NUCLEOTIDES || PARAMS_BULGE_0x3_NUCLEOTIDES || PARAMS_INTERNAL_1x1_NUCLEOTIDES || PARAMS_INTERNAL_1x2_NUCLEOTIDES || PARAMS_INTERNAL_2x2_NUCLEOTIDES
   size_t find_internal_nucleotides(const std::vector<NUCL>& s, uint i, uint l, uint j, uint m) const;
   size_t insert_internal_nucleotides(const std::vector<NUCL>& s, uint i, uint l, uint j, uint m);
+  void initialize_cache_internal_nucleotides();
 #endif
 #if PARAMS_HELIX_STACKING
   size_t find_helix_stacking(NUCL i1, NUCL j1, NUCL i2, NUCL j2) const;
@@ -210,8 +223,16 @@ private:
   size_t NBASES;
   const std::vector<std::string> def_bps_;
   size_t NBPS;
+  uint KMER_BITS;
+  // all the features over def_bases_ are registered in the constructor,
+  // so that hash_ and keys_ can be read by many threads without locks.
   std::unordered_map<std::string, size_t> hash_;
   std::vector<std::string> keys_;
+  // the features registered after that, which are kept aside until merge()
+  std::unordered_map<std::string, size_t> new_hash_;
+  std::deque<std::string> new_keys_;
+  std::atomic<size_t> num_new_keys_;
+  mutable std::mutex mtx_;
   std::array<int, 256> is_base_;
   std::array<std::array<int, 256>, 256> is_complementary_;
 
@@ -287,6 +308,12 @@ private:
   int cache_external_unpaired_;
   int cache_external_paired_;
 #endif
+#if PARAMS_HAIRPIN_NUCLEOTIDES || PARAMS_HAIRPIN_3_NUCLEOTIDES || PARAMS_HAIRPIN_4_NUCLEOTIDES
+  VVI cache_hairpin_nucleotides_;           // [l][k-mer code]
+#endif
+#if PARAMS_INTERNAL_NUCLEOTIDES || PARAMS_BULGE_0x1_NUCLEOTIDES || PARAMS_BULGE_0x2_NUCLEOTIDES || PARAMS_BULGE_0x3_NUCLEOTIDES || PARAMS_INTERNAL_1x1_NUCLEOTIDES || PARAMS_INTERNAL_1x2_NUCLEOTIDES || PARAMS_INTERNAL_2x2_NUCLEOTIDES
+  VVVI cache_internal_nucleotides_;        // [l][m][k-mer code]
+#endif
 #endif
 
 };
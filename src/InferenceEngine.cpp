@@ -9,6 +9,8 @@
 #include "FeatureMap.hpp"
 #include <algorithm>
 #include <cassert>
+#include <cmath>
+#include <cstdlib>
 
 template < class M, class OFFSET >
 void show_matrix(const M& matrix, const OFFSET& offset, const std::string& name, int L)
@@ -78,6 +80,13 @@ find_param(const std::vector<T>* params, size_t i)
     return /*params!=nullptr && i!=-1u && */ i<params->size() ? (*params)[i] : T(0);
 }
 
+template < typename T >
+T
+find_param(const ParameterView<T>& params, size_t i)
+{
+    return params[i];
+}
+
 template < typename T >
 T
 find_param(const std::vector<T>* params1, const std::vector<T>* params2, size_t i)
@@ -96,43 +105,58 @@ insert_param(std::vector<T>* params, size_t i)
 
 template < typename T >
 T&
-insert_param(std::unordered_map<size_t, T>* params, size_t i)
+insert_param(FeatureCounts<T>* params, size_t i)
 {
     assert(i!=-1u);
-    auto r = params->emplace(i, T(0));
-    return r.first->second;
+    return (*params)[i];
 }
 
 //////////////////////////////////////////////////////////////////////
-// ComputeRowOffset()
+// InferenceEngine::ComputeOffsets()
 //
-// Consider an N x N upper triangular matrix whose elements are
-// stored in a one-dimensional flat array using the following
-// row-major indexing scheme:
+// Consider an (L+1) x (L+1) upper triangular matrix of which only
+// the band j-i <= BAND is kept, with the elements stored in a
+// one-dimensional flat array using the following row-major
+// indexing scheme (here L = 4 and BAND = 2):
 //
-//     0  1  2  3     <-- row 0
-//        4  5  6     <-- row 1
-//           7 [8]    <-- row 2
-//              9     <-- row 3
+//     0  1  2           <-- row 0
+//        3  4  5        <-- row 1
+//           6 [7] 8     <-- row 2
+//              9 10     <-- row 3
+//                11     <-- row 4
 //
 // Assuming 0-based indexing, this function computes offset[i]
 // for the ith row such that offset[i]+j is the index of the
-// (i,j)th element of the upper triangular matrix in the flat
-// array.
+// (i,j)th element in the flat array, and SIZE, the number of the
+// stored elements.
 //
-// For example, offset[2] = 5, so the (2,3)th element of the
-// upper triangular matrix (marked in the picture above) can be 
-// found at position offset[2]+3 = 5+3 = 8 in the flat array.
+// For example, offset[2] = 4, so the (2,3)th element of the
+// matrix (marked in the picture above) can be found at position
+// offset[2]+3 = 4+3 = 7 in the flat array.  With BAND = L, this
+// is the whole upper triangular matrix.
+//
+// Similarly, column_offset[j]+i is the index of the (i,j)th
+// element in the column-major copies of the same band.  The matrices
+// which keep only some of their rows in the checkpointed run (see
+// UseCheckpoints()) use checkpoint_offset[i]+j and window_offset[i]+j
+// instead, which are set by ComputeInside() and ComputeOutside().
 //////////////////////////////////////////////////////////////////////
 
 template<class RealT>
-int InferenceEngine<RealT>::ComputeRowOffset(int i, int N) const
+void InferenceEngine<RealT>::ComputeOffsets()
 {
-    Assert(i >= 0 && i <= N, "Index out-of-bounds.");
+    offset.resize(L+1);
+    column_offset.resize(L+1);
 
-    // equivalent to:
-    //   return N*(N+1)/2 - (N-i)*(N-i+1)/2 - i;
-    return i*(N+N-i-1)/2;
+    int row = 0, column = 0;
+    for (int i = 0; i <= L; i++)
+    {
+        offset[i] = row - i;
+        row += std::min(L, i+BAND) - i + 1;
+        column_offset[i] = column - std::max(0, i-BAND);
+        column += i - std::max(0, i-BAND) + 1;
+    }
+    SIZE = row;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -149,6 +173,28 @@ bool InferenceEngine<RealT>::IsComplementary(int i, int j) const
     return fm_->is_complementary(s[i], s[j])>=0;
 }
 
+#ifdef HAVE_VIENNA20
+
+//////////////////////////////////////////////////////////////////////
+// SharedTurnerParameters()
+//
+// The Turner parameters of ViennaRNA's default model, created on the
+// first call and shared read-only by all the engines, so that an
+// engine constructed per sequence does not rebuild them.
+//////////////////////////////////////////////////////////////////////
+
+static std::shared_ptr<VIENNA::vrna_param_t> SharedTurnerParameters()
+{
+    static const std::shared_ptr<VIENNA::vrna_param_t> P = []() {
+        VIENNA::vrna_md_t md;
+        vrna_md_set_default(&md);
+        return std::shared_ptr<VIENNA::vrna_param_t>(vrna_params(&md), free);
+    }();
+    return P;
+}
+
+#endif
+
 //////////////////////////////////////////////////////////////////////
 // InferenceEngine::InferenceEngine()
 //
@@ -169,18 +215,27 @@ InferenceEngine<RealT>::InferenceEngine(bool with_turner,
     C_MIN_HAIRPIN_LENGTH(min_hairpin_length),
     C_MAX_HAIRPIN_NUCLEOTIDES_LENGTH(max_hairpin_nucleotides_length),
     C_MAX_SPAN(max_span),
+    num_threads(1),
+    checkpoint_interval(-1),
     cache_initialized(false),
     L(0),
     SIZE(0),
+    SPAN(0),
+    BAND(0),
+    INTERVAL(0),
+    WINDOW(0),
 #ifdef HAVE_VIENNA20
     with_turner_(with_turner),
-    vc_(nullptr),
+    turner_params_(),
 #endif
-    cache_score_single(C_MAX_SINGLE_LENGTH+1, std::vector<std::pair<RealT,RealT>>(C_MAX_SINGLE_LENGTH+1))
+    cache_score_single()
 {
 #ifdef HAVE_VIENNA20
     if (with_turner_)
+    {
         vrna_md_set_default(&md_);
+        turner_params_ = SharedTurnerParameters();
+    }
 #endif
 }
 
@@ -193,9 +248,6 @@ InferenceEngine<RealT>::InferenceEngine(bool with_turner,
 template<class RealT>
 InferenceEngine<RealT>::~InferenceEngine()
 {
-#ifdef HAVE_VIENNA20
-    if (vc_) vrna_fold_compound_free(vc_);
-#endif
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -208,69 +260,40 @@ template<class RealT>
 void InferenceEngine<RealT>::LoadSequence(const SStruct &sstruct)
 {
     cache_initialized = false;
+    EncodeSequence(sstruct);
 
-    // compute dimensions
-    L = sstruct.GetLength();
-    SIZE = (L+1)*(L+2) / 2;
+    // compute dimensions; with a limited span, the cells enclosed by a
+    // base pair have j-i < C_MAX_SPAN, and the band also covers the
+    // few cells beyond them that the outside algorithm looks up
+    SPAN = C_MAX_SPAN>=0 ? std::min(L, std::max(0, C_MAX_SPAN-1)) : L;
+    BAND = std::min(L, SPAN+3);
+    ComputeOffsets();
 
     // allocate memory
-    s.resize(L+1);
-    offset.resize(L+1);
-    allow_unpaired_position.resize(L+1);
-    allow_unpaired.resize(SIZE);
-    allow_paired.resize(SIZE);
-    loss_unpaired_position.resize(L+1);
-    loss_unpaired.resize(SIZE);
-    loss_paired.resize(SIZE);
-    loss_const = RealT(0);
-    reactivity_unpaired_position.resize(L+1);
-    reactivity_unpaired.resize(SIZE);
-    reactivity_paired.resize(SIZE);
+    loss_unpaired.clear();
 
 #if FAST_HELIX_LENGTHS
-    cache_score_helix_sums.clear();                  cache_score_helix_sums.resize((2*L+1)*L);
-#endif
-
-    // convert sequences to index representation
-    const std::string &sequence = sstruct.GetSequences()[0];
-    s[0] = '@';
-    for (int i = 1; i <= L; i++)
-    {
-        s[i] = toupper(sequence[i]);
-    }
+    cache_score_helix_sums.clear();                  cache_score_helix_sums.resize((2*L+1)*(BAND/2+1));
+#endif
+    cache_score_base_pair.resize(SIZE);
+    cache_score_helix_stacking.resize(SIZE);
+    cache_score_junction_hairpin.resize(junction_position.size()*junction_position.size());
+    cache_score_junction_b.resize(junction_position.size()*junction_position.size());
+    cache_score_junction_multi.resize(junction_position.size()*junction_position.size());
+    cache_score_junction_external.resize(junction_position.size()*junction_position.size());
 #ifdef HAVE_VIENNA20
     if (with_turner_)
-        vc_  = vrna_fold_compound(&sequence.c_str()[1], &md_, 0);
+        cache_energy_hairpin.resize(SIZE);
 #endif
 
-    // compute indexing scheme for upper triangular arrays;
-    // also allow each position to be unpaired by default, and
-    // set the loss for each unpaired position to zero
-    for (int i = 0; i <= L; i++)
-    {
-        offset[i] = ComputeRowOffset(i,L+1);
-        allow_unpaired_position[i] = 1;
-        loss_unpaired_position[i] = RealT(0);
-        reactivity_unpaired_position[i] = RealT(0);
-    }
-
-    // allow all ranges to be unpaired, and all pairs of letters
-    // to be paired; set the respective losses to zero
-    for (int i = 0; i < SIZE; i++)
-    {
-        allow_unpaired[i] = 1;
-        allow_paired[i] = 1;
-        loss_unpaired[i] = RealT(0);
-        loss_paired[i] = RealT(0);
-        reactivity_unpaired[i] = RealT(0);
-        reactivity_paired[i] = RealT(0);
-    }
+    // allow all pairs of letters to be paired
+    allow_paired.assign(SIZE, true);
 
     // prevent the non-letter before each sequence from pairing with anything;
     // also prevent each letter from pairing with itself
     for (int i = 0; i <= L; i++)
     {
-        allow_paired[offset[0]+i] = 0;
+        if (i <= BAND) allow_paired[offset[0]+i] = 0;
         allow_paired[offset[i]+i] = 0;
     }
 
@@ -280,7 +303,7 @@ void InferenceEngine<RealT>::LoadSequence(const SStruct &sstruct)
         // for each pair of non-complementary letters in the sequence, disallow the pairing
         for (int i = 1; i <= L; i++)
         {
-            for (int j = i+1; j <= L; j++)
+            for (int j = i+1; j <= std::min(L, i+BAND); j++)
             {
                 if (!IsComplementary(i,j))
                     allow_paired[offset[i]+j] = 0;
@@ -292,12 +315,94 @@ void InferenceEngine<RealT>::LoadSequence(const SStruct &sstruct)
     {
         for (int i = 1; i <= L; i++)
         {
-            for (int j = i+1; j <= L; j++)
+            for (int j = i+C_MAX_SPAN+1; j <= std::min(L, i+BAND); j++)
+                allow_paired[offset[i]+j] = 0;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::EncodeSequence()
+//
+// Convert the sequence into the representations used for scoring,
+// and reset the per-position constraints and losses.  Only the
+// arrays of length L are set here.
+//////////////////////////////////////////////////////////////////////
+
+template<class RealT>
+void InferenceEngine<RealT>::EncodeSequence(const SStruct &sstruct)
+{
+    L = sstruct.GetLength();
+
+    s.resize(L+1);
+    allow_unpaired_position.resize(L+1);
+    unpaired_end.assign(L+1, L);
+    loss_unpaired_position.resize(L+1);
+    loss_const = RealT(0);
+    loss_type = NO_LOSS;
+    reactivity_unpaired_position.resize(L+1);
+    reactivity_paired_position.clear();
+
+    // convert sequences to index representation
+    const std::string &sequence = sstruct.GetSequences()[0];
+    s[0] = '@';
+    for (int i = 1; i <= L; i++)
+    {
+        s[i] = toupper(sequence[i]);
+    }
+#ifdef HAVE_VIENNA20
+    // ViennaRNA's encoding of the sequence (A=1, C=2, G=3, U/T=4, others 0),
+    // with S[0] = S[L] and S[L+1] = S[1] as in vrna_seq_encode(); S[0]
+    // is the 3' mismatch of the exterior pairs starting at position 1
+    if (with_turner_)
+    {
+        turner_sequence_ = ConvertToUpperCase(sequence.substr(1));
+        turner_S_.resize(L+2);
+        for (int i = 1; i <= L; i++)
+        {
+            switch (s[i])
             {
-                if (j-i>C_MAX_SPAN)
-                    allow_paired[offset[i]+j] = 0;
+                case 'A': turner_S_[i] = 1; break;
+                case 'C': turner_S_[i] = 2; break;
+                case 'G': turner_S_[i] = 3; break;
+                case 'U': case 'T': turner_S_[i] = 4; break;
+                default: turner_S_[i] = 0; break;
             }
         }
+        turner_S_[0] = turner_S_[L];
+        turner_S_[L+1] = turner_S_[1];
+    }
+#endif
+
+    // number the distinct pairs of adjacent letters (s[i],s[i+1]); the
+    // junction scores at (i,j) depend on the letters only through those
+    // at i and j, so they are tabulated by the codes.  Both ends of the
+    // sequence get codes of their own.
+    std::map<std::pair<NUCL,NUCL>,int> codes;
+    junction_code.resize(L+1);
+    junction_position.clear();
+    for (int i = 0; i <= L; i++)
+    {
+        if (0 < i && i < L)
+        {
+            auto c = codes.insert(std::make_pair(std::make_pair(s[i], s[i+1]), int(junction_position.size())));
+            if (c.second) junction_position.push_back(i);
+            junction_code[i] = c.first->second;
+        }
+        else
+        {
+            junction_code[i] = junction_position.size();
+            junction_position.push_back(i);
+        }
+    }
+
+    // allow each position (and so each range) to be unpaired by
+    // default, and set the loss for each unpaired position to zero
+    for (int i = 0; i <= L; i++)
+    {
+        allow_unpaired_position[i] = 1;
+        loss_unpaired_position[i] = RealT(0);
+        reactivity_unpaired_position[i] = RealT(0);
     }
 }
 
@@ -388,6 +493,8 @@ void InferenceEngine<RealT>::InitializeCache()
 #endif
 
     // precompute score for single-branch loops of length l1 and l2
+    if (cache_score_single.empty())
+        cache_score_single.assign(C_MAX_SINGLE_LENGTH+1, std::vector<std::pair<RealT,RealT>>(C_MAX_SINGLE_LENGTH+1));
     for (int l1 = 0; l1 <= C_MAX_SINGLE_LENGTH; l1++)
     {
         for (int l2 = 0; l1+l2 <= C_MAX_SINGLE_LENGTH; l2++)
@@ -431,19 +538,65 @@ void InferenceEngine<RealT>::InitializeCache()
         }
     }
 
+    // precompute base-pair and stacking scores for each pair of
+    // positions of the sequence
+    for (int i = 1; i <= L; i++)
+    {
+        for (int j = i+1; j <= std::min(L, i+BAND); j++)
+        {
+            cache_score_base_pair[offset[i]+j] = ScoreBasePairUncached(i,j);
+            cache_score_helix_stacking[offset[i]+j] = j-i >= 3 ? ScoreHelixStackingUncached(i,j) : RealT(0);
+        }
+    }
+
+    // precompute junction scores for each pair of junction codes at
+    // the positions of those codes; ScoreJunctionB() and
+    // ScoreJunctionMulti() are used with both i < j (pair closing a
+    // loop) and i > j (pair enclosed by a loop), so the tables are square
+    const int n = junction_position.size();
+    for (int a = 0; a < n; a++)
+    {
+        const int i = junction_position[a];
+        for (int b = 0; b < n; b++)
+        {
+            const int j = junction_position[b];
+            cache_score_junction_hairpin[a*n+b] = 0 < i && i < L && 0 < j && j < L ? ScoreJunctionHairpinUncached(i,j) : RealT(0);
+            cache_score_junction_b[a*n+b] = 0 < i && i < L && 0 < j && j < L ? ScoreJunctionBUncached(i,j) : RealT(0);
+            cache_score_junction_multi[a*n+b] = 0 < i && j < L ? ScoreJunctionMultiUncached(i,j) : RealT(0);
+            cache_score_junction_external[a*n+b] = 0 < i && j < L ? ScoreJunctionExternalUncached(i,j) : RealT(0);
+        }
+    }
+
+#ifdef HAVE_VIENNA20
+    // Turner energies of hairpins closed by (i,j+1)
+    if (turner_params_)
+    {
+        const short *S = &turner_S_[0];
+        for (int i = 1; i < L; i++)
+        {
+            for (int j = i+C_MIN_HAIRPIN_LENGTH; j < std::min(L, i+BAND); j++)
+            {
+                unsigned char type = md_.pair[S[i]][S[j+1]];
+                cache_energy_hairpin[offset[i]+j] = VIENNA::E_Hairpin(j-i, type, S[i+1], S[j], &turner_sequence_[i-1], turner_params_.get()) / -100.;
+            }
+        }
+    }
+#endif
+
 #if FAST_HELIX_LENGTHS
-    // precompute helix partial sums
+    // precompute helix partial sums; the sum at (i,j) is kept at
+    // (i+j)*(BAND/2+1)+(j-i)/2, as j-i has the same parity as i+j
     FillScores(cache_score_helix_sums.begin(), cache_score_helix_sums.end(), 0);
     for (int i = L; i >= 1; i--)
     {
-        for (int j = i+3; j <= L; j++)
+        for (int j = i+3; j <= std::min(L, i+BAND); j++)
         {
-            cache_score_helix_sums[(i+j)*L+j-i].first = cache_score_helix_sums[(i+j)*L+j-i-2].first;
+            cache_score_helix_sums[(i+j)*(BAND/2+1)+(j-i)/2].first = cache_score_helix_sums[(i+j)*(BAND/2+1)+(j-i)/2-1].first;
             if (allow_paired[offset[i+1]+j-1])
             {
-                cache_score_helix_sums[(i+j)*L+j-i].first += ScoreBasePair(i+1,j-1);
+                cache_score_helix_sums[(i+j)*(BAND/2+1)+(j-i)/2].first += ScoreBasePair(i+1,j-1);
                 if (allow_paired[offset[i]+j])
-                    cache_score_helix_sums[(i+j)*L+j-i].first += ScoreHelixStacking(i,j);
+                    cache_score_helix_sums[(i+j)*(BAND/2+1)+(j-i)/2].first += ScoreHelixStacking(i,j);
             }
         }
     }
@@ -464,12 +617,169 @@ InferenceEngine<RealT>::LoadValues(FeatureMap* fm, const std::vector<param_value
 {
     cache_initialized = false;
     fm_ = fm;
-    params_ = params;
+    params_ = ParameterView<RealT>(params);
 #ifdef PARAMS_VIENNA_COMPAT
     params_base_ = params_base;
 #endif
+#ifdef HAVE_VIENNA20
+    if (turner_params_ && turner_stack.empty())
+        LoadTurnerParameters();
+#endif
+}
+
+// the parameters read through a view, e.g. those of the training on
+// which the regularization is pending
+template<class RealT>
+void
+InferenceEngine<RealT>::LoadValues(FeatureMap* fm, const ParameterView<param_value_type>& params)
+{
+    cache_initialized = false;
+    fm_ = fm;
+    params_ = params;
+#ifdef PARAMS_VIENNA_COMPAT
+    params_base_ = nullptr;
+#endif
+#ifdef HAVE_VIENNA20
+    if (turner_params_ && turner_stack.empty())
+        LoadTurnerParameters();
+#endif
+}
+
+#ifdef HAVE_VIENNA20
+
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::LoadTurnerParameters()
+//
+// Copy the Turner parameters for stacking pairs, bulges and interior
+// loops out of turner_params_ into flat tables used by EnergySingle().
+// Energies are kept in dcal/mol.
+//////////////////////////////////////////////////////////////////////
+
+template<class RealT>
+void InferenceEngine<RealT>::LoadTurnerParameters()
+{
+    const VIENNA::vrna_param_t *P = turner_params_.get();
+    const int NP = NBPAIRS+1;
+
+    turner_stack.resize(NP*NP);
+    turner_int11.resize(NP*NP*5*5);
+    turner_int21.resize(NP*NP*5*5*5);
+    turner_int22.resize(NP*NP*5*5*5*5);
+    for (int t = 0; t < NP; t++)
+    {
+        for (int t2 = 0; t2 < NP; t2++)
+        {
+            const int tt = t*NP+t2;
+            turner_stack[tt] = P->stack[t][t2];
+            for (int a = 0; a < 5; a++)
+            {
+                for (int b = 0; b < 5; b++)
+                {
+                    turner_int11[(tt*5+a)*5+b] = P->int11[t][t2][a][b];
+                    for (int c = 0; c < 5; c++)
+                    {
+                        turner_int21[((tt*5+a)*5+b)*5+c] = P->int21[t][t2][a][b][c];
+                        for (int d = 0; d < 5; d++)
+                            turner_int22[(((tt*5+a)*5+b)*5+c)*5+d] = P->int22[t][t2][a][b][c][d];
+                    }
+                }
+            }
+        }
+    }
+
+    turner_mismatch_i.resize(NP*5*5);
+    turner_mismatch_1n_i.resize(NP*5*5);
+    turner_mismatch_23_i.resize(NP*5*5);
+    for (int t = 0; t < NP; t++)
+    {
+        for (int a = 0; a < 5; a++)
+        {
+            for (int b = 0; b < 5; b++)
+            {
+                turner_mismatch_i[(t*5+a)*5+b] = P->mismatchI[t][a][b];
+                turner_mismatch_1n_i[(t*5+a)*5+b] = P->mismatch1nI[t][a][b];
+                turner_mismatch_23_i[(t*5+a)*5+b] = P->mismatch23I[t][a][b];
+            }
+        }
+    }
+
+    // loop length terms, extrapolated beyond MAXLOOP as ViennaRNA does
+    const int max_length = std::max(C_MAX_SINGLE_LENGTH, MAXLOOP);
+    turner_bulge.resize(max_length+1);
+    turner_internal.resize(max_length+1);
+    turner_ninio.resize(max_length+1);
+    for (int l = 0; l <= max_length; l++)
+    {
+        turner_bulge[l] = l <= MAXLOOP ? P->bulge[l] : P->bulge[30] + (int)(P->lxc * log(l / 30.));
+        turner_internal[l] = l <= MAXLOOP ? P->internal_loop[l] : P->internal_loop[30] + (int)(P->lxc * log(l / 30.));
+        turner_ninio[l] = std::min(VIENNA::MAX_NINIO, l * P->ninio[2]);
+    }
+    turner_internal_23 = P->internal_loop[5] + P->ninio[2];
+    turner_terminal_au = P->TerminalAU;
+}
+
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::EnergySingle()
+//
+// Returns the Turner energy (in dcal/mol) of a stacking pair, bulge
+// or interior loop with l1 and l2 unpaired bases; the arguments are
+// those of VIENNA::E_IntLoop(), which this follows case by case.
+//////////////////////////////////////////////////////////////////////
+
+template<class RealT>
+inline int InferenceEngine<RealT>::EnergySingle(int l1, int l2, int type, int type2, int si1, int sj1, int sp1, int sq1) const
+{
+    const int NP = NBPAIRS+1;
+    const int nl = std::max(l1, l2);
+    const int ns = std::min(l1, l2);
+
+    // stacking pair
+    if (nl == 0)
+        return turner_stack[type*NP+type2];
+
+    // bulge loop
+    if (ns == 0)
+    {
+        int e = turner_bulge[nl];
+        if (nl == 1)
+            e += turner_stack[type*NP+type2];
+        else
+        {
+            if (type > 2) e += turner_terminal_au;
+            if (type2 > 2) e += turner_terminal_au;
+        }
+        return e;
+    }
+
+    // interior loops; 1x1, 2x1 and 2x2 loops are tabulated explicitly
+    if (ns == 1)
+    {
+        if (nl == 1)
+            return turner_int11[((type*NP+type2)*5+si1)*5+sj1];
+        if (nl == 2)
+        {
+            if (l1 == 1)
+                return turner_int21[(((type*NP+type2)*5+si1)*5+sq1)*5+sj1];
+            else
+                return turner_int21[(((type2*NP+type)*5+sq1)*5+si1)*5+sp1];
+        }
+        return turner_internal[nl+1] + turner_ninio[nl-ns]
+            + turner_mismatch_1n_i[(type*5+si1)*5+sj1] + turner_mismatch_1n_i[(type2*5+sq1)*5+sp1];
+    }
+    if (ns == 2)
+    {
+        if (nl == 2)
+            return turner_int22[((((type*NP+type2)*5+si1)*5+sp1)*5+sq1)*5+sj1];
+        if (nl == 3)
+            return turner_internal_23
+                + turner_mismatch_23_i[(type*5+si1)*5+sj1] + turner_mismatch_23_i[(type2*5+sq1)*5+sp1];
+    }
+    return turner_internal[nl+ns] + turner_ninio[nl-ns]
+        + turner_mismatch_i[(type*5+si1)*5+sj1] + turner_mismatch_i[(type2*5+sq1)*5+sp1];
 }
 
+#endif
+
 //////////////////////////////////////////////////////////////////////
 // InferenceEngine::ClearCounts()
 //
@@ -480,6 +790,26 @@ template<class RealT>
 void InferenceEngine<RealT>::ClearCounts()
 {
     // clear counts for cache
+    ClearLengthCounts();
+
+    for (int l1 = 0; l1 <= C_MAX_SINGLE_LENGTH; l1++)
+        for (int l2 = 0; l2 <= C_MAX_SINGLE_LENGTH; l2++)
+            cache_score_single[l1][l2].second = 0;
+
+#if FAST_HELIX_LENGTHS
+    FillCounts(cache_score_helix_sums.begin(), cache_score_helix_sums.end(), 0);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::ClearLengthCounts()
+//
+// Set the counts for the length and distance caches to zero.
+//////////////////////////////////////////////////////////////////////
+
+template<class RealT>
+void InferenceEngine<RealT>::ClearLengthCounts()
+{
 #if PARAMS_BASE_PAIR_DIST
     for (int i = 0; i <= BP_DIST_LAST_THRESHOLD; i++)
         cache_score_base_pair_dist[i].second = 0;
@@ -494,14 +824,6 @@ void InferenceEngine<RealT>::ClearCounts()
     for (int i = 0; i <= D_MAX_HELIX_LENGTH; i++)
         cache_score_helix_length[i].second = 0;
 #endif
-
-    for (int l1 = 0; l1 <= C_MAX_SINGLE_LENGTH; l1++)
-        for (int l2 = 0; l2 <= C_MAX_SINGLE_LENGTH; l2++)
-            cache_score_single[l1][l2].second = 0;
-
-#if FAST_HELIX_LENGTHS
-    FillCounts(cache_score_helix_sums.begin(), cache_score_helix_sums.end(), 0);
-#endif
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -520,50 +842,34 @@ void InferenceEngine<RealT>::FinalizeCounts()
 
     for (int i = 1; i <= L; i++)
     {
-        for (int j = L; j >= i+3; j--)
+        for (int j = std::min(L, i+BAND); j >= i+3; j--)
         {
             // the "if" conditions here can be omitted
 
             if (allow_paired[offset[i+1]+j-1])
             {
-                CountBasePair(i+1,j-1,reverse_sums[(i+j)*L+j-i].second);
+                CountBasePair(i+1,j-1,reverse_sums[(i+j)*(BAND/2+1)+(j-i)/2].second);
                 if (allow_paired[offset[i]+j])
                 {
-                    CountHelixStacking(i,j,reverse_sums[(i+j)*L+j-i].second);
+                    CountHelixStacking(i,j,reverse_sums[(i+j)*(BAND/2+1)+(j-i)/2].second);
                 }
                 else
                 {
-                    Assert(Abs(double(reverse_sums[(i+j)*L+j-i].second)) < 1e-8, "Should be zero.");
+                    Assert(Abs(double(reverse_sums[(i+j)*(BAND/2+1)+(j-i)/2].second)) < 1e-8, "Should be zero.");
                 }
             }
             else
             {
-                Assert(Abs(double(reverse_sums[(i+j)*L+j-i-2].second)) < 1e-8, "Should be zero.");
+                Assert(Abs(double(reverse_sums[(i+j)*(BAND/2+1)+(j-i)/2-1].second)) < 1e-8, "Should be zero.");
             }
 
-            reverse_sums[(i+j)*L+j-i-2].second += reverse_sums[(i+j)*L+j-i].second;
+            reverse_sums[(i+j)*(BAND/2+1)+(j-i)/2-1].second += reverse_sums[(i+j)*(BAND/2+1)+(j-i)/2].second;
         }
     }
 #endif
 
     // perform transformations
-#if PARAMS_BASE_PAIR_DIST
-    for (int i = 0; i < D_MAX_BP_DIST_THRESHOLDS; i++)
-        for (int j = BP_DIST_THRESHOLDS[i]; j <= BP_DIST_LAST_THRESHOLD; j++)
-            insert_param(counts_, fm_->insert_base_pair_dist_at_least(i)) += cache_score_base_pair_dist[j].second;
-#endif
-
-#if PARAMS_HAIRPIN_LENGTH
-    for (int i = 0; i <= D_MAX_HAIRPIN_LENGTH; i++)
-        for (int j = i; j <= D_MAX_HAIRPIN_LENGTH; j++)
-            insert_param(counts_, fm_->insert_hairpin_length_at_least(i)) += cache_score_hairpin_length[j].second;
-#endif
-
-#if PARAMS_HELIX_LENGTH
-    for (int i = 0; i <= D_MAX_HELIX_LENGTH; i++)
-        for (int j = i; j <= D_MAX_HELIX_LENGTH; j++)
-            insert_param(counts_, fm_->insert_helix_length_at_least(i)) += cache_score_helix_length[j].second;
-#endif
+    FinalizeLengthCounts();
 
     // allocate temporary storage
 #if PARAMS_BULGE_LENGTH
@@ -653,6 +959,35 @@ void InferenceEngine<RealT>::FinalizeCounts()
 #endif
 }
 
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::FinalizeLengthCounts()
+//
+// Transfer the counts for the length and distance caches to the
+// cumulative features.
+//////////////////////////////////////////////////////////////////////
+
+template<class RealT>
+void InferenceEngine<RealT>::FinalizeLengthCounts()
+{
+#if PARAMS_BASE_PAIR_DIST
+    for (int i = 0; i < D_MAX_BP_DIST_THRESHOLDS; i++)
+        for (int j = BP_DIST_THRESHOLDS[i]; j <= BP_DIST_LAST_THRESHOLD; j++)
+            insert_param(counts_, fm_->insert_base_pair_dist_at_least(i)) += cache_score_base_pair_dist[j].second;
+#endif
+
+#if PARAMS_HAIRPIN_LENGTH
+    for (int i = 0; i <= D_MAX_HAIRPIN_LENGTH; i++)
+        for (int j = i; j <= D_MAX_HAIRPIN_LENGTH; j++)
+            insert_param(counts_, fm_->insert_hairpin_length_at_least(i)) += cache_score_hairpin_length[j].second;
+#endif
+
+#if PARAMS_HELIX_LENGTH
+    for (int i = 0; i <= D_MAX_HELIX_LENGTH; i++)
+        for (int j = i; j <= D_MAX_HELIX_LENGTH; j++)
+            insert_param(counts_, fm_->insert_helix_length_at_least(i)) += cache_score_helix_length[j].second;
+#endif
+}
+
 //////////////////////////////////////////////////////////////////////
 // InferenceEngine::UseLoss()
 //
@@ -682,21 +1017,22 @@ void InferenceEngine<RealT>::UseLoss(const std::vector<int> &true_mapping, RealT
     }
 
     // now, compute the penalty for declaring ranges of positions to be unpaired;
-    // also, compute the penalty for matching positions s[i] and s[j].
+    // the penalty for matching positions s[i] and s[j] is given by LossPaired().
+    loss_unpaired.resize(SIZE);
     for (int i = 0; i <= L; i++)
     {
         loss_unpaired[offset[i]+i] = RealT(0);
-        loss_paired[offset[i]+i] = RealT(NEG_INF);
-        for (int j = i+1; j <= L; j++)
+        for (int j = i+1; j <= std::min(L, i+BAND); j++)
         {
             loss_unpaired[offset[i]+j] = 
                 loss_unpaired[offset[i]+j-1] +
                 loss_unpaired_position[j];
-            loss_paired[offset[i]+j] = 
-                ((i == 0 || true_mapping[i] == SStruct::UNKNOWN || true_mapping[i] == SStruct::UNPAIRED || true_mapping[i] == j) ? RealT(0) : per_position_loss) +
-                ((i == 0 || true_mapping[j] == SStruct::UNKNOWN || true_mapping[j] == SStruct::UNPAIRED || true_mapping[j] == i) ? RealT(0) : per_position_loss);
         }
     }
+
+    loss_type = LOSS_CONTRAFOLD;
+    loss_mapping = true_mapping;
+    loss_pos_w = per_position_loss;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -711,27 +1047,22 @@ void InferenceEngine<RealT>::UseLossBasePair(const std::vector<int> &true_mappin
     Assert(int(true_mapping.size()) == L+1, "Mapping of incorrect length!");
     cache_initialized = false;
 
-    for (int i = 0; i <= L; i++)
+    // the loss of each base pair is given by LossPaired(); the constant
+    // is summed over all the pairs, also those out of the band, so that
+    // the loss does not depend on --max-span
+    for (int i = 1; i <= L; i++)
     {
-        loss_paired[offset[i]+i] = RealT(NEG_INF);
         for (int j = i+1; j <= L; j++)
         {
-            if (i==0)
-                loss_paired[offset[i]+j] = 0;
-            else if (true_mapping[i] == j /* && true_mapping[j] == i */)
-            {
-                loss_paired[offset[i]+j] = -pos_w;
+            if (true_mapping[i] == j /* && true_mapping[j] == i */)
                 loss_const += pos_w;
-            }
-            else if (true_mapping[i] == SStruct::UNPAIRED || true_mapping[j] == SStruct::UNPAIRED ||
-                     (true_mapping[i] > 0 && true_mapping[i] != j) || (true_mapping[j] > 0 && true_mapping[j] != i))
-                loss_paired[offset[i]+j] = neg_w;
-            //else if (true_mapping[i] == SStruct::PAIRED && true_mapping[j] == SStruct::PAIRED)
-            //    loss_paired[offset[i]+j] = -pos_w;
-            //else
-            //    loss_paired[offset[i]+j] = 0;
         }
     }
+
+    loss_type = LOSS_BASE_PAIR;
+    loss_mapping = true_mapping;
+    loss_pos_w = pos_w;
+    loss_neg_w = neg_w;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -746,35 +1077,24 @@ void InferenceEngine<RealT>::UseLossPosition(const std::vector<int> &true_mappin
     Assert(int(true_mapping.size()) == L+1, "Mapping of incorrect length!");
     cache_initialized = false;
 
-    for (int i = 0; i <= L; i++)
+    // the loss of each base pair is given by LossPaired(); the constant
+    // is summed over all the pairs, also those out of the band, so that
+    // the loss does not depend on --max-span
+    for (int i = 1; i <= L; i++)
     {
-        loss_paired[offset[i]+i] = RealT(NEG_INF);
         for (int j = i+1; j <= L; j++)
         {
-            loss_paired[offset[i]+j] = 0;
-            if (i==0) continue;
-
             if (true_mapping[i] == SStruct::PAIRED || true_mapping[i] > 0)
-            {
-                loss_paired[offset[i]+j] += -pos_w/2;
                 loss_const += pos_w/2;
-            }
-            else if (true_mapping[i] == SStruct::UNPAIRED)
-            {
-                loss_paired[offset[i]+j] += neg_w/2;
-            }
-
             if (true_mapping[j] == SStruct::PAIRED || true_mapping[j] > 0)
-            {
-                loss_paired[offset[i]+j] += -pos_w/2;
                 loss_const += pos_w/2;
-            }
-            else if (true_mapping[j] == SStruct::UNPAIRED)
-            {
-                loss_paired[offset[i]+j] += neg_w/2;
-            }
         }
     }
+
+    loss_type = LOSS_POSITION;
+    loss_mapping = true_mapping;
+    loss_pos_w = pos_w;
+    loss_neg_w = neg_w;
 }
 
 template<class RealT>
@@ -783,20 +1103,19 @@ void InferenceEngine<RealT>::UseLossReactivity(const std::vector<float> &reactiv
     Assert(int(reactivity_pair.size()) == L+1, "Mapping of incorrect length!");
     cache_initialized = false;
 
-    for (int i = 0; i <= L; i++)
+    // the loss of each base pair is given by LossPaired(); the constant
+    // is summed over all the pairs, also those out of the band, so that
+    // the loss does not depend on --max-span
+    for (int i = 1; i <= L; i++)
     {
-        loss_paired[offset[i]+i] = RealT(NEG_INF);
         for (int j = i+1; j <= L; j++)
-        {
-            loss_paired[offset[i]+j] = 0;
-            if (i==0) continue;
-
-            loss_paired[offset[i]+j] += 
-                - pos_w/2 * (reactivity_pair[i] + reactivity_pair[j]) 
-                + neg_w/2 * (1.0-reactivity_pair[i] + 1.0-reactivity_pair[j]); 
             loss_const += pos_w/2 * (reactivity_pair[i] + reactivity_pair[j]);
-        }
     }
+
+    loss_type = LOSS_REACTIVITY;
+    loss_reactivity = reactivity_pair;
+    loss_pos_w = pos_w;
+    loss_neg_w = neg_w;
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -818,25 +1137,28 @@ void InferenceEngine<RealT>::UseConstraints(const std::vector<int> &true_mapping
             (true_mapping[i] == SStruct::UNKNOWN ||
              true_mapping[i] == SStruct::UNPAIRED ||
              std::abs(i-true_mapping[i]) <= C_MIN_HAIRPIN_LENGTH ||
-             (!allow_noncomplementary && true_mapping[i]>0 && !IsComplementary(i, true_mapping[i])));
+             (!allow_noncomplementary && true_mapping[i]>0 && !IsComplementary(i, true_mapping[i])) ||
+             (C_MAX_SPAN >= 0 && true_mapping[i]>0 && std::abs(i-true_mapping[i]) > C_MAX_SPAN));
     }
 
-    // determine whether we allow ranges of positions to be unpaired;
-    // also determine which base-pairings we allow
+    // determine whether we allow ranges of positions to be unpaired,
+    // i.e. how far the positions allowed to be unpaired extend
+    unpaired_end[L] = L;
+    for (int i = L-1; i >= 0; i--)
+        unpaired_end[i] = allow_unpaired_position[i+1] ? unpaired_end[i+1] : i;
+
+    // determine which base-pairings we allow
     for (int i = 0; i <= L; i++)
     {
-        allow_unpaired[offset[i]+i] = 1;
-        allow_paired[offset[i]+i] = 0;
-        for (int j = i+1; j <= L; j++)
+        allow_paired[offset[i]+i] = false;
+        for (int j = i+1; j <= std::min(L, i+BAND); j++)
         {
-            allow_unpaired[offset[i]+j] =
-                allow_unpaired[offset[i]+j-1] &&
-                allow_unpaired_position[j];
             allow_paired[offset[i]+j] =
                 (i > 0 &&
                  (true_mapping[i] == SStruct::UNKNOWN || true_mapping[i] == SStruct::PAIRED || true_mapping[i] == j) &&
                  (true_mapping[j] == SStruct::UNKNOWN || true_mapping[j] == SStruct::PAIRED || true_mapping[j] == i) &&
-                 (allow_noncomplementary || IsComplementary(i,j)));
+                 (allow_noncomplementary || IsComplementary(i,j)) &&
+                 (C_MAX_SPAN < 0 || j-i <= C_MAX_SPAN));
         }
     }
 }
@@ -853,15 +1175,117 @@ void InferenceEngine<RealT>::UseSoftConstraints(const std::vector<float> &reacti
 {
     cache_initialized = false;
 
-    std::vector<float> pe(L+1);
+    // the score of each base pair is given by ReactivityPaired()
+    std::vector<float> &pe = reactivity_paired_position;
+    pe.resize(L+1);
     for (int i = 0; i <= L; i++)
         pe[i] = log((reactivity_pair[i]+0.01)/(1.0-reactivity_pair[i]+0.01));
+    reactivity_scale = scale_reactivity;
+}
 
-    for (int i = 0; i <= L; i++)
-        for (int j = i+1; j <= L; j++)
-            reactivity_paired[offset[i]+j] = scale_reactivity * (pe[i] + pe[j]);
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::UseThreads()
+//
+// Set the number of threads for the dynamic programming.  The
+// results do not depend on the number of threads.
+//////////////////////////////////////////////////////////////////////
+
+template<class RealT>
+void InferenceEngine<RealT>::UseThreads(int num_threads)
+{
+    this->num_threads = std::max(1, num_threads);
+}
+
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::UseCheckpoints()
+//
+// Compute the posteriors without keeping the whole of FC, FM, FE, FN
+// and the outside matrices but FM2.  The inside algorithm keeps the
+// rows of FC, FM, FE and FN only at the checkpoints, the first rows of
+// every interval, from which the others are recomputed an interval at
+// a time during the outside algorithm, and the posteriors are
+// collected as soon as each row (each interval, with several threads)
+// of the outside matrices is filled.  FM1, FM2 and the column-major
+// copy of FM are kept whole, as the multi-branch loops read them over
+// whole rows and columns.  This takes about one more run of the inside
+// algorithm, and on one thread, the posteriors are the same as those
+// of the full run.  With interval = 0, it is chosen so as to minimize
+// the memory, and with interval < 0 (the default), the whole matrices
+// are kept.
+//////////////////////////////////////////////////////////////////////
+
+template<class RealT>
+void InferenceEngine<RealT>::UseCheckpoints(int interval)
+{
+#if !COLUMN_MAJOR_FM2
+    Assert(interval < 0, "The checkpointed run needs COLUMN_MAJOR_FM2.");
+#endif
+    checkpoint_interval = interval;
+}
+
+
+// whether s[i+1...j] may be left unpaired
+
+template<class RealT>
+inline bool InferenceEngine<RealT>::AllowUnpaired(int i, int j) const
+{
+    return j <= unpaired_end[i];
+}
+
+// loss for a base-pairing between letters i and j, 0 < i < j <= L
+
+template<class RealT>
+inline RealT InferenceEngine<RealT>::LossPaired(int i, int j) const
+{
+    const std::vector<int> &m = loss_mapping;
+    const std::vector<float> &r = loss_reactivity;
+    const RealT pos_w = loss_pos_w;
+    const RealT neg_w = loss_neg_w;
+    RealT loss = RealT(0);
+
+    switch (loss_type)
+    {
+        case NO_LOSS:
+            break;
+        case LOSS_CONTRAFOLD:
+            loss =
+                ((m[i] == SStruct::UNKNOWN || m[i] == SStruct::UNPAIRED || m[i] == j) ? RealT(0) : pos_w) +
+                ((m[j] == SStruct::UNKNOWN || m[j] == SStruct::UNPAIRED || m[j] == i) ? RealT(0) : pos_w);
+            break;
+        case LOSS_BASE_PAIR:
+            if (m[i] == j /* && m[j] == i */)
+                loss = -pos_w;
+            else if (m[i] == SStruct::UNPAIRED || m[j] == SStruct::UNPAIRED ||
+                     (m[i] > 0 && m[i] != j) || (m[j] > 0 && m[j] != i))
+                loss = neg_w;
+            break;
+        case LOSS_POSITION:
+            if (m[i] == SStruct::PAIRED || m[i] > 0)
+                loss += -pos_w/2;
+            else if (m[i] == SStruct::UNPAIRED)
+                loss += neg_w/2;
+            if (m[j] == SStruct::PAIRED || m[j] > 0)
+                loss += -pos_w/2;
+            else if (m[j] == SStruct::UNPAIRED)
+                loss += neg_w/2;
+            break;
+        case LOSS_REACTIVITY:
+            loss +=
+                - pos_w/2 * (r[i] + r[j])
+                + neg_w/2 * (1.0-r[i] + 1.0-r[j]);
+            break;
+    }
+    return loss;
 }
 
+// soft constraint for a base-pairing between letters i and j
+
+template<class RealT>
+inline RealT InferenceEngine<RealT>::ReactivityPaired(int i, int j) const
+{
+    if (reactivity_paired_position.empty()) return RealT(0);
+    return float(reactivity_scale * (reactivity_paired_position[i] + reactivity_paired_position[j]));
+}
 
 // score for leaving s[i] unpaired
 
@@ -881,7 +1305,7 @@ inline void InferenceEngine<RealT>::CountUnpairedPosition(int i, RealT v)
 template<class RealT>
 inline RealT InferenceEngine<RealT>::ScoreUnpaired(int i, int j) const
 {
-    return loss_unpaired[offset[i]+j]+reactivity_unpaired[offset[i]+j];
+    return loss_unpaired.empty() ? RealT(0) : loss_unpaired[offset[i]+j];
 }
 
 template<class RealT>
@@ -916,8 +1340,8 @@ inline RealT InferenceEngine<RealT>::ScoreMultiBase() const
 {
     RealT e = RealT(0);
 #ifdef HAVE_VIENNA20
-    if (vc_)
-        e = vc_->params->MLclosing / -100.;
+    if (turner_params_)
+        e = turner_params_->MLclosing / -100.;
 #endif
 
 #if PARAMS_MULTI_LENGTH
@@ -966,8 +1390,8 @@ inline RealT InferenceEngine<RealT>::ScoreMultiUnpaired(int i) const
 {
     RealT e = RealT(0);
 #ifdef HAVE_VIENNA20
-    if (vc_)
-        e = vc_->params->MLbase / -100.;
+    if (turner_params_)
+        e = turner_params_->MLbase / -100.;
 #endif
 
 #if PARAMS_MULTI_LENGTH
@@ -1040,16 +1464,16 @@ inline void InferenceEngine<RealT>::CountExternalUnpaired(int i, RealT v)
 //       |         |
 
 template<class RealT>
-inline RealT InferenceEngine<RealT>::ScoreHelixStacking(int i, int j) const
+inline RealT InferenceEngine<RealT>::ScoreHelixStackingUncached(int i, int j) const
 {
     RealT e = RealT(0);
 #ifdef HAVE_VIENNA20
-    if (vc_)
+    if (turner_params_)
     {
-        short *S = vc_->sequence_encoding;
+        const short *S = &turner_S_[0];
         unsigned char type   = md_.pair[S[i]][S[j]];
         unsigned char type2  = md_.pair[S[j-1]][S[i+1]];
-        e = VIENNA::E_IntLoop(0, 0, type, type2, S[i+1], S[j-1], S[i], S[j], vc_->params) / -100.;
+        e = EnergySingle(0, 0, type, type2, S[i+1], S[j-1], S[i], S[j]) / -100.;
     }
 #endif
 
@@ -1060,6 +1484,13 @@ inline RealT InferenceEngine<RealT>::ScoreHelixStacking(int i, int j) const
 #endif
 }
 
+template<class RealT>
+inline RealT InferenceEngine<RealT>::ScoreHelixStacking(int i, int j) const
+{
+    Assert(0 < i && i < j && j <= L, "Invalid indices.");
+    return cache_score_helix_stacking[offset[i]+j];
+}
+
 template<class RealT>
 inline void InferenceEngine<RealT>::CountHelixStacking(int i,int j, RealT v)
 {
@@ -1129,7 +1560,7 @@ inline void InferenceEngine<RealT>::CountJunctionA(int i, int j, RealT value)
 }
 
 template<class RealT>
-inline RealT InferenceEngine<RealT>::ScoreJunctionMulti(int i, int j) const
+inline RealT InferenceEngine<RealT>::ScoreJunctionMultiUncached(int i, int j) const
 {
     // i and j must be bounded away from the edges so that s[i] and s[j+1]
     // refer to actual nucleotides.  To allow us to use this macro when
@@ -1141,11 +1572,11 @@ inline RealT InferenceEngine<RealT>::ScoreJunctionMulti(int i, int j) const
 
     RealT e = RealT(0);
 #ifdef HAVE_VIENNA20
-    if (vc_)
+    if (turner_params_)
     {
-        short *S = vc_->sequence_encoding;
+        const short *S = &turner_S_[0];
         unsigned char type   = md_.pair[S[i]][S[j+1]];
-        e = VIENNA::E_MLstem(type, S[i+1], S[j], vc_->params) / -100.;
+        e = VIENNA::E_MLstem(type, S[i+1], S[j], turner_params_.get()) / -100.;
     }
 #endif
     return e
@@ -1162,6 +1593,13 @@ inline RealT InferenceEngine<RealT>::ScoreJunctionMulti(int i, int j) const
         ;
 }
 
+template<class RealT>
+inline RealT InferenceEngine<RealT>::ScoreJunctionMulti(int i, int j) const
+{
+    Assert(0 < i && i <= L && 0 <= j && j < L, "Invalid indices.");
+    return cache_score_junction_multi[junction_code[i]*junction_position.size()+junction_code[j]];
+}
+
 template<class RealT>
 inline void InferenceEngine<RealT>::CountJunctionMulti(int i, int j, RealT value)
 {
@@ -1180,7 +1618,7 @@ inline void InferenceEngine<RealT>::CountJunctionMulti(int i, int j, RealT value
 }
 
 template<class RealT>
-inline RealT InferenceEngine<RealT>::ScoreJunctionExternal(int i, int j) const
+inline RealT InferenceEngine<RealT>::ScoreJunctionExternalUncached(int i, int j) const
 {
     // i and j must be bounded away from the edges so that s[i] and s[j+1]
     // refer to actual nucleotides.  To allow us to use this macro when
@@ -1191,11 +1629,11 @@ inline RealT InferenceEngine<RealT>::ScoreJunctionExternal(int i, int j) const
     Assert(0 < i && i <= L && 0 <= j && j < L, "Invalid indices.");
     RealT e = RealT(0);
 #ifdef HAVE_VIENNA20
-    if (vc_)
+    if (turner_params_)
     {
-        short *S = vc_->sequence_encoding;
+        const short *S = &turner_S_[0];
         unsigned char type   = md_.pair[S[i]][S[j+1]];
-        e = VIENNA::E_ExtLoop(type, S[i+1], S[j], vc_->params) / -100.;
+        e = VIENNA::E_ExtLoop(type, S[i+1], S[j], turner_params_.get()) / -100.;
     }
 #endif
     return e
@@ -1212,6 +1650,13 @@ inline RealT InferenceEngine<RealT>::ScoreJunctionExternal(int i, int j) const
         ;
 }
 
+template<class RealT>
+inline RealT InferenceEngine<RealT>::ScoreJunctionExternal(int i, int j) const
+{
+    Assert(0 < i && i <= L && 0 <= j && j < L, "Invalid indices.");
+    return cache_score_junction_external[junction_code[i]*junction_position.size()+junction_code[j]];
+}
+
 template<class RealT>
 inline void InferenceEngine<RealT>::CountJunctionExternal(int i, int j, RealT value)
 {
@@ -1231,6 +1676,7 @@ inline void InferenceEngine<RealT>::CountJunctionExternal(int i, int j, RealT va
 
 //////////////////////////////////////////////////////////////////////
 // InferenceEngine::ScoreJunctionB()
+// InferenceEngine::ScoreJunctionBUncached()
 // InferenceEngine::CountJunctionB()
 //
 // Returns the score for a symmetric junction at positions i
@@ -1248,11 +1694,12 @@ inline void InferenceEngine<RealT>::CountJunctionExternal(int i, int j, RealT va
 // Note that the difference between ScoreJunctionA() and
 // ScoreJunctionB() is that the former applies to multi-branch
 // loops whereas the latter is used for hairpin loops and
-// single-branch loops.
+// single-branch loops.  As for ScoreBasePair(), the uncached
+// version is only used to fill the per-sequence table.
 //////////////////////////////////////////////////////////////////////
 
 template<class RealT>
-inline RealT InferenceEngine<RealT>::ScoreJunctionB(int i, int j) const
+inline RealT InferenceEngine<RealT>::ScoreJunctionBUncached(int i, int j) const
 {
     // The bounds here are similar to the asymmetric junction case, with
     // the main difference being that symmetric junctions are not allowed
@@ -1270,6 +1717,13 @@ inline RealT InferenceEngine<RealT>::ScoreJunctionB(int i, int j) const
         ;
 }
 
+template<class RealT>
+inline RealT InferenceEngine<RealT>::ScoreJunctionB(int i, int j) const
+{
+    Assert(0 < i && i < L && 0 < j && j < L, "Invalid indices.");
+    return cache_score_junction_b[junction_code[i]*junction_position.size()+junction_code[j]];
+}
+
 template<class RealT>
 inline void InferenceEngine<RealT>::CountJunctionB(int i, int j, RealT value)
 {
@@ -1284,7 +1738,7 @@ inline void InferenceEngine<RealT>::CountJunctionB(int i, int j, RealT value)
 }
 
 template<class RealT>
-inline RealT InferenceEngine<RealT>::ScoreJunctionHairpin(int i, int j) const
+inline RealT InferenceEngine<RealT>::ScoreJunctionHairpinUncached(int i, int j) const
 {
     // The bounds here are similar to the asymmetric junction case, with
     // the main difference being that symmetric junctions are not allowed
@@ -1305,6 +1759,13 @@ inline RealT InferenceEngine<RealT>::ScoreJunctionHairpin(int i, int j) const
         ;
 }
 
+template<class RealT>
+inline RealT InferenceEngine<RealT>::ScoreJunctionHairpin(int i, int j) const
+{
+    Assert(0 < i && i < j && j < L, "Invalid indices.");
+    return cache_score_junction_hairpin[junction_code[i]*junction_position.size()+junction_code[j]];
+}
+
 template<class RealT>
 inline void InferenceEngine<RealT>::CountJunctionHairpin(int i, int j, RealT value)
 {
@@ -1437,19 +1898,22 @@ inline void InferenceEngine<RealT>::CountJunctionInternal23(int i, int j, RealT
 
 //////////////////////////////////////////////////////////////////////
 // InferenceEngine::ScoreBasePair()
+// InferenceEngine::ScoreBasePairUncached()
 // InferenceEngine::CountBasePair()
 //
 // Returns the score for a base-pairing between letters i and j.
+// The uncached version evaluates the features and is only used to
+// fill the per-sequence table in InitializeCache().
 //////////////////////////////////////////////////////////////////////
 
 template<class RealT>
-inline RealT InferenceEngine<RealT>::ScoreBasePair(int i, int j) const
+inline RealT InferenceEngine<RealT>::ScoreBasePairUncached(int i, int j) const
 {
     // Clearly, i and j must refer to actual letters of the sequence,
     // and no letter may base-pair to itself.
     Assert(0 < i && i <= L && 0 < j && j <= L && i != j, "Invalid base-pair");
 
-    return reactivity_paired[offset[i]+j] + loss_paired[offset[i]+j]
+    return ReactivityPaired(i,j) + LossPaired(i,j)
 #if PARAMS_BASE_PAIR
         + find_param(params_, fm_->find_base_pair(s[i], s[j]))
 #endif
@@ -1459,6 +1923,13 @@ inline RealT InferenceEngine<RealT>::ScoreBasePair(int i, int j) const
         ;
 }
 
+template<class RealT>
+inline RealT InferenceEngine<RealT>::ScoreBasePair(int i, int j) const
+{
+    Assert(0 < i && i < j && j <= L, "Invalid base-pair");
+    return cache_score_base_pair[offset[i]+j];
+}
+
 template<class RealT>
 inline void InferenceEngine<RealT>::CountBasePair(int i, int j, RealT value)
 {
@@ -1504,12 +1975,8 @@ inline RealT InferenceEngine<RealT>::ScoreHairpin(int i, int j) const
 
     RealT e = RealT(0);
 #ifdef HAVE_VIENNA20
-    if (vc_)
-    {
-        short *S = vc_->sequence_encoding;
-        unsigned char type   = md_.pair[S[i]][S[j+1]];
-        e = VIENNA::E_Hairpin(j-i, type, S[i+1], S[j], vc_->sequence+i-1, vc_->params) / -100.;
-    }
+    if (turner_params_)
+        e = cache_energy_hairpin[offset[i]+j];
 #endif
 
     return
@@ -1586,7 +2053,7 @@ inline RealT InferenceEngine<RealT>::ScoreHelix(int i, int j, int m) const
 #if FAST_HELIX_LENGTHS
 
     return
-        cache_score_helix_sums[(i+j+1)*L+j-i-1].first - cache_score_helix_sums[(i+j+1)*L+j-i-m-m+1].first
+        cache_score_helix_sums[(i+j+1)*(BAND/2+1)+(j-i-1)/2].first - cache_score_helix_sums[(i+j+1)*(BAND/2+1)+(j-i-m-m+1)/2].first
 #if PARAMS_HELIX_LENGTH
         + cache_score_helix_length[m].first
 #endif
@@ -1616,8 +2083,8 @@ inline void InferenceEngine<RealT>::CountHelix(int i, int j, int m, RealT value)
 
 #if FAST_HELIX_LENGTHS
 
-    cache_score_helix_sums[(i+j+1)*L+j-i-1].second += value;
-    cache_score_helix_sums[(i+j+1)*L+j-i-m-m+1].second -= value;
+    cache_score_helix_sums[(i+j+1)*(BAND/2+1)+(j-i-1)/2].second += value;
+    cache_score_helix_sums[(i+j+1)*(BAND/2+1)+(j-i-m-m+1)/2].second -= value;
 
 #else
 
@@ -1782,12 +2249,12 @@ inline RealT InferenceEngine<RealT>::ScoreSingle(int i, int j, int p, int q) con
 
     RealT e = RealT(0);
 #ifdef HAVE_VIENNA20
-    if (vc_)
+    if (turner_params_)
     {
-        short *S = vc_->sequence_encoding;
+        const short *S = &turner_S_[0];
         unsigned char type   = md_.pair[S[i]][S[j+1]];
         unsigned char type2  = md_.pair[S[q]][S[p+1]];
-        e = VIENNA::E_IntLoop(l1, l2, type, type2, S[i+1], S[j], S[p], S[q+1], vc_->params) / -100.;
+        e = EnergySingle(l1, l2, type, type2, S[i+1], S[j], S[p], S[q+1]) / -100.;
     }
 #endif
 
@@ -1815,6 +2282,56 @@ inline void InferenceEngine<RealT>::CountSingle(int i, int j, int p, int q, Real
     CountSingleNucleotides(i,j,p,q,value);
 }
 
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::CountSingleLength()
+//
+// Count the length features of a single-branch loop with l1 and l2
+// unpaired nucleotides directly, which FinalizeCounts() does for
+// the loops counted in cache_score_single.
+//////////////////////////////////////////////////////////////////////
+
+template<class RealT>
+void InferenceEngine<RealT>::CountSingleLength(int l1, int l2, RealT value)
+{
+    Assert(l1 + l2 > 0 && l1 >= 0 && l2 >= 0, "Invalid single-branch loop size.");
+
+    // consider bulge loops
+    if (l1 == 0 || l2 == 0)
+    {
+#if PARAMS_BULGE_LENGTH
+        for (int i = 0; i <= std::min(D_MAX_BULGE_LENGTH, l1+l2); i++)
+            insert_param(counts_, fm_->insert_bulge_length_at_least(i)) += value;
+#endif
+    }
+
+    // consider internal loops
+    else
+    {
+#if PARAMS_INTERNAL_EXPLICIT
+        if (l1 <= D_MAX_INTERNAL_EXPLICIT_LENGTH && l2 <= D_MAX_INTERNAL_EXPLICIT_LENGTH)
+        {
+            if (l1 <= l2)
+                insert_param(counts_, fm_->insert_internal_explicit(l1, l2)) += value;
+            else
+                insert_param(counts_, fm_->insert_internal_explicit(l2, l1)) += value;
+        }
+#endif
+#if PARAMS_INTERNAL_LENGTH
+        for (int i = 0; i <= std::min(D_MAX_INTERNAL_LENGTH, l1+l2); i++)
+            insert_param(counts_, fm_->insert_internal_length_at_least(i)) += value;
+#endif
+#if PARAMS_INTERNAL_SYMMETRY
+        if (l1 == l2)
+            for (int i = 0; i <= std::min(D_MAX_INTERNAL_SYMMETRIC_LENGTH, l1); i++)
+                insert_param(counts_, fm_->insert_internal_symmetric_length_at_least(i)) += value;
+#endif
+#if PARAMS_INTERNAL_ASYMMETRY
+        for (int i = 0; i <= std::min(D_MAX_INTERNAL_ASYMMETRY, Abs(l1-l2)); i++)
+            insert_param(counts_, fm_->insert_internal_asymmetry_at_least(i)) += value;
+#endif
+    }
+}
+
 //////////////////////////////////////////////////////////////////////
 // InferenceEngine::EncodeTraceback()
 // InferenceEngine::DecodeTraceback()
@@ -1837,368 +2354,397 @@ inline std::pair<int,int> InferenceEngine<RealT>::DecodeTraceback(int s) const
 }
 
 //////////////////////////////////////////////////////////////////////
-// InferenceEngine::ComputeViterbi()
+// InferenceEngine::ComputeViterbiCell()
 //
-// Run Viterbi algorithm.
+// Fill in the Viterbi matrices at (i,j), which depend only on the
+// cells with shorter spans.  The candidates for the bifurcation at
+// row i are accumulated in increasing order of j.
 //////////////////////////////////////////////////////////////////////
 
 template<class RealT>
-void InferenceEngine<RealT>::ComputeViterbi()
+void InferenceEngine<RealT>::ComputeViterbiCell(int i, int j, std::vector<int> &candidates)
 {
-    InitializeCache();
-#if SHOW_TIMINGS
-    double starting_time = GetSystemTime();
-#endif
+    // FM2[i,j] = MAX (i<k<j : FM1[i,k] + FM[k,j])
 
-#if CANDIDATE_LIST
-    std::vector<int> candidates;
-    candidates.reserve(L+1);
-    long long int candidates_seen = 0;
-    long long int candidates_possible = 0;
-#endif
+    RealT FM2v = RealT(NEG_INF);
+    int FM2t = -1;
 
-    // initialization
+#if SIMPLE_FM2
 
-    F5t.clear(); F5t.resize(L+1, -1);
-    FCt.clear(); FCt.resize(SIZE, -1);
-    FMt.clear(); FMt.resize(SIZE, -1);
-    FM1t.clear(); FM1t.resize(SIZE, -1);
+    for (int k = i+1; k < j; k++)
+        UPDATE_MAX(FM2v, FM2t, FM1v[offset[i]+k] + FMv[offset[k]+j], k);
 
-    F5v.clear(); F5v.resize(L+1, RealT(NEG_INF));
-    FCv.clear(); FCv.resize(SIZE, RealT(NEG_INF));
-    FMv.clear(); FMv.resize(SIZE, RealT(NEG_INF));
-    FM1v.clear(); FM1v.resize(SIZE, RealT(NEG_INF));
+#else
 
-#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
-    FEt.clear(); FEt.resize(SIZE, -1);
-    FNt.clear(); FNt.resize(SIZE, -1);
-    FEv.clear(); FEv.resize(SIZE, RealT(NEG_INF));
-    FNv.clear(); FNv.resize(SIZE, RealT(NEG_INF));
+#if !CANDIDATE_LIST
+
+    if (i+2 <= j)
+    {
+#if COLUMN_MAJOR_FM2
+        Fast_MaxPlus(&(FM1v[offset[i]+i+1]), &(FMv_col[column_offset[j]+i+1]), j-i-1, i+1, FM2v, FM2t);
+#else
+        RealT *p1 = &(FM1v[offset[i]+i+1]);
+        RealT *p2 = &(FMv[offset[i+1]+j]);
+        for (int k = i+1; k < j; k++)
+        {
+            UPDATE_MAX(FM2v, FM2t, (*p1) + (*p2), k);
+            ++p1;
+            p2 += offset[k+1]-offset[k];
+        }
 #endif
+    }
 
-    for (int i = L; i >= 0; i--)
+#else
+
+    for (size_t kp = 0; kp < candidates.size(); kp++)
     {
+        const int k = candidates[kp];
+#if COLUMN_MAJOR_FM2
+        UPDATE_MAX(FM2v, FM2t, FM1v[offset[i]+k] + FMv_col[column_offset[j]+k], k);
+#else
+        UPDATE_MAX(FM2v, FM2t, FM1v[offset[i]+k] + FMv[offset[k]+j], k);
+#endif
+    }
 
-#if CANDIDATE_LIST
-        candidates.clear();
 #endif
 
-        for (int j = i; j <= L; j++)
-        {
-            // FM2[i,j] = MAX (i<k<j : FM1[i,k] + FM[k,j])
+#endif
 
-            RealT FM2v = RealT(NEG_INF);
-            int FM2t = -1;
+#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
 
-#if SIMPLE_FM2
+    // FN[i,j] = optimal energy for substructure between positions
+    //           i and j such that letters (i,j+1) are base-paired
+    //           and the next interaction is not a stacking pair
+    //
+    //         = MAX [ScoreHairpin(i,j),
+    //                MAX (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
+    //                ScoreJunctionA(i,j) + a + c + MAX (i<k<j : FM1[i,k] + FM[k,j])]
+    //
+    //           (assuming 0 < i <= j < L)
+    //
+    // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
 
-            for (int k = i+1; k < j; k++)
-                UPDATE_MAX(FM2v, FM2t, FM1v[offset[i]+k] + FMv[offset[k]+j], k);
 
-#else
+    if (0 < i && j < L && allow_paired[offset[i]+j+1])
+    {
+        RealT best_v = RealT(NEG_INF);
+        int best_t = -1;
 
-#if !CANDIDATE_LIST
+        // compute ScoreHairpin(i,j)
 
-            if (i+2 <= j)
-            {
-                RealT *p1 = &(FM1v[offset[i]+i+1]);
-                RealT *p2 = &(FMv[offset[i+1]+j]);
-                for (int k = i+1; k < j; k++)
-                {
-                    UPDATE_MAX(FM2v, FM2t, (*p1) + (*p2), k);
-                    ++p1;
-                    p2 += L-k;
-                }
-            }
+        if (AllowUnpaired(i,j) && j-i >= C_MIN_HAIRPIN_LENGTH)
+            UPDATE_MAX(best_v, best_t, ScoreHairpin(i,j), EncodeTraceback(TB_FN_HAIRPIN,0));
 
-#else
+        // compute MAX (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
 
-            for (size_t kp = 0; kp < candidates.size(); kp++)
+        for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
+        {
+            if (p > i && !allow_unpaired_position[p]) break;
+            int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
+            for (int q = j; q >= q_min; q--)
             {
-                const int k = candidates[kp];
-                UPDATE_MAX(FM2v, FM2t, FM1v[offset[i]+k] + FMv[offset[k]+j], k);
+                if (q < j && !allow_unpaired_position[q+1]) break;
+                if (!allow_paired[offset[p+1]+q]) continue;
+                if (i == p && j == q) continue;
+
+                UPDATE_MAX(best_v, best_t,
+                           ScoreSingle(i,j,p,q) + FCv[offset[p+1]+q-1],
+                           EncodeTraceback(TB_FN_SINGLE,(p-i)*(C_MAX_SINGLE_LENGTH+1)+j-q));
             }
+        }
 
-            candidates_seen += (long long int) candidates.size();
-            candidates_possible += (long long int) std::max(j-i-1,0);
+        // compute MAX (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c)
 
-#endif
+        UPDATE_MAX(best_v, best_t,
+                   FM2v + ScoreJunctionMulti(i,j) + ScoreMultiPaired() + ScoreMultiBase(), 
+                   EncodeTraceback(TB_FN_BIFURCATION,FM2t));
 
-#endif
+        FNv[offset[i]+j] = best_v;
+        FNt[offset[i]+j] = best_t;
+    }
 
-#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
+    // FE[i,j] = optimal energy for substructure between positions
+    //           i and j such that letters (i,j+1) ... (i-D+1,j+D) are 
+    //           already base-paired
+    //
+    //         = MAX [ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]   if i+2<=j,
+    //                FN(i,j)]
+    //
+    //           (assuming 0 < i <= j < L)
 
-            // FN[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) are base-paired
-            //           and the next interaction is not a stacking pair
-            //
-            //         = MAX [ScoreHairpin(i,j),
-            //                MAX (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
-            //                ScoreJunctionA(i,j) + a + c + MAX (i<k<j : FM1[i,k] + FM[k,j])]
-            //
-            //           (assuming 0 < i <= j < L)
-            //
-            // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
+    if (0 < i && j < L && allow_paired[offset[i]+j+1])
+    {
+        RealT best_v = RealT(NEG_INF);
+        int best_t = -1;
 
+        // compute ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
-                RealT best_v = RealT(NEG_INF);
-                int best_t = -1;
+        if (i+2 <= j && allow_paired[offset[i+1]+j])
+        {
+            UPDATE_MAX(best_v, best_t, 
+                       ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) + FEv[offset[i+1]+j-1],
+                       EncodeTraceback(TB_FE_STACKING,0));
+        }
 
-                // compute ScoreHairpin(i,j)
+        // compute FN(i,j)
 
-                if (allow_unpaired[offset[i]+j] && j-i >= C_MIN_HAIRPIN_LENGTH)
-                    UPDATE_MAX(best_v, best_t, ScoreHairpin(i,j), EncodeTraceback(TB_FN_HAIRPIN,0));
+        UPDATE_MAX(best_v, best_t, FNv[offset[i]+j], EncodeTraceback(TB_FE_FN,0));
 
-                // compute MAX (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
+        FEv[offset[i]+j] = best_v;
+        FEt[offset[i]+j] = best_t;
+    }
 
-                for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
-                {
-                    if (p > i && !allow_unpaired_position[p]) break;
-                    int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
-                    for (int q = j; q >= q_min; q--)
-                    {
-                        if (q < j && !allow_unpaired_position[q+1]) break;
-                        if (!allow_paired[offset[p+1]+q]) continue;
-                        if (i == p && j == q) continue;
+    // FC[i,j] = optimal energy for substructure between positions
+    //           i and j such that letters (i,j+1) are base-paired
+    //           but (i-1,j+2) are not
+    //
+    //         = MAX [ScoreIsolated() + FN(i,j),
+    //                MAX (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k)),
+    //                FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
+    //
+    //           (assuming 0 < i <= j < L)
+
+    if (0 < i && j < L && allow_paired[offset[i]+j+1])
+    {
 
-                        UPDATE_MAX(best_v, best_t,
-                                   ScoreSingle(i,j,p,q) + FCv[offset[p+1]+q-1],
-                                   EncodeTraceback(TB_FN_SINGLE,(p-i)*(C_MAX_SINGLE_LENGTH+1)+j-q));
-                    }
-                }
+        RealT best_v = RealT(NEG_INF);
+        int best_t = -1;
 
-                // compute MAX (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c)
+        // compute ScoreIsolated() + FN(i,j)
 
-                UPDATE_MAX(best_v, best_t,
-                           FM2v + ScoreJunctionMulti(i,j) + ScoreMultiPaired() + ScoreMultiBase(), 
-                           EncodeTraceback(TB_FN_BIFURCATION,FM2t));
+        UPDATE_MAX(best_v, best_t, ScoreIsolated() + FNv[offset[i]+j], EncodeTraceback(TB_FC_FN,0));
 
-                FNv[offset[i]+j] = best_v;
-                FNt[offset[i]+j] = best_t;
-            }
+        // compute MAX (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k))
 
-            // FE[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) ... (i-D+1,j+D) are 
-            //           already base-paired
-            //
-            //         = MAX [ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]   if i+2<=j,
-            //                FN(i,j)]
-            //
-            //           (assuming 0 < i <= j < L)
+        bool allowed = true;
+        for (int k = 2; k < D_MAX_HELIX_LENGTH; k++)
+        {
+            if (i + 2*k - 2 > j) break;
+            if (!allow_paired[offset[i+k-1]+j-k+2]) { allowed = false; break; }
+            UPDATE_MAX(best_v, best_t, ScoreHelix(i-1,j+1,k) + FNv[offset[i+k-1]+j-k+1], EncodeTraceback(TB_FC_HELIX,k));
+        }
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
-                RealT best_v = RealT(NEG_INF);
-                int best_t = -1;
+        // compute FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
 
-                // compute ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]
+        if (i + 2*D_MAX_HELIX_LENGTH-2 <= j)
+        {
+            if (allowed && allow_paired[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+2])
+                UPDATE_MAX(best_v, best_t, ScoreHelix(i-1,j+1,D_MAX_HELIX_LENGTH) +
+                           FEv[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+1],
+                           EncodeTraceback(TB_FC_FE,0));
+        }
+        FCv[offset[i]+j] = best_v;
+        FCt[offset[i]+j] = best_t;
+    }
 
-                if (i+2 <= j && allow_paired[offset[i+1]+j])
-                {
-                    UPDATE_MAX(best_v, best_t, 
-                               ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) + FEv[offset[i+1]+j-1],
-                               EncodeTraceback(TB_FE_STACKING,0));
-                }
-
-                // compute FN(i,j)
-
-                UPDATE_MAX(best_v, best_t, FNv[offset[i]+j], EncodeTraceback(TB_FE_FN,0));
-
-                FEv[offset[i]+j] = best_v;
-                FEt[offset[i]+j] = best_t;
-            }
-
-            // FC[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) are base-paired
-            //           but (i-1,j+2) are not
-            //
-            //         = MAX [ScoreIsolated() + FN(i,j),
-            //                MAX (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k)),
-            //                FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
-            //
-            //           (assuming 0 < i <= j < L)
-
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
+#else
 
-                RealT best_v = RealT(NEG_INF);
-                int best_t = -1;
+    // FC[i,j] = optimal energy for substructure between positions
+    //           i and j such that letters (i,j+1) are base-paired
+    //
+    //         = MAX [ScoreHairpin(i,j),
+    //                MAX (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
+    //                ScoreJunctionA(i,j) + a + c + MAX (i<k<j : FM1[i,k] + FM[k,j])]
+    //
+    //           (assuming 0 < i <= j < L)
+    //
+    // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
+
+    if (0 < i && j < L && allow_paired[offset[i]+j+1])
+    {
 
-                // compute ScoreIsolated() + FN(i,j)
+        RealT best_v = RealT(NEG_INF);
+        int best_t = -1;
 
-                UPDATE_MAX(best_v, best_t, ScoreIsolated() + FNv[offset[i]+j], EncodeTraceback(TB_FC_FN,0));
+        // compute ScoreHairpin(i,j)
 
-                // compute MAX (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k))
+        if (AllowUnpaired(i,j) && j-i >= C_MIN_HAIRPIN_LENGTH)
+            UPDATE_MAX(best_v, best_t, ScoreHairpin(i,j), EncodeTraceback(TB_FC_HAIRPIN,0));
 
-                bool allowed = true;
-                for (int k = 2; k < D_MAX_HELIX_LENGTH; k++)
-                {
-                    if (i + 2*k - 2 > j) break;
-                    if (!allow_paired[offset[i+k-1]+j-k+2]) { allowed = false; break; }
-                    UPDATE_MAX(best_v, best_t, ScoreHelix(i-1,j+1,k) + FNv[offset[i+k-1]+j-k+1], EncodeTraceback(TB_FC_HELIX,k));
-                }
+        // compute MAX (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
 
-                // compute FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
+        for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
+        {
+            if (p > i && !allow_unpaired_position[p]) break;
+            int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
+            for (int q = j; q >= q_min; q--)
+            {
+                if (q < j && !allow_unpaired_position[q+1]) break;
+                if (!allow_paired[offset[p+1]+q]) continue;
 
-                if (i + 2*D_MAX_HELIX_LENGTH-2 <= j)
-                {
-                    if (allowed && allow_paired[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+2])
-                        UPDATE_MAX(best_v, best_t, ScoreHelix(i-1,j+1,D_MAX_HELIX_LENGTH) +
-                                   FEv[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+1],
-                                   EncodeTraceback(TB_FC_FE,0));
-                }
-                FCv[offset[i]+j] = best_v;
-                FCt[offset[i]+j] = best_t;
+                UPDATE_MAX(best_v, best_t,
+                           FCv[offset[p+1]+q-1] +
+                           (p == i && q == j ? ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) : ScoreSingle(i,j,p,q)),
+                           EncodeTraceback(TB_FC_SINGLE,(p-i)*(C_MAX_SINGLE_LENGTH+1)+j-q));
             }
+        }
 
-#else
-
-            // FC[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) are base-paired
-            //
-            //         = MAX [ScoreHairpin(i,j),
-            //                MAX (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
-            //                ScoreJunctionA(i,j) + a + c + MAX (i<k<j : FM1[i,k] + FM[k,j])]
-            //
-            //           (assuming 0 < i <= j < L)
-            //
-            // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
-
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
-
-                RealT best_v = RealT(NEG_INF);
-                int best_t = -1;
+        // compute MAX (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c)
 
-                // compute ScoreHairpin(i,j)
+        UPDATE_MAX(best_v, best_t,
+                   FM2v + ScoreJunctionMulti(i,j) + ScoreMultiPaired() + ScoreMultiBase(), 
+                   EncodeTraceback(TB_FC_BIFURCATION,FM2t));
 
-                if (allow_unpaired[offset[i]+j] && j-i >= C_MIN_HAIRPIN_LENGTH)
-                    UPDATE_MAX(best_v, best_t, ScoreHairpin(i,j), EncodeTraceback(TB_FC_HAIRPIN,0));
+        FCv[offset[i]+j] = best_v;
+        FCt[offset[i]+j] = best_t;
+    }
 
-                // compute MAX (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
+#endif
 
-                for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
-                {
-                    if (p > i && !allow_unpaired_position[p]) break;
-                    int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
-                    for (int q = j; q >= q_min; q--)
-                    {
-                        if (q < j && !allow_unpaired_position[q+1]) break;
-                        if (!allow_paired[offset[p+1]+q]) continue;
+    // FM1[i,j] = optimal energy for substructure belonging to a
+    //            multibranch loop containing a (k+1,j) base pair
+    //            preceded by 5' unpaired nucleotides from i to k
+    //            for some i <= k <= j-2
+    //
+    //          = MAX [FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)  if i+2<=j,
+    //                 FM1[i+1,j] + b                                          if i+2<=j]
+    //
+    //            (assuming 0 < i < i+2 <= j < L)
 
-                        UPDATE_MAX(best_v, best_t,
-                                   FCv[offset[p+1]+q-1] +
-                                   (p == i && q == j ? ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) : ScoreSingle(i,j,p,q)),
-                                   EncodeTraceback(TB_FC_SINGLE,(p-i)*(C_MAX_SINGLE_LENGTH+1)+j-q));
-                    }
-                }
+    if (0 < i && i+2 <= j && j < L)
+    {
+        RealT best_v = RealT(NEG_INF);
+        int best_t = -1;
 
-                // compute MAX (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c)
+        // compute FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)
 
-                UPDATE_MAX(best_v, best_t,
-                           FM2v + ScoreJunctionMulti(i,j) + ScoreMultiPaired() + ScoreMultiBase(), 
-                           EncodeTraceback(TB_FC_BIFURCATION,FM2t));
+        if (allow_paired[offset[i+1]+j])
+        {
+            UPDATE_MAX(best_v, best_t, 
+                       FCv[offset[i+1]+j-1] + ScoreJunctionMulti(j,i) +
+                       ScoreMultiPaired() + ScoreBasePair(i+1,j), 
+                       EncodeTraceback(TB_FM1_PAIRED,0));
+        }
 
-                FCv[offset[i]+j] = best_v;
-                FCt[offset[i]+j] = best_t;
-            }
+        // compute FM1[i+1,j] + b
 
-#endif
+        if (allow_unpaired_position[i+1])
+        {
+            UPDATE_MAX(best_v, best_t,
+                       FM1v[offset[i+1]+j] + ScoreMultiUnpaired(i+1),
+                       EncodeTraceback(TB_FM1_UNPAIRED,0));
+        }
 
-            // FM1[i,j] = optimal energy for substructure belonging to a
-            //            multibranch loop containing a (k+1,j) base pair
-            //            preceded by 5' unpaired nucleotides from i to k
-            //            for some i <= k <= j-2
-            //
-            //          = MAX [FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)  if i+2<=j,
-            //                 FM1[i+1,j] + b                                          if i+2<=j]
-            //
-            //            (assuming 0 < i < i+2 <= j < L)
+        FM1v[offset[i]+j] = best_v;
+        FM1t[offset[i]+j] = best_t;
+    }
 
-            if (0 < i && i+2 <= j && j < L)
-            {
-                RealT best_v = RealT(NEG_INF);
-                int best_t = -1;
+#if CANDIDATE_LIST
 
-                // compute FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)
+    // If there exists some i <= k < j for which
+    //   FM1[i,k] + FM[k,j] >= FM1[i,j]
+    // then for all j' > j, we know that
+    //   FM1[i,k] + FM[k,j'] >= FM1[i,j] + FM[j,j'].
+    // since 
+    //   FM[k,j'] >= FM[k,j] + FM[j,j'].
+    //
+    // From this, it follows that we only need to consider
+    // j as a candidate partition point for future j' values
+    // only if FM1[i,j] > FM1[i,k] + FM[k,j] for all k.
+
+    if (FM1v[offset[i]+j] > FM2v)
+        candidates.push_back(j);
+#endif
+
+    // FM[i,j] = optimal energy for substructure belonging to a
+    //           multibranch loop which contains at least one 
+    //           helix
+    //
+    //         = MAX [MAX (i<k<j : FM1[i,k] + FM[k,j]),
+    //                FM[i,j-1] + b,
+    //                FM1[i,j]]
+    //
+    //            (assuming 0 < i < i+2 <= j < L)
+
+    if (0 < i && i+2 <= j && j < L)
+    {
+        RealT best_v = RealT(NEG_INF);
+        int best_t = -1;
 
-                if (allow_paired[offset[i+1]+j])
-                {
-                    UPDATE_MAX(best_v, best_t, 
-                               FCv[offset[i+1]+j-1] + ScoreJunctionMulti(j,i) +
-                               ScoreMultiPaired() + ScoreBasePair(i+1,j), 
-                               EncodeTraceback(TB_FM1_PAIRED,0));
-                }
+        // compute MAX (i<k<j : FM1[i,k] + FM[k,j])
 
-                // compute FM1[i+1,j] + b
+        UPDATE_MAX(best_v, best_t, FM2v, EncodeTraceback(TB_FM_BIFURCATION,FM2t));
 
-                if (allow_unpaired_position[i+1])
-                {
-                    UPDATE_MAX(best_v, best_t,
-                               FM1v[offset[i+1]+j] + ScoreMultiUnpaired(i+1),
-                               EncodeTraceback(TB_FM1_UNPAIRED,0));
-                }
+        // compute FM[i,j-1] + b
 
-                FM1v[offset[i]+j] = best_v;
-                FM1t[offset[i]+j] = best_t;
-            }
+        if (allow_unpaired_position[j])
+        {
+            UPDATE_MAX(best_v, best_t,
+                       FMv[offset[i]+j-1] + ScoreMultiUnpaired(j), 
+                       EncodeTraceback(TB_FM_UNPAIRED,0));
+        }
 
-#if CANDIDATE_LIST
+        // compute FM1[i,j]
 
-            // If there exists some i <= k < j for which
-            //   FM1[i,k] + FM[k,j] >= FM1[i,j]
-            // then for all j' > j, we know that
-            //   FM1[i,k] + FM[k,j'] >= FM1[i,j] + FM[j,j'].
-            // since 
-            //   FM[k,j'] >= FM[k,j] + FM[j,j'].
-            //
-            // From this, it follows that we only need to consider
-            // j as a candidate partition point for future j' values
-            // only if FM1[i,j] > FM1[i,k] + FM[k,j] for all k.
+        UPDATE_MAX(best_v, best_t, FM1v[offset[i]+j], EncodeTraceback(TB_FM_FM1,0));
 
-            if (FM1v[offset[i]+j] > FM2v)
-                candidates.push_back(j);
+        FMv[offset[i]+j] = best_v;
+#if COLUMN_MAJOR_FM2
+        FMv_col[column_offset[j]+i] = best_v;
 #endif
+        FMt[offset[i]+j] = best_t;
+    }
+}
 
-            // FM[i,j] = optimal energy for substructure belonging to a
-            //           multibranch loop which contains at least one 
-            //           helix
-            //
-            //         = MAX [MAX (i<k<j : FM1[i,k] + FM[k,j]),
-            //                FM[i,j-1] + b,
-            //                FM1[i,j]]
-            //
-            //            (assuming 0 < i < i+2 <= j < L)
-
-            if (0 < i && i+2 <= j && j < L)
-            {
-                RealT best_v = RealT(NEG_INF);
-                int best_t = -1;
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::ComputeViterbi()
+//
+// Run Viterbi algorithm.
+//////////////////////////////////////////////////////////////////////
 
-                // compute MAX (i<k<j : FM1[i,k] + FM[k,j])
+template<class RealT>
+void InferenceEngine<RealT>::ComputeViterbi()
+{
+    InitializeCache();
+#if SHOW_TIMINGS
+    double starting_time = GetSystemTime();
+#endif
 
-                UPDATE_MAX(best_v, best_t, FM2v, EncodeTraceback(TB_FM_BIFURCATION,FM2t));
+    std::vector<int> candidates;
+#if CANDIDATE_LIST
+    candidates.reserve(L+1);
+#endif
 
-                // compute FM[i,j-1] + b
+    // initialization
 
-                if (allow_unpaired_position[j])
-                {
-                    UPDATE_MAX(best_v, best_t,
-                               FMv[offset[i]+j-1] + ScoreMultiUnpaired(j), 
-                               EncodeTraceback(TB_FM_UNPAIRED,0));
-                }
+    F5t.clear(); F5t.resize(L+1, -1);
+    FCt.clear(); FCt.resize(SIZE, -1);
+    FMt.clear(); FMt.resize(SIZE, -1);
+    FM1t.clear(); FM1t.resize(SIZE, -1);
 
-                // compute FM1[i,j]
+    F5v.clear(); F5v.resize(L+1, RealT(NEG_INF));
+    FCv.clear(); FCv.resize(SIZE, RealT(NEG_INF));
+    FMv.clear(); FMv.resize(SIZE, RealT(NEG_INF));
+    FM1v.clear(); FM1v.resize(SIZE, RealT(NEG_INF));
+#if COLUMN_MAJOR_FM2
+    FMv_col.clear(); FMv_col.resize(SIZE, RealT(NEG_INF));
+#endif
 
-                UPDATE_MAX(best_v, best_t, FM1v[offset[i]+j], EncodeTraceback(TB_FM_FM1,0));
+#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
+    FEt.clear(); FEt.resize(SIZE, -1);
+    FNt.clear(); FNt.resize(SIZE, -1);
+    FEv.clear(); FEv.resize(SIZE, RealT(NEG_INF));
+    FNv.clear(); FNv.resize(SIZE, RealT(NEG_INF));
+#endif
 
-                FMv[offset[i]+j] = best_v;
-                FMt[offset[i]+j] = best_t;
-            }
+    if (num_threads <= 1)
+    {
+        for (int i = L; i >= 0; i--)
+        {
+#if CANDIDATE_LIST
+            candidates.clear();
+#endif
+            for (int j = i; j <= std::min(L, i+SPAN); j++)
+                ComputeViterbiCell(i, j, candidates);
         }
     }
+    else
+    {
+        // the cells with the same span are independent of each other
+        std::vector<std::vector<int>> row_candidates(L+1);
+        ParallelWavefront(L, SPAN, num_threads, false,
+                          [&](int i, int j) { ComputeViterbiCell(i, j, row_candidates[i]); });
+    }
 
     F5v[0] = RealT(0);
     F5t[0] = EncodeTraceback(TB_F5_ZERO,0);
@@ -2223,8 +2769,9 @@ void InferenceEngine<RealT>::ComputeViterbi()
         }
 
         // compute MAX (0<=k<j : F5[k] + FC[k+1,j-1] + ScoreExternalPaired() + ScoreBP(k+1,j) + ScoreJunctionA(j,k))
+        // (FC[k+1,j-1] is filled only for j-k-2 <= SPAN)
 
-        for (int k = 0; k < j; k++)
+        for (int k = std::max(0, j-SPAN-2); k < j; k++)
         {
             if (allow_paired[offset[k+1]+j])
             {
@@ -2243,10 +2790,6 @@ void InferenceEngine<RealT>::ComputeViterbi()
     std::cerr << "Viterbi score: " << F5v[L] << " (" << GetSystemTime() - starting_time << " seconds)" << std::endl;
 #endif
 
-#if CANDIDATE_LIST
-    //std::cerr << "Candidates: " << candidates_seen << "/" << candidates_possible << " = " << double(candidates_seen)/candidates_possible << std::endl;
-#endif
-
     //show_matrix(FCv, "F5", L);
     //show_matrix(FCv, offset, "FC", L);
     //show_matrix(FMv, offset, "FM", L);
@@ -2430,20 +2973,17 @@ std::vector<int> InferenceEngine<RealT>::PredictPairingsViterbi() const
 //////////////////////////////////////////////////////////////////////
 // InferenceEngine::ComputeViterbiFeatureCounts()
 // 
-// Use feature counts from Viterbi decoding.
+// Use feature counts from Viterbi decoding, which are added to cnt.
 //////////////////////////////////////////////////////////////////////
 
 template<class RealT>
-//std::vector<RealT>
-std::unordered_map<size_t,RealT>
-InferenceEngine<RealT>::ComputeViterbiFeatureCounts()
+void
+InferenceEngine<RealT>::ComputeViterbiFeatureCounts(FeatureCounts<RealT>& cnt)
 {
     std::queue<triple<int *,int,int> > traceback_queue;
     traceback_queue.push(make_triple(&F5t[0], 0, L));
 
     ClearCounts();
-    //std::vector<RealT> cnt(params_->size(), 0.0);
-    std::unordered_map<size_t,RealT> cnt;
     counts_ = &cnt;
 
     while (!traceback_queue.empty())
@@ -2597,286 +3137,411 @@ InferenceEngine<RealT>::ComputeViterbiFeatureCounts()
     }
 
     FinalizeCounts();
-    return cnt;
 }
 
 //////////////////////////////////////////////////////////////////////
-// InferenceEngine::ComputeInside()
+// InferenceEngine::ComputeInsideCell()
 //
-// Run inside algorithm.
+// Fill in the inside matrices at (i,j), which depend only on the
+// cells with shorter spans.
 //////////////////////////////////////////////////////////////////////
 
 template<class RealT>
-void InferenceEngine<RealT>::ComputeInside()
+void InferenceEngine<RealT>::ComputeInsideCell(int i, int j)
 {
-    InitializeCache();
+    // FM2[i,j] = SUM (i<k<j : FM1[i,k] + FM[k,j])
 
-#if SHOW_TIMINGS
-    double starting_time = GetSystemTime();
-#endif
+    RealT FM2i = RealT(NEG_INF);
 
-    // initialization
+#if SIMPLE_FM2
 
-    F5i.clear(); F5i.resize(L+1, RealT(NEG_INF));
-    FCi.clear(); FCi.resize(SIZE, RealT(NEG_INF));
-    FMi.clear(); FMi.resize(SIZE, RealT(NEG_INF));
-    FM1i.clear(); FM1i.resize(SIZE, RealT(NEG_INF));
+    for (int k = i+1; k < j; k++)
+        Fast_LogPlusEquals(FM2i, FM1i[offset[i]+k] + FMi[offset[k]+j]);
 
-#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
-    FEi.clear(); FEi.resize(SIZE, RealT(NEG_INF));
-    FNi.clear(); FNi.resize(SIZE, RealT(NEG_INF));
-#endif
+#elif COLUMN_MAJOR_FM2
 
-    for (int i = L; i >= 0; i--)
+    if (i+2 <= j)
+        FM2i = Fast_LogSumPlus(&(FM1i[offset[i]+i+1]), &(FMi_col[column_offset[j]+i+1]), j-i-1);
+
+#else
+
+    if (i+2 <= j)
     {
-        for (int j = i; j <= L; j++)
+        const RealT *p1 = &(FM1i[offset[i]+i+1]);
+        const RealT *p2 = &(FMi[offset[i+1]+j]);
+        for (int k = i+1; k < j; k++)
         {
+            Fast_LogPlusEquals(FM2i, (*p1) + (*p2));
+            ++p1;
+            p2 += offset[k+1]-offset[k];
+        }
+    }
 
-            // FM2[i,j] = SUM (i<k<j : FM1[i,k] + FM[k,j])
+#endif
 
-            RealT FM2i = RealT(NEG_INF);
+#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
 
-#if SIMPLE_FM2
+    // FN[i,j] = optimal energy for substructure between positions
+    //           i and j such that letters (i,j+1) are base-paired
+    //           and the next interaction is not a stacking pair
+    //
+    //         = SUM [ScoreHairpin(i,j),
+    //                SUM (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
+    //                ScoreJunctionA(i,j) + a + c + SUM (i<k<j : FM1[i,k] + FM[k,j])]
+    //
+    //           (assuming 0 < i <= j < L)
+    //
+    // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
+
+    if (0 < i && j < L && allow_paired[offset[i]+j+1])
+    {
 
-            for (int k = i+1; k < j; k++)
-                Fast_LogPlusEquals(FM2i, FM1i[offset[i]+k] + FMi[offset[k]+j]);
+        RealT sum_i = RealT(NEG_INF);
 
-#else
+        // compute ScoreHairpin(i,j)
 
-            if (i+2 <= j)
+        if (AllowUnpaired(i,j) && j-i >= C_MIN_HAIRPIN_LENGTH)
+            Fast_LogPlusEquals(sum_i, ScoreHairpin(i,j));
+
+        // compute SUM (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
+
+        for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
+        {
+            if (p > i && !allow_unpaired_position[p]) break;
+            int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
+            for (int q = j; q >= q_min; q--)
             {
-                const RealT *p1 = &(FM1i[offset[i]+i+1]);
-                const RealT *p2 = &(FMi[offset[i+1]+j]);
-                for (int k = i+1; k < j; k++)
-                {
-                    Fast_LogPlusEquals(FM2i, (*p1) + (*p2));
-                    ++p1;
-                    p2 += L-k;
-                }
+                if (q < j && !allow_unpaired_position[q+1]) break;
+                if (!allow_paired[offset[p+1]+q]) continue;
+                if (i == p && j == q) continue;
+
+                Fast_LogPlusEquals(sum_i, ScoreSingle(i,j,p,q) + FCi[checkpoint_offset[p+1]+q-1]);
             }
+        }
 
-#endif
+        // compute SUM (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c)
 
-#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
+        Fast_LogPlusEquals(sum_i, FM2i + ScoreJunctionMulti(i,j) + ScoreMultiPaired() + ScoreMultiBase());
 
-            // FN[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) are base-paired
-            //           and the next interaction is not a stacking pair
-            //
-            //         = SUM [ScoreHairpin(i,j),
-            //                SUM (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
-            //                ScoreJunctionA(i,j) + a + c + SUM (i<k<j : FM1[i,k] + FM[k,j])]
-            //
-            //           (assuming 0 < i <= j < L)
-            //
-            // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
+        FNi[checkpoint_offset[i]+j] = sum_i;
+    }
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
+    // FE[i,j] = optimal energy for substructure between positions
+    //           i and j such that letters (i,j+1) ... (i-D+1,j+D) are 
+    //           already base-paired
+    //
+    //         = SUM [ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]   if i+2<=j,
+    //                FN(i,j)]
+    //
+    //           (assuming 0 < i <= j < L)
 
-                RealT sum_i = RealT(NEG_INF);
+    if (0 < i && j < L && allow_paired[offset[i]+j+1])
+    {
+        RealT sum_i = RealT(NEG_INF);
 
-                // compute ScoreHairpin(i,j)
+        // compute ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]
 
-                if (allow_unpaired[offset[i]+j] && j-i >= C_MIN_HAIRPIN_LENGTH)
-                    Fast_LogPlusEquals(sum_i, ScoreHairpin(i,j));
+        if (i+2 <= j && allow_paired[offset[i+1]+j])
+        {
+            Fast_LogPlusEquals(sum_i, ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) + FEi[checkpoint_offset[i+1]+j-1]);
+        }
 
-                // compute SUM (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
+        // compute FN(i,j)
 
-                for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
-                {
-                    if (p > i && !allow_unpaired_position[p]) break;
-                    int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
-                    for (int q = j; q >= q_min; q--)
-                    {
-                        if (q < j && !allow_unpaired_position[q+1]) break;
-                        if (!allow_paired[offset[p+1]+q]) continue;
-                        if (i == p && j == q) continue;
+        Fast_LogPlusEquals(sum_i, FNi[checkpoint_offset[i]+j]);
 
-                        Fast_LogPlusEquals(sum_i, ScoreSingle(i,j,p,q) + FCi[offset[p+1]+q-1]);
-                    }
-                }
+        FEi[checkpoint_offset[i]+j] = sum_i;
+    }
 
-                // compute SUM (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c)
+    // FC[i,j] = optimal energy for substructure between positions
+    //           i and j such that letters (i,j+1) are base-paired
+    //           but (i-1,j+2) are not
+    //
+    //         = SUM [ScoreIsolated() + FN(i,j),
+    //                SUM (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k)),
+    //                FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
+    //
+    //           (assuming 0 < i <= j < L)
+
+    if (0 < i && j < L && allow_paired[offset[i]+j+1])
+    {
+        RealT sum_i = RealT(NEG_INF);
 
-                Fast_LogPlusEquals(sum_i, FM2i + ScoreJunctionMulti(i,j) + ScoreMultiPaired() + ScoreMultiBase());
+        // compute ScoreIsolated() + FN(i,j)
 
-                FNi[offset[i]+j] = sum_i;
-            }
+        Fast_LogPlusEquals(sum_i, ScoreIsolated() + FNi[checkpoint_offset[i]+j]);
 
-            // FE[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) ... (i-D+1,j+D) are 
-            //           already base-paired
-            //
-            //         = SUM [ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]   if i+2<=j,
-            //                FN(i,j)]
-            //
-            //           (assuming 0 < i <= j < L)
+        // compute SUM (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k))
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
-                RealT sum_i = RealT(NEG_INF);
+        bool allowed = true;
+        for (int k = 2; k < D_MAX_HELIX_LENGTH; k++)
+        {
+            if (i + 2*k - 2 > j) break;
+            if (!allow_paired[offset[i+k-1]+j-k+2]) { allowed = false; break; }
+            Fast_LogPlusEquals(sum_i, ScoreHelix(i-1,j+1,k) + FNi[checkpoint_offset[i+k-1]+j-k+1]);
+        }
 
-                // compute ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]
+        // compute FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
 
-                if (i+2 <= j && allow_paired[offset[i+1]+j])
-                {
-                    Fast_LogPlusEquals(sum_i, ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) + FEi[offset[i+1]+j-1]);
-                }
+        if (i + 2*D_MAX_HELIX_LENGTH-2 <= j)
+        {
+            if (allowed && allow_paired[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+2])
+                Fast_LogPlusEquals(sum_i, ScoreHelix(i-1,j+1,D_MAX_HELIX_LENGTH) + FEi[checkpoint_offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+1]);
+        }
 
-                // compute FN(i,j)
+        FCi[checkpoint_offset[i]+j] = sum_i;
+    }
 
-                Fast_LogPlusEquals(sum_i, FNi[offset[i]+j]);
+#else
 
-                FEi[offset[i]+j] = sum_i;
-            }
+    // FC[i,j] = optimal energy for substructure between positions
+    //           i and j such that letters (i,j+1) are base-paired
+    //
+    //         = SUM [ScoreHairpin(i,j),
+    //                SUM (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
+    //                ScoreJunctionA(i,j) + a + c + SUM (i<k<j : FM1[i,k] + FM[k,j])]
+    //
+    //           (assuming 0 < i <= j < L)
+    //
+    // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
+
+    if (0 < i && j < L && allow_paired[offset[i]+j+1])
+    {
+        RealT sum_i = RealT(NEG_INF);
 
-            // FC[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) are base-paired
-            //           but (i-1,j+2) are not
-            //
-            //         = SUM [ScoreIsolated() + FN(i,j),
-            //                SUM (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k)),
-            //                FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
-            //
-            //           (assuming 0 < i <= j < L)
+        // compute ScoreHairpin(i,j)
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
-                RealT sum_i = RealT(NEG_INF);
+        if (AllowUnpaired(i,j) && j-i >= C_MIN_HAIRPIN_LENGTH)
+            Fast_LogPlusEquals(sum_i, ScoreHairpin(i,j));
 
-                // compute ScoreIsolated() + FN(i,j)
+        // compute SUM (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
 
-                Fast_LogPlusEquals(sum_i, ScoreIsolated() + FNi[offset[i]+j]);
+        for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
+        {
+            if (p > i && !allow_unpaired_position[p]) break;
+            int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
+            for (int q = j; q >= q_min; q--)
+            {
+                if (q < j && !allow_unpaired_position[q+1]) break;
+                if (!allow_paired[offset[p+1]+q]) continue;
 
-                // compute SUM (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k))
+                Fast_LogPlusEquals(sum_i,
+                                   FCi[checkpoint_offset[p+1]+q-1] +
+                                   (p == i && q == j ? ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) : ScoreSingle(i,j,p,q)));
+            }
+        }
 
-                bool allowed = true;
-                for (int k = 2; k < D_MAX_HELIX_LENGTH; k++)
-                {
-                    if (i + 2*k - 2 > j) break;
-                    if (!allow_paired[offset[i+k-1]+j-k+2]) { allowed = false; break; }
-                    Fast_LogPlusEquals(sum_i, ScoreHelix(i-1,j+1,k) + FNi[offset[i+k-1]+j-k+1]);
-                }
+        // compute SUM (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c)
 
-                // compute FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
+        Fast_LogPlusEquals(sum_i, FM2i + ScoreJunctionMulti(i,j) + ScoreMultiPaired() + ScoreMultiBase());
 
-                if (i + 2*D_MAX_HELIX_LENGTH-2 <= j)
-                {
-                    if (allowed && allow_paired[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+2])
-                        Fast_LogPlusEquals(sum_i, ScoreHelix(i-1,j+1,D_MAX_HELIX_LENGTH) + FEi[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+1]);
-                }
+        FCi[checkpoint_offset[i]+j] = sum_i;
+    }
 
-                FCi[offset[i]+j] = sum_i;
-            }
+#endif
 
-#else
+    // FM1[i,j] = optimal energy for substructure belonging to a
+    //            multibranch loop containing a (k+1,j) base pair
+    //            preceded by 5' unpaired nucleotides from i to k
+    //            for some i <= k <= j-2
+    //
+    //          = SUM [FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)  if i+2<=j,
+    //                 FM1[i+1,j] + b                                          if i+2<=j]
+    //
+    //            (assuming 0 < i < i+2 <= j < L)
 
-            // FC[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) are base-paired
-            //
-            //         = SUM [ScoreHairpin(i,j),
-            //                SUM (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
-            //                ScoreJunctionA(i,j) + a + c + SUM (i<k<j : FM1[i,k] + FM[k,j])]
-            //
-            //           (assuming 0 < i <= j < L)
-            //
-            // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
+    if (0 < i && i+2 <= j && j < L)
+    {
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
-                RealT sum_i = RealT(NEG_INF);
+        RealT sum_i = RealT(NEG_INF);
 
-                // compute ScoreHairpin(i,j)
+        // compute FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)
 
-                if (allow_unpaired[offset[i]+j] && j-i >= C_MIN_HAIRPIN_LENGTH)
-                    Fast_LogPlusEquals(sum_i, ScoreHairpin(i,j));
+        if (allow_paired[offset[i+1]+j])
+            Fast_LogPlusEquals(sum_i, FCi[checkpoint_offset[i+1]+j-1] + ScoreJunctionMulti(j,i) + ScoreMultiPaired() + ScoreBasePair(i+1,j));
 
-                // compute SUM (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
+        // compute FM1[i+1,j] + b
 
-                for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
-                {
-                    if (p > i && !allow_unpaired_position[p]) break;
-                    int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
-                    for (int q = j; q >= q_min; q--)
-                    {
-                        if (q < j && !allow_unpaired_position[q+1]) break;
-                        if (!allow_paired[offset[p+1]+q]) continue;
+        if (allow_unpaired_position[i+1])
+            Fast_LogPlusEquals(sum_i, FM1i[offset[i+1]+j] + ScoreMultiUnpaired(i+1));
 
-                        Fast_LogPlusEquals(sum_i,
-                                           FCi[offset[p+1]+q-1] +
-                                           (p == i && q == j ? ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) : ScoreSingle(i,j,p,q)));
-                    }
-                }
+        FM1i[offset[i]+j] = sum_i;
+    }
 
-                // compute SUM (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c)
+    // FM[i,j] = optimal energy for substructure belonging to a
+    //           multibranch loop which contains at least one 
+    //           helix
+    //
+    //         = SUM [SUM (i<k<j : FM1[i,k] + FM[k,j]),
+    //                FM[i,j-1] + b,
+    //                FM1[i,j]]
+    //
+    //            (assuming 0 < i < i+2 <= j < L)
+
+    if (0 < i && i+2 <= j && j < L)
+    {
 
-                Fast_LogPlusEquals(sum_i, FM2i + ScoreJunctionMulti(i,j) + ScoreMultiPaired() + ScoreMultiBase());
+        RealT sum_i = RealT(NEG_INF);
 
-                FCi[offset[i]+j] = sum_i;
-            }
+        // compute SUM (i<k<j : FM1[i,k] + FM[k,j])
 
-#endif
+        Fast_LogPlusEquals(sum_i, FM2i);
 
-            // FM1[i,j] = optimal energy for substructure belonging to a
-            //            multibranch loop containing a (k+1,j) base pair
-            //            preceded by 5' unpaired nucleotides from i to k
-            //            for some i <= k <= j-2
-            //
-            //          = SUM [FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)  if i+2<=j,
-            //                 FM1[i+1,j] + b                                          if i+2<=j]
-            //
-            //            (assuming 0 < i < i+2 <= j < L)
+        // compute FM[i,j-1] + b
 
-            if (0 < i && i+2 <= j && j < L)
-            {
-
-                RealT sum_i = RealT(NEG_INF);
+        if (allow_unpaired_position[j])
+            Fast_LogPlusEquals(sum_i, FMi[checkpoint_offset[i]+j-1] + ScoreMultiUnpaired(j));
 
-                // compute FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)
+        // compute FM1[i,j]
 
-                if (allow_paired[offset[i+1]+j])
-                    Fast_LogPlusEquals(sum_i, FCi[offset[i+1]+j-1] + ScoreJunctionMulti(j,i) + ScoreMultiPaired() + ScoreBasePair(i+1,j));
+        Fast_LogPlusEquals(sum_i, FM1i[offset[i]+j]);
 
-                // compute FM1[i+1,j] + b
-
-                if (allow_unpaired_position[i+1])
-                    Fast_LogPlusEquals(sum_i, FM1i[offset[i+1]+j] + ScoreMultiUnpaired(i+1));
+        FMi[checkpoint_offset[i]+j] = sum_i;
+#if COLUMN_MAJOR_FM2
+        FMi_col[column_offset[j]+i] = sum_i;
+#endif
+    }
+}
 
-                FM1i[offset[i]+j] = sum_i;
-            }
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::ComputeInsideRows()
+//
+// Fill in the inside matrices at the rows first...last in the
+// checkpointed run, whose slots of FCi, FMi, FEi and FNi are cleared
+// first.  The rows last+1...last+CHECKPOINT must have been filled.
+//////////////////////////////////////////////////////////////////////
 
-            // FM[i,j] = optimal energy for substructure belonging to a
-            //           multibranch loop which contains at least one 
-            //           helix
-            //
-            //         = SUM [SUM (i<k<j : FM1[i,k] + FM[k,j]),
-            //                FM[i,j-1] + b,
-            //                FM1[i,j]]
-            //
-            //            (assuming 0 < i < i+2 <= j < L)
+template<class RealT>
+void InferenceEngine<RealT>::ComputeInsideRows(int first, int last)
+{
+    for (int i = first; i <= last; i++)
+    {
+        const int begin = checkpoint_offset[i] + i, end = begin + BAND+1;
+        std::fill(FCi.begin() + begin, FCi.begin() + end, RealT(NEG_INF));
+        std::fill(FMi.begin() + begin, FMi.begin() + end, RealT(NEG_INF));
+#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
+        std::fill(FEi.begin() + begin, FEi.begin() + end, RealT(NEG_INF));
+        std::fill(FNi.begin() + begin, FNi.begin() + end, RealT(NEG_INF));
+#endif
+    }
 
-            if (0 < i && i+2 <= j && j < L)
-            {
+    if (num_threads <= 1)
+    {
+        for (int i = last; i >= first; i--)
+            for (int j = i; j <= std::min(L, i+SPAN); j++)
+                ComputeInsideCell(i, j);
+    }
+    else
+    {
+        ParallelWavefront(first, last, L, std::min(SPAN, L-first), num_threads, false,
+                          [&](int i, int j) { ComputeInsideCell(i, j); });
+    }
+}
 
-                RealT sum_i = RealT(NEG_INF);
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::ComputeInside()
+//
+// Run inside algorithm.
+//////////////////////////////////////////////////////////////////////
 
-                // compute SUM (i<k<j : FM1[i,k] + FM[k,j])
+template<class RealT>
+void InferenceEngine<RealT>::ComputeInside()
+{
+    InitializeCache();
 
-                Fast_LogPlusEquals(sum_i, FM2i);
+#if SHOW_TIMINGS
+    double starting_time = GetSystemTime();
+#endif
 
-                // compute FM[i,j-1] + b
+    // initialization
 
-                if (allow_unpaired_position[j])
-                    Fast_LogPlusEquals(sum_i, FMi[offset[i]+j-1] + ScoreMultiUnpaired(j));
+    // in the checkpointed run, the checkpoints are the first CHECKPOINT
+    // rows of every INTERVAL rows, from which the rows of FC, FM, FE and
+    // FN in between can be recomputed, as each row reads the next
+    // C_MAX_SINGLE_LENGTH+1 rows of FC and D_MAX_HELIX_LENGTH-1 rows of
+    // FE and FN.  The other rows of an interval share INTERVAL-CHECKPOINT
+    // slots.  FM1i and FMi_col are kept whole, as the multi-branch loops
+    // read them over whole columns.
+    int size = SIZE;
+    if (checkpoint_interval < 0)
+    {
+        checkpoint_offset = offset;
+    }
+    else
+    {
+        CHECKPOINT = std::max(C_MAX_SINGLE_LENGTH+1, D_MAX_HELIX_LENGTH-1);
+
+        // FCi, FMi, FEi and FNi keep about L/INTERVAL*CHECKPOINT+INTERVAL
+        // rows, and with several threads, the five outside matrices
+        // INTERVAL rows more, see ComputeOutside()
+        INTERVAL = checkpoint_interval > 0 ? checkpoint_interval :
+            int(std::ceil(std::sqrt(double(L+1) * CHECKPOINT * (num_threads <= 1 ? 1.0 : 4.0/9))));
+        INTERVAL = std::max(INTERVAL, CHECKPOINT+1);
+
+        const int checkpoints = (L/INTERVAL+1) * CHECKPOINT;
+        checkpoint_offset.resize(L+1);
+        for (int i = 0; i <= L; i++)
+        {
+            const int slot = i % INTERVAL < CHECKPOINT ? i / INTERVAL * CHECKPOINT + i % INTERVAL :
+                checkpoints + i % INTERVAL - CHECKPOINT;
+            checkpoint_offset[i] = slot * (BAND+1) - i;
+        }
+        size = (checkpoints + INTERVAL - CHECKPOINT) * (BAND+1);
+    }
 
-                // compute FM1[i,j]
+    F5i.clear(); F5i.resize(L+1, RealT(NEG_INF));
+    FCi.clear(); FCi.resize(size, RealT(NEG_INF));
+    FMi.clear(); FMi.resize(size, RealT(NEG_INF));
+    FM1i.clear(); FM1i.resize(SIZE, RealT(NEG_INF));
+#if COLUMN_MAJOR_FM2
+    FMi_col.clear(); FMi_col.resize(SIZE, RealT(NEG_INF));
+#endif
+#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
+    FEi.clear(); FEi.resize(size, RealT(NEG_INF));
+    FNi.clear(); FNi.resize(size, RealT(NEG_INF));
+#endif
 
-                Fast_LogPlusEquals(sum_i, FM1i[offset[i]+j]);
+    if (checkpoint_interval >= 0)
+    {
+        // F5 is not computed here, as the rows of FC are not kept, but
+        // F5o is, from the rows of FC as soon as they are filled; the
+        // terms are added in the same order as ComputeOutside() does in
+        // the full run
+        F5o.clear(); F5o.resize(L+1, RealT(NEG_INF));
+        F5o[L] = RealT(0);
+
+        for (int a = L / INTERVAL * INTERVAL; a >= 0; a -= INTERVAL)
+        {
+            const int last = std::min(L, a+INTERVAL-1);
+            ComputeInsideRows(a, last);
 
-                FMi[offset[i]+j] = sum_i;
+            for (int k = std::min(L-1, last); k >= a; k--)
+            {
+                for (int j = std::min(L, k+SPAN+2); j > k+1; j--)
+                    if (allow_paired[offset[k+1]+j])
+                        Fast_LogPlusEquals(F5o[k], F5o[j] + ScoreExternalPaired() + ScoreBasePair(k+1,j) + ScoreJunctionExternal(j,k) + FCi[checkpoint_offset[k+1]+j-1]);
+                if (allow_unpaired_position[k+1])
+                    Fast_LogPlusEquals(F5o[k], F5o[k+1] + ScoreExternalUnpaired(k+1));
             }
         }
+
+#if SHOW_TIMINGS
+        std::cerr << "Inside score: " << F5o[0] << " (" << GetSystemTime() - starting_time << " seconds)" << std::endl;
+#endif
+        return;
+    }
+
+    if (num_threads <= 1)
+    {
+        for (int i = L; i >= 0; i--)
+            for (int j = i; j <= std::min(L, i+SPAN); j++)
+                ComputeInsideCell(i, j);
+    }
+    else
+    {
+        // the cells with the same span are independent of each other
+        ParallelWavefront(L, SPAN, num_threads, false,
+                          [&](int i, int j) { ComputeInsideCell(i, j); });
     }
 
     F5i[0] = RealT(0);
@@ -2888,20 +3553,23 @@ void InferenceEngine<RealT>::ComputeInside()
         //
         //       = SUM [F5[j-1] + ScoreExternalUnpaired(),
         //              SUM (0<=k<j : F5[k] + FC[k+1,j-1] + ScoreExternalPaired() + ScoreBP(k+1,j) + ScoreJunctionA(j,k))]
+        //
+        // (the terms are added in the same order as ComputeOutside()
+        // scatters them in the checkpointed run)
 
         RealT sum_i = RealT(NEG_INF);
 
-        // compute F5[j-1] + ScoreExternalUnpaired()
-
-        if (allow_unpaired_position[j])
-            Fast_LogPlusEquals(sum_i, F5i[j-1] + ScoreExternalUnpaired(j));
-
         // compute SUM (0<=k<j : F5[k] + FC[k+1,j-1] + ScoreExternalPaired() + ScoreBP(k+1,j) + ScoreJunctionA(j,k))
 
-        for (int k = 0; k < j; k++)
+        for (int k = std::max(0, j-SPAN-2); k < j; k++)
             if (allow_paired[offset[k+1]+j])
                 Fast_LogPlusEquals(sum_i, F5i[k] + FCi[offset[k+1]+j-1] + ScoreExternalPaired() + ScoreBasePair(k+1,j) + ScoreJunctionExternal(j,k));
 
+        // compute F5[j-1] + ScoreExternalUnpaired()
+
+        if (allow_unpaired_position[j])
+            Fast_LogPlusEquals(sum_i, F5i[j-1] + ScoreExternalUnpaired(j));
+
         F5i[j] = sum_i;
     }
 
@@ -2911,299 +3579,365 @@ void InferenceEngine<RealT>::ComputeInside()
 }
 
 //////////////////////////////////////////////////////////////////////
-// InferenceEngine::ComputeOutside()
+// InferenceEngine::ComputeOutsideCell()
 //
-// Run outside algorithm.
+// Fill in the outside matrices at (i,j) by collecting the terms
+// from the cells with longer spans.  The terms are added in the
+// same order as a row-by-row sweep (increasing i, decreasing j)
+// would scatter them, so the result does not depend on the order
+// in which the cells are visited.
 //////////////////////////////////////////////////////////////////////
 
 template<class RealT>
-void InferenceEngine<RealT>::ComputeOutside()
+void InferenceEngine<RealT>::ComputeOutsideCell(int i, int j)
 {
-    InitializeCache();
-
-#if SHOW_TIMINGS
-    double starting_time = GetSystemTime();
-#endif
+    // FM[i,j] appears in FM2[k,j] + FM1[k,i] (k<i<j) and FM[i,j+1] + b
 
-    // initialization
+    {
+        RealT sum_o = RealT(NEG_INF);
 
-    F5o.clear(); F5o.resize(L+1, RealT(NEG_INF));
-    FCo.clear(); FCo.resize(SIZE, RealT(NEG_INF));
-    FMo.clear(); FMo.resize(SIZE, RealT(NEG_INF));
-    FM1o.clear(); FM1o.resize(SIZE, RealT(NEG_INF));
+        if (i < j)
+        {
+            for (int k = std::max(0, j-SPAN); k < i; k++)
+                Fast_LogPlusEquals(sum_o, FM2o[offset[k]+j] + FM1i[offset[k]+i]);
+        }
 
-#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
-    FEo.clear(); FEo.resize(SIZE, RealT(NEG_INF));
-    FNo.clear(); FNo.resize(SIZE, RealT(NEG_INF));
-#endif
+        if (0 < i && i+1 <= j && j+1 < L && allow_unpaired_position[j+1])
+            Fast_LogPlusEquals(sum_o, FMo[window_offset[i]+j+1] + ScoreMultiUnpaired(j+1));
 
-    F5o[L] = RealT(0);  
-    for (int j = L; j >= 1; j--)
-    {
+        FMo[window_offset[i]+j] = sum_o;
+    }
 
-        // F5[j] = optimal energy for substructure between positions 0 and j
-        //         (or 0 if j = 0)
-        //
-        //       = SUM [F5[j-1] + ScoreExternalUnpaired(),
-        //              SUM (0<=k<j : F5[k] + FC[k+1,j-1] + ScoreExternalPaired() + ScoreBP(k+1,j) + ScoreJunctionA(j,k))]
+    // FM1[i,j] appears in FM1[i-1,j] + b, FM2[i,k] + FM[j,k] (i<j<k) and FM[i,j]
 
-        // compute F5[j-1] + ScoreExternalUnpaired()
+    {
+        RealT sum_o = RealT(NEG_INF);
 
-        if (allow_unpaired_position[j])
-            Fast_LogPlusEquals(F5o[j-1], F5o[j] + ScoreExternalUnpaired(j));
+        if (1 < i && i+1 <= j && j < L && allow_unpaired_position[i])
+            Fast_LogPlusEquals(sum_o, FM1o[window_offset[i-1]+j] + ScoreMultiUnpaired(i));
 
-        // compute SUM (0<=k<j : F5[k] + FC[k+1,j-1] + ScoreExternalPaired() + ScoreBP(k+1,j) + ScoreJunctionA(j,k))
+        // (the checkpointed run keeps only the column-major copy of FM whole)
 
+#if COLUMN_MAJOR_FM2
+        if (i < j && checkpoint_interval >= 0)
         {
-            for (int k = 0; k < j; k++)
-            {
-                if (allow_paired[offset[k+1]+j])
-                {
-                    RealT temp = F5o[j] + ScoreExternalPaired() + ScoreBasePair(k+1,j) + ScoreJunctionExternal(j,k);
-                    Fast_LogPlusEquals(F5o[k], temp + FCi[offset[k+1]+j-1]);
-                    Fast_LogPlusEquals(FCo[offset[k+1]+j-1], temp + F5i[k]);
-                }
-            }
+            for (int k = std::min(L, i+SPAN); k > j; k--)
+                Fast_LogPlusEquals(sum_o, FM2o[offset[i]+k] + FMi_col[column_offset[k]+j]);
         }
-    }
-
-    for (int i = 0; i <= L; i++)
-    {
-        for (int j = L; j >= i; j--)
+        else
+#endif
+        if (i < j)
         {
-            RealT FM2o = RealT(NEG_INF);
+            for (int k = std::min(L, i+SPAN); k > j; k--)
+                Fast_LogPlusEquals(sum_o, FM2o[offset[i]+k] + FMi[offset[j]+k]);
+        }
 
-            // FM[i,j] = optimal energy for substructure belonging to a
-            //           multibranch loop which contains at least one 
-            //           helix
-            //
-            //         = SUM [SUM (i<k<j : FM1[i,k] + FM[k,j]),
-            //                FM[i,j-1] + b,
-            //                FM1[i,j]]
-            //
-            //            (assuming 0 < i < i+2 <= j < L)
+        if (0 < i && i+2 <= j && j < L)
+            Fast_LogPlusEquals(sum_o, FMo[window_offset[i]+j]);
 
-            if (0 < i && i+2 <= j && j < L)
-            {
-                // compute SUM (i<k<j : FM1[i,k] + FM[k,j])
+        FM1o[window_offset[i]+j] = sum_o;
+    }
 
-                Fast_LogPlusEquals(FM2o, FMo[offset[i]+j]);
+    // FC[i,j] appears in F5 (already added), in the single-branch loops
+    // closed by (p,q+1) with p < i <= j < q, and in FM1[i-1,j+1]
 
-                // compute FM[i,j-1] + b
+    if (1 < i && j+1 < L && allow_paired[offset[i]+j+1])
+    {
+        RealT sum_o = FCo[window_offset[i]+j];
 
-                if (allow_unpaired_position[j])
-                    Fast_LogPlusEquals(FMo[offset[i]+j-1], FMo[offset[i]+j] + ScoreMultiUnpaired(j));
+        int p_min = i-1;
+        while (p_min > 1 && i-p_min <= C_MAX_SINGLE_LENGTH && allow_unpaired_position[p_min]) p_min--;
+        int q_max = j+1;
+        while (q_max+1 < L && q_max-j <= C_MAX_SINGLE_LENGTH && allow_unpaired_position[q_max+1]) q_max++;
 
-                // compute FM1[i,j]
+        for (int p = p_min; p < i; p++)
+        {
+            for (int q = std::min({q_max, j+1+C_MAX_SINGLE_LENGTH-(i-1-p), p+SPAN}); q > j; q--)
+            {
+                if (p == i-1 && q == j+1) continue;
+                if (!allow_paired[offset[p]+q+1]) continue;
 
-                Fast_LogPlusEquals(FM1o[offset[i]+j], FMo[offset[i]+j]);
+#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
+                Fast_LogPlusEquals(sum_o, FNo[window_offset[p]+q] + ScoreSingle(p,q,i-1,j+1));
+#else
+                Fast_LogPlusEquals(sum_o, FCo[window_offset[p]+q] + ScoreSingle(p,q,i-1,j+1));
+#endif
             }
+        }
 
-            // FM1[i,j] = optimal energy for substructure belonging to a
-            //            multibranch loop containing a (k+1,j) base pair
-            //            preceded by 5' unpaired nucleotides from i to k
-            //            for some i <= k <= j-2
-            //
-            //          = SUM [FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)  if i+2<=j,
-            //                 FM1[i+1,j] + b                                          if i+2<=j]
-            //
-            //            (assuming 0 < i < i+2 <= j < L)
+        Fast_LogPlusEquals(sum_o, FM1o[window_offset[i-1]+j+1] + ScoreJunctionMulti(j+1,i-1) + ScoreMultiPaired() + ScoreBasePair(i,j+1));
 
-            if (0 < i && i+2 <= j && j < L)
-            {
-                // compute FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)
+#if !(PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR)
+        if (allow_paired[offset[i-1]+j+2])
+            Fast_LogPlusEquals(sum_o, FCo[window_offset[i-1]+j+1] + (ScoreBasePair(i,j+1) + ScoreHelixStacking(i-1,j+2)));
+#endif
 
-                if (allow_paired[offset[i+1]+j])
-                    Fast_LogPlusEquals(FCo[offset[i+1]+j-1], FM1o[offset[i]+j] + ScoreJunctionMulti(j,i) + ScoreMultiPaired() + ScoreBasePair(i+1,j));
+        FCo[window_offset[i]+j] = sum_o;
+    }
 
-                // compute FM1[i+1,j] + b
+#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
 
-                if (allow_unpaired_position[i+1])
-                    Fast_LogPlusEquals(FM1o[offset[i+1]+j], FM1o[offset[i]+j] + ScoreMultiUnpaired(i+1));
+    // h = number of nested pairs (i-n,j+n+1), 0 <= n < h, that are allowed
 
-            }
+    int h = 0;
+    while (h < D_MAX_HELIX_LENGTH && 0 < i-h && j+h < L && allow_paired[offset[i-h]+j+h+1]) h++;
 
-#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
+    // FE[i,j] appears in FC[i-D+1,j+D-1] + ScoreHelix(i-D,j+D,D) and
+    // FE[i-1,j+1] + ScoreBP(i,j+1) + ScoreHelixStacking(i-1,j+2)
 
-            // FC[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) are base-paired
-            //           but (i-1,j+2) are not
-            //
-            //         = SUM [ScoreIsolated() + FN(i,j),
-            //                SUM (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k)),
-            //                FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
-            //
-            //           (assuming 0 < i <= j < L)
+    {
+        RealT sum_o = RealT(NEG_INF);
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
+        if (h == D_MAX_HELIX_LENGTH)
+            Fast_LogPlusEquals(sum_o, ScoreHelix(i-D_MAX_HELIX_LENGTH,j+D_MAX_HELIX_LENGTH,D_MAX_HELIX_LENGTH) +
+                               FCo[window_offset[i-D_MAX_HELIX_LENGTH+1]+j+D_MAX_HELIX_LENGTH-1]);
 
-                // compute ScoreIsolated() + FN(i,j)
+        if (h >= 2 && i <= j)
+            Fast_LogPlusEquals(sum_o, FEo[window_offset[i-1]+j+1] + ScoreBasePair(i,j+1) + ScoreHelixStacking(i-1,j+2));
 
-                Fast_LogPlusEquals(FNo[offset[i]+j], ScoreIsolated() + FCo[offset[i]+j]);
+        FEo[window_offset[i]+j] = sum_o;
+    }
 
-                // compute SUM (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k))
+    // FN[i,j] appears in FC[i-k+1,j+k-1] + ScoreHelix(i-k,j+k,k) (2<=k<D),
+    // ScoreIsolated() + FC[i,j] and FE[i,j]
 
-                bool allowed = true;
-                for (int k = 2; k < D_MAX_HELIX_LENGTH; k++)
-                {
-                    if (i + 2*k - 2 > j) break;
-                    if (!allow_paired[offset[i+k-1]+j-k+2]) { allowed = false; break; }
-                    Fast_LogPlusEquals(FNo[offset[i+k-1]+j-k+1], ScoreHelix(i-1,j+1,k) + FCo[offset[i]+j]);
-                }
+    {
+        RealT sum_o = RealT(NEG_INF);
 
-                // compute FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
+        for (int k = std::min(h, D_MAX_HELIX_LENGTH-1); k >= 2; k--)
+            Fast_LogPlusEquals(sum_o, ScoreHelix(i-k,j+k,k) + FCo[window_offset[i-k+1]+j+k-1]);
 
-                if (i + 2*D_MAX_HELIX_LENGTH-2 <= j)
-                {
-                    if (allowed && allow_paired[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+2])
-                        Fast_LogPlusEquals(FEo[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+1],
-                                           ScoreHelix(i-1,j+1,D_MAX_HELIX_LENGTH) + FCo[offset[i]+j]);
-                }
-            }
+        if (h >= 1)
+        {
+            Fast_LogPlusEquals(sum_o, ScoreIsolated() + FCo[window_offset[i]+j]);
+            Fast_LogPlusEquals(sum_o, FEo[window_offset[i]+j]);
+        }
 
-            // FE[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) ... (i-D+1,j+D) are 
-            //           already base-paired
-            //
-            //         = SUM [ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]   if i+2<=j,
-            //                FN(i,j)]
-            //
-            //           (assuming 0 < i <= j < L)
+        FNo[window_offset[i]+j] = sum_o;
+    }
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
+#endif
 
-                // compute ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]
+    // FM2[i,j] appears in FM[i,j] and in the multi-branch loop closed by (i,j+1)
 
-                if (i+2 <= j && allow_paired[offset[i+1]+j])
-                {
-                    Fast_LogPlusEquals(FEo[offset[i+1]+j-1], FEo[offset[i]+j] + ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1));
-                }
+    {
+        RealT sum_o = RealT(NEG_INF);
 
-                // compute FN(i,j)
+        if (0 < i && i+2 <= j && j < L)
+            Fast_LogPlusEquals(sum_o, FMo[window_offset[i]+j]);
 
-                Fast_LogPlusEquals(FNo[offset[i]+j], FEo[offset[i]+j]);
-            }
+        if (0 < i && j < L && allow_paired[offset[i]+j+1])
+        {
+#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
+            Fast_LogPlusEquals(sum_o, FNo[window_offset[i]+j] + ScoreJunctionMulti(i,j) + ScoreMultiPaired() + ScoreMultiBase());
+#else
+            Fast_LogPlusEquals(sum_o, FCo[window_offset[i]+j] + ScoreJunctionMulti(i,j) + ScoreMultiPaired() + ScoreMultiBase());
+#endif
+        }
 
-            // FN[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) are base-paired
-            //           and the next interaction is not a stacking pair
-            //
-            //         = SUM [ScoreHairpin(i,j),
-            //                SUM (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
-            //                ScoreJunctionA(i,j) + a + c + SUM (i<k<j : FM1[i,k] + FM[k,j])]
-            //
-            //           (assuming 0 < i <= j < L)
-            //
-            // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
+        FM2o[offset[i]+j] = sum_o;
+    }
+}
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::ComputeOutsideRows()
+//
+// Fill in the outside matrices at the rows first...last in the
+// checkpointed run, starting with the terms of F5 which ComputeOutside()
+// adds to FC beforehand in the full run.  The rows first-WINDOW+1...
+// first-1 must have been filled, and F5i up to last-1.
+//////////////////////////////////////////////////////////////////////
+
+template<class RealT>
+void InferenceEngine<RealT>::ComputeOutsideRows(int first, int last)
+{
+    for (int i = first; i <= last; i++)
+    {
+        const int begin = window_offset[i] + i, end = begin + BAND+1;
+        std::fill(FCo.begin() + begin, FCo.begin() + end, RealT(NEG_INF));
+        std::fill(FMo.begin() + begin, FMo.begin() + end, RealT(NEG_INF));
+        std::fill(FM1o.begin() + begin, FM1o.begin() + end, RealT(NEG_INF));
+#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
+        std::fill(FEo.begin() + begin, FEo.begin() + end, RealT(NEG_INF));
+        std::fill(FNo.begin() + begin, FNo.begin() + end, RealT(NEG_INF));
+#endif
+
+        if (i == 0) continue;
+        for (int j = i; j <= std::min(L-1, i+SPAN); j++)
+        {
+            if (allow_paired[offset[i]+j+1])
             {
+                RealT temp = F5o[j+1] + ScoreExternalPaired() + ScoreBasePair(i,j+1) + ScoreJunctionExternal(j+1,i-1);
+                Fast_LogPlusEquals(FCo[window_offset[i]+j], temp + F5i[i-1]);
+            }
+        }
+    }
 
-                // compute ScoreHairpin(i,j) -- do nothing
+    if (num_threads <= 1)
+    {
+        for (int i = first; i <= last; i++)
+            for (int j = std::min(L, i+SPAN); j >= i; j--)
+                ComputeOutsideCell(i, j);
+    }
+    else
+    {
+        ParallelWavefront(first, last, L, std::min(SPAN, L-first), num_threads, true,
+                          [&](int i, int j) { ComputeOutsideCell(i, j); });
+    }
+}
 
-                // compute SUM (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::ComputeOutside()
+//
+// Run outside algorithm.
+//////////////////////////////////////////////////////////////////////
 
-                {
-                    RealT temp = FNo[offset[i]+j];
-                    for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
-                    {
-                        if (p > i && !allow_unpaired_position[p]) break;
-                        int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
-                        for (int q = j; q >= q_min; q--)
-                        {
-                            if (q < j && !allow_unpaired_position[q+1]) break;
-                            if (!allow_paired[offset[p+1]+q]) continue;
-                            if (i == p && j == q) continue;
+template<class RealT>
+void InferenceEngine<RealT>::ComputeOutside()
+{
+    InitializeCache();
 
-                            Fast_LogPlusEquals(FCo[offset[p+1]+q-1], temp + ScoreSingle(i,j,p,q));
-                        }
-                    }
-                }
+#if SHOW_TIMINGS
+    double starting_time = GetSystemTime();
+#endif
 
-                // compute SUM (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c)
+    // initialization
 
-                Fast_LogPlusEquals(FM2o, FNo[offset[i]+j] + ScoreJunctionMulti(i,j) + ScoreMultiPaired() + ScoreMultiBase());
+    // in the checkpointed run, row i is kept in slot i % WINDOW, as
+    // ComputeOutsideCell() reads the rows i-C_MAX_SINGLE_LENGTH-1...i
+    // and i-D_MAX_HELIX_LENGTH+1...i, or in slot i % (INTERVAL+WINDOW)
+    // with several threads, which fill the rows of an interval together
+    int size = SIZE;
+    if (checkpoint_interval < 0)
+    {
+        window_offset = offset;
+    }
+    else
+    {
+        WINDOW = std::max(C_MAX_SINGLE_LENGTH+2, D_MAX_HELIX_LENGTH);
+        const int slots = num_threads <= 1 ? WINDOW : INTERVAL+WINDOW;
+        window_offset.resize(L+1);
+        for (int i = 0; i <= L; i++)
+            window_offset[i] = i % slots * (BAND+1) - i;
+        size = slots * (BAND+1);
+    }
 
-            }
+    FCo.clear(); FCo.resize(size, RealT(NEG_INF));
+    FMo.clear(); FMo.resize(size, RealT(NEG_INF));
+    FM1o.clear(); FM1o.resize(size, RealT(NEG_INF));
+    FM2o.clear(); FM2o.resize(SIZE, RealT(NEG_INF));
 
-#else
+#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
+    FEo.clear(); FEo.resize(size, RealT(NEG_INF));
+    FNo.clear(); FNo.resize(size, RealT(NEG_INF));
+#endif
 
-            // FC[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) are base-paired
-            //
-            //         = SUM [ScoreHairpin(i,j),
-            //                SUM (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
-            //                ScoreJunctionA(i,j) + a + c + SUM (i<k<j : FM1[i,k] + FM[k,j])]
-            //
-            //           (assuming 0 < i <= j < L)
-            //
-            // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
+    if (checkpoint_interval >= 0)
+    {
+        // ComputeInside() has computed F5o.  Each interval is filled in
+        // turn: the rows of the inside matrices between the checkpoints
+        // are recomputed, F5 is computed from their rows of FC, with the
+        // terms added in the same order as ComputeInside() does in the
+        // full run, and then the outside matrices and the posteriors
+        // are, in the same order as ComputePosterior() in the full run
+        posterior.clear();
+        posterior.resize(SIZE, RealT(0));
+        const RealT Z = ComputeLogPartitionCoefficient();
+
+        F5i.assign(L+1, RealT(NEG_INF));
+        F5i[0] = RealT(0);
+
+        for (int a = 0; a <= L; a += INTERVAL)
+        {
+            const int last = std::min(L, a+INTERVAL-1);
+            if (a+CHECKPOINT <= last)
+                ComputeInsideRows(a+CHECKPOINT, last);
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
+            for (int k = std::max(0, a-1); k < last; k++)
             {
-                // compute ScoreHairpin(i,j) -- do nothing
-
-                // compute SUM (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
+                if (k > 0 && allow_unpaired_position[k])
+                    Fast_LogPlusEquals(F5i[k], F5i[k-1] + ScoreExternalUnpaired(k));
+                for (int j = k+2; j <= std::min(L, k+SPAN+2); j++)
+                    if (allow_paired[offset[k+1]+j])
+                        Fast_LogPlusEquals(F5i[j], F5i[k] + FCi[checkpoint_offset[k+1]+j-1] + ScoreExternalPaired() + ScoreBasePair(k+1,j) + ScoreJunctionExternal(j,k));
+            }
+            if (last == L && L > 0 && allow_unpaired_position[L])
+                Fast_LogPlusEquals(F5i[L], F5i[L-1] + ScoreExternalUnpaired(L));
 
+            // one thread keeps only the last WINDOW rows of the outside
+            // matrices, see above
+            if (num_threads <= 1)
+            {
+                for (int i = a; i <= last; i++)
                 {
-                    RealT temp = FCo[offset[i]+j];
-                    for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
-                    {
-                        if (p > i && !allow_unpaired_position[p]) break;
-                        int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
-                        for (int q = j; q >= q_min; q--)
-                        {
-                            if (q < j && !allow_unpaired_position[q+1]) break;
-                            if (!allow_paired[offset[p+1]+q]) continue;
-
-                            Fast_LogPlusEquals(FCo[offset[p+1]+q-1],
-                                               temp + (p == i && q == j ? ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) : ScoreSingle(i,j,p,q)));
-                        }
-                    }
+                    ComputeOutsideRows(i, i);
+                    ComputePosteriorRows(i, i, Z);
                 }
+            }
+            else
+            {
+                ComputeOutsideRows(a, last);
+                ComputePosteriorRows(a, last, Z);
+            }
 
-                // compute SUM (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c)
-
-                Fast_LogPlusEquals(FM2o, FCo[offset[i]+j] + ScoreJunctionMulti(i,j) + ScoreMultiPaired() + ScoreMultiBase());
-
+            for (int k = std::max(0, a-1); k < last; k++)
+            {
+                for (int j = k+2; j <= std::min(L, k+SPAN+2); j++)
+                    if (allow_paired[offset[k+1]+j])
+                        posterior[offset[k+1]+j] += Fast_Exp(F5o[j] - Z + F5i[k] + FCi[checkpoint_offset[k+1]+j-1] + ScoreExternalPaired() + ScoreBasePair(k+1,j) + ScoreJunctionExternal(j,k));
             }
+        }
 
+#if SHOW_TIMINGS
+        std::cerr << "Outside score: " << F5o[0] << " (" << GetSystemTime() - starting_time << " seconds)" << std::endl;
 #endif
+        return;
+    }
 
-            // FM2[i,j] = SUM (i<k<j : FM1[i,k] + FM[k,j])
+    F5o.clear(); F5o.resize(L+1, RealT(NEG_INF));
+    F5o[L] = RealT(0);  
+    for (int j = L; j >= 1; j--)
+    {
 
-#if SIMPLE_FM2
+        // F5[j] = optimal energy for substructure between positions 0 and j
+        //         (or 0 if j = 0)
+        //
+        //       = SUM [F5[j-1] + ScoreExternalUnpaired(),
+        //              SUM (0<=k<j : F5[k] + FC[k+1,j-1] + ScoreExternalPaired() + ScoreBP(k+1,j) + ScoreJunctionA(j,k))]
 
-            for (int k = i+1; k < j; k++)
-            {
-                Fast_LogPlusEquals(FM1o[offset[i]+k], FM2o + FMi[offset[k]+j]);
-                Fast_LogPlusEquals(FMo[offset[k]+j], FM2o + FM1i[offset[i]+k]);
-            }
+        // compute F5[j-1] + ScoreExternalUnpaired()
 
-#else
-            if (i+2 <= j)
+        if (allow_unpaired_position[j])
+            Fast_LogPlusEquals(F5o[j-1], F5o[j] + ScoreExternalUnpaired(j));
+
+        // compute SUM (0<=k<j : F5[k] + FC[k+1,j-1] + ScoreExternalPaired() + ScoreBP(k+1,j) + ScoreJunctionA(j,k))
+
+        {
+            for (int k = std::max(0, j-SPAN-2); k < j; k++)
             {
-                RealT *p1i = &(FM1i[offset[i]+i+1]);
-                RealT *p2i = &(FMi[offset[i+1]+j]);
-                RealT *p1o = &(FM1o[offset[i]+i+1]);
-                RealT *p2o = &(FMo[offset[i+1]+j]);
-                for (int k = i+1; k < j; k++)
+                if (allow_paired[offset[k+1]+j])
                 {
-                    Fast_LogPlusEquals(*p1o, FM2o + *p2i);
-                    Fast_LogPlusEquals(*p2o, FM2o + *p1i);
-                    ++p1i;
-                    ++p1o;
-                    p2i += L-k;
-                    p2o += L-k;
+                    RealT temp = F5o[j] + ScoreExternalPaired() + ScoreBasePair(k+1,j) + ScoreJunctionExternal(j,k);
+                    Fast_LogPlusEquals(F5o[k], temp + FCi[offset[k+1]+j-1]);
+                    Fast_LogPlusEquals(FCo[window_offset[k+1]+j-1], temp + F5i[k]);
                 }
             }
-
-#endif
         }
     }
 
+    if (num_threads <= 1)
+    {
+        for (int i = 0; i <= L; i++)
+            for (int j = std::min(L, i+SPAN); j >= i; j--)
+                ComputeOutsideCell(i, j);
+    }
+    else
+    {
+        // the cells with the same span are independent of each other
+        ParallelWavefront(L, SPAN, num_threads, true,
+                          [&](int i, int j) { ComputeOutsideCell(i, j); });
+    }
+
 #if SHOW_TIMINGS
     std::cerr << "Outside score: " << F5o[0] << " (" << GetSystemTime() - starting_time << " seconds)" << std::endl;
 #endif
@@ -3219,21 +3953,22 @@ template<class RealT>
 inline RealT InferenceEngine<RealT>::ComputeLogPartitionCoefficient() const
 {
     // NOTE: This should be equal to F5o[0]. 
+    // (the checkpointed run has only F5o until the outside algorithm)
 
-    return F5i[L];
+    return checkpoint_interval < 0 ? F5i[L] : F5o[0];
 }
 
 //////////////////////////////////////////////////////////////////////
 // InferenceEngine::ComputeFeatureCountExpectations()
 // 
 // Combine the results of the inside and outside algorithms
-// in order to compute feature count expectations.
+// in order to compute feature count expectations, which are added
+// to cnt.
 //////////////////////////////////////////////////////////////////////
 
 template<class RealT>
-//std::vector<RealT>
-std::unordered_map<size_t,RealT>
-InferenceEngine<RealT>::ComputeFeatureCountExpectations()
+void
+InferenceEngine<RealT>::ComputeFeatureCountExpectations(FeatureCounts<RealT>& cnt)
 {
 #if SHOW_TIMINGS
     double starting_time = GetSystemTime();
@@ -3242,16 +3977,16 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
     //std::cerr << "Inside score: " << F5i[L].GetLogRepresentation() << std::endl;
     //std::cerr << "Outside score: " << F5o[0].GetLogRepresentation() << std::endl;
 
+    Assert(checkpoint_interval < 0, "The checkpointed run does not keep the matrices.");
+
     const RealT Z = ComputeLogPartitionCoefficient();
 
     ClearCounts();
-    //std::vector<RealT> cnt;
-    std::unordered_map<size_t,RealT> cnt;
     counts_= &cnt;
 
     for (int i = L; i >= 0; i--)
     {
-        for (int j = i; j <= L; j++)
+        for (int j = i; j <= std::min(L, i+SPAN); j++)
         {
 
             // FM2[i,j] = SUM (i<k<j : FM1[i,k] + FM[k,j])
@@ -3263,6 +3998,11 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
             for (int k = i+1; k < j; k++)
                 Fast_LogPlusEquals(FM2i, FM1i[offset[i]+k] + FMi[offset[k]+j]);
 
+#elif COLUMN_MAJOR_FM2
+
+            if (i+2 <= j)
+                FM2i = Fast_LogSumPlus(&(FM1i[offset[i]+i+1]), &(FMi_col[column_offset[j]+i+1]), j-i-1);
+
 #else
 
             if (i+2 <= j)
@@ -3273,7 +4013,7 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
                 {
                     Fast_LogPlusEquals(FM2i, (*p1) + (*p2));
                     ++p1;
-                    p2 += L-k;
+                    p2 += offset[k+1]-offset[k];
                 }
             }
 
@@ -3296,11 +4036,11 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
             if (0 < i && j < L && allow_paired[offset[i]+j+1])
             {
 
-                RealT outside = FNo[offset[i]+j] - Z;
+                RealT outside = FNo[window_offset[i]+j] - Z;
 
                 // compute ScoreHairpin(i,j)
 
-                if (allow_unpaired[offset[i]+j] && j-i >= C_MIN_HAIRPIN_LENGTH)
+                if (AllowUnpaired(i,j) && j-i >= C_MIN_HAIRPIN_LENGTH)
                     CountHairpin(i,j,Fast_Exp(outside + ScoreHairpin(i,j)));
 
                 // compute SUM (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
@@ -3341,13 +4081,13 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
             if (0 < i && j < L && allow_paired[offset[i]+j+1])
             {
 
-                RealT outside = FEo[offset[i]+j] - Z;
+                RealT outside = FEo[window_offset[i]+j] - Z;
 
                 // compute ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]
 
                 if (i+2 <= j && allow_paired[offset[i+1]+j])
                 {
-                    RealT value = Fast_Exp(outside + ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) + FEi[offset[i+1]+j-1]);
+                    RealT value = Fast_Exp(outside + ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) + FEi[checkpoint_offset[i+1]+j-1]);
                     CountBasePair(i+1,j,value);
                     CountHelixStacking(i,j+1,value);
                 }
@@ -3368,11 +4108,11 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
 
             if (0 < i && j < L && allow_paired[offset[i]+j+1])
             {
-                RealT outside = FCo[offset[i]+j] - Z;
+                RealT outside = FCo[window_offset[i]+j] - Z;
 
                 // compute ScoreIsolated() + FN(i,j)
 
-                CountIsolated(Fast_Exp(outside + ScoreIsolated() + FNi[offset[i]+j]));
+                CountIsolated(Fast_Exp(outside + ScoreIsolated() + FNi[checkpoint_offset[i]+j]));
 
                 // compute SUM (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k))
 
@@ -3381,7 +4121,7 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
                 {
                     if (i + 2*k - 2 > j) break;
                     if (!allow_paired[offset[i+k-1]+j-k+2]) { allowed = false; break; }
-                    CountHelix(i-1,j+1,k,Fast_Exp(outside + ScoreHelix(i-1,j+1,k) + FNi[offset[i+k-1]+j-k+1]));
+                    CountHelix(i-1,j+1,k,Fast_Exp(outside + ScoreHelix(i-1,j+1,k) + FNi[checkpoint_offset[i+k-1]+j-k+1]));
                 }
 
                 // compute FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
@@ -3390,7 +4130,7 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
                 {
                     if (allowed && allow_paired[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+2])
                         CountHelix(i-1,j+1,D_MAX_HELIX_LENGTH,
-                                   Fast_Exp(outside + ScoreHelix(i-1,j+1,D_MAX_HELIX_LENGTH) + FEi[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+1]));
+                                   Fast_Exp(outside + ScoreHelix(i-1,j+1,D_MAX_HELIX_LENGTH) + FEi[checkpoint_offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+1]));
                 }
             }
 
@@ -3409,11 +4149,11 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
 
             if (0 < i && j < L && allow_paired[offset[i]+j+1])
             {
-                RealT outside = FCo[offset[i]+j] - Z;
+                RealT outside = FCo[window_offset[i]+j] - Z;
 
                 // compute ScoreHairpin(i,j)
 
-                if (allow_unpaired[offset[i]+j] && j-i >= C_MIN_HAIRPIN_LENGTH)
+                if (AllowUnpaired(i,j) && j-i >= C_MIN_HAIRPIN_LENGTH)
                     CountHairpin(i,j,Fast_Exp(outside + ScoreHairpin(i,j)));
 
                 // compute SUM (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
@@ -3469,7 +4209,7 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
 
                 if (allow_paired[offset[i+1]+j])
                 {
-                    RealT value = Fast_Exp(FM1o[offset[i]+j] + FCi[offset[i+1]+j-1] + ScoreJunctionMulti(j,i) + ScoreMultiPaired() + ScoreBasePair(i+1,j) - Z);
+                    RealT value = Fast_Exp(FM1o[window_offset[i]+j] + FCi[offset[i+1]+j-1] + ScoreJunctionMulti(j,i) + ScoreMultiPaired() + ScoreBasePair(i+1,j) - Z);
                     CountJunctionMulti(j,i,value);
                     CountMultiPaired(value);
                     CountBasePair(i+1,j,value);
@@ -3479,7 +4219,7 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
 
                 if (allow_unpaired_position[i+1])
                 {
-                    CountMultiUnpaired(i+1,Fast_Exp(FM1o[offset[i]+j] + FM1i[offset[i+1]+j] + ScoreMultiUnpaired(i+1) - Z));
+                    CountMultiUnpaired(i+1,Fast_Exp(FM1o[window_offset[i]+j] + FM1i[offset[i+1]+j] + ScoreMultiUnpaired(i+1) - Z));
                 }
             }
 
@@ -3501,7 +4241,7 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
                 // compute FM[i,j-1] + b
 
                 if (allow_unpaired_position[j])
-                    CountMultiUnpaired(j,Fast_Exp(FMo[offset[i]+j] + FMi[offset[i]+j-1] + ScoreMultiUnpaired(j) - Z));
+                    CountMultiUnpaired(j,Fast_Exp(FMo[window_offset[i]+j] + FMi[offset[i]+j-1] + ScoreMultiUnpaired(j) - Z));
 
                 // compute FM1[i,j] -- do nothing
             }
@@ -3526,7 +4266,7 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
 
         // compute SUM (0<=k<j : F5[k] + FC[k+1,j-1] + ScoreExternalPaired() + ScoreBP(k+1,j) + ScoreJunctionA(j,k))
 
-        for (int k = 0; k < j; k++)
+        for (int k = std::max(0, j-SPAN-2); k < j; k++)
         {
             if (allow_paired[offset[k+1]+j])
             {
@@ -3543,250 +4283,305 @@ InferenceEngine<RealT>::ComputeFeatureCountExpectations()
 #if SHOW_TIMINGS
     std::cerr << "Feature expectations (" << GetSystemTime() - starting_time << " seconds)" << std::endl;
 #endif
-
-    return cnt;
 }
 
 //////////////////////////////////////////////////////////////////////
-// InferenceEngine::ComputePosterior()
-// 
-// Combine the results of the inside and outside algorithms
-// in order to compute posterior probabilities of base pairing.
+// InferenceEngine::ComputePosteriorCell()
+//
+// Add the base-pairing probabilities contributed by the cell (i,j)
+// to the given buffer.
 //////////////////////////////////////////////////////////////////////
 
 template<class RealT>
-void InferenceEngine<RealT>::ComputePosterior()
+void InferenceEngine<RealT>::ComputePosteriorCell(int i, int j, RealT Z, std::vector<RealT> &partial)
 {
-    posterior.clear();
-    posterior.resize(SIZE, RealT(0));
-
-    //double starting_time = GetSystemTime();
-
-    const RealT Z = ComputeLogPartitionCoefficient();
+#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
 
-    for (int i = L; i >= 0; i--)
+    // FN[i,j] = optimal energy for substructure between positions
+    //           i and j such that letters (i,j+1) are base-paired
+    //           and the next interaction is not a stacking pair
+    //
+    //         = SUM [ScoreHairpin(i,j),
+    //                SUM (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
+    //                ScoreJunctionA(i,j) + a + c + SUM (i<k<j : FM1[i,k] + FM[k,j])]
+    //
+    //           (assuming 0 < i <= j < L)
+    //
+    // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
+
+    if (0 < i && j < L && allow_paired[offset[i]+j+1])
     {
-        for (int j = i; j <= L; j++)
-        {
+        RealT outside = FNo[window_offset[i]+j] - Z;
 
-            // FM2[i,j] = SUM (i<k<j : FM1[i,k] + FM[k,j])
-
-            RealT FM2i = RealT(NEG_INF);
+        // compute ScoreHairpin(i,j) -- do nothing
 
-#if SIMPLE_FM2
-
-            for (int k = i+1; k < j; k++)
-                Fast_LogPlusEquals(FM2i, FM1i[offset[i]+k] + FMi[offset[k]+j]);
+        // compute SUM (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
 
-#else
-
-            if (i+2 <= j)
+        for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
+        {
+            if (p > i && !allow_unpaired_position[p]) break;
+            int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
+            for (int q = j; q >= q_min; q--)
             {
-                const RealT *p1 = &(FM1i[offset[i]+i+1]);
-                const RealT *p2 = &(FMi[offset[i+1]+j]);
-                for (int k = i+1; k < j; k++)
-                {
-                    Fast_LogPlusEquals(FM2i, (*p1) + (*p2));
-                    ++p1;
-                    p2 += L-k;
-                }
+                if (q < j && !allow_unpaired_position[q+1]) break;
+                if (!allow_paired[offset[p+1]+q]) continue;
+                if (i == p && j == q) continue;
+
+                partial[offset[p+1]+q] += Fast_Exp(outside + ScoreSingle(i,j,p,q) + FCi[checkpoint_offset[p+1]+q-1]);
             }
+        }
 
-#endif
+        // compute SUM (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c) -- do nothing
 
-#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
+    }
 
-            // FN[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) are base-paired
-            //           and the next interaction is not a stacking pair
-            //
-            //         = SUM [ScoreHairpin(i,j),
-            //                SUM (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
-            //                ScoreJunctionA(i,j) + a + c + SUM (i<k<j : FM1[i,k] + FM[k,j])]
-            //
-            //           (assuming 0 < i <= j < L)
-            //
-            // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
+    // FE[i,j] = optimal energy for substructure between positions
+    //           i and j such that letters (i,j+1) ... (i-D+1,j+D) are 
+    //           already base-paired
+    //
+    //         = SUM [ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]   if i+2<=j,
+    //                FN(i,j)]
+    //
+    //           (assuming 0 < i <= j < L)
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
-                RealT outside = FNo[offset[i]+j] - Z;
+    if (0 < i && j < L && allow_paired[offset[i]+j+1])
+    {
+        RealT outside = FEo[window_offset[i]+j] - Z;
 
-                // compute ScoreHairpin(i,j) -- do nothing
+        // compute ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]
 
-                // compute SUM (i<=p<p+2<=q<=j, p-i+j-q>0 : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
+        if (i+2 <= j && allow_paired[offset[i+1]+j])
+            partial[offset[i]+j] += Fast_Exp(outside + ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) + FEi[checkpoint_offset[i+1]+j-1]);
 
-                for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
-                {
-                    if (p > i && !allow_unpaired_position[p]) break;
-                    int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
-                    for (int q = j; q >= q_min; q--)
-                    {
-                        if (q < j && !allow_unpaired_position[q+1]) break;
-                        if (!allow_paired[offset[p+1]+q]) continue;
-                        if (i == p && j == q) continue;
+        // compute FN(i,j) -- do nothing
 
-                        posterior[offset[p+1]+q] += Fast_Exp(outside + ScoreSingle(i,j,p,q) + FCi[offset[p+1]+q-1]);
-                    }
-                }
+    }
 
-                // compute SUM (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c) -- do nothing
+    // FC[i,j] = optimal energy for substructure between positions
+    //           i and j such that letters (i,j+1) are base-paired
+    //           but (i-1,j+2) are not
+    //
+    //         = SUM [ScoreIsolated() + FN(i,j),
+    //                SUM (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k)),
+    //                FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
+    //
+    //           (assuming 0 < i <= j < L)
+
+    if (0 < i && j < L && allow_paired[offset[i]+j+1])
+    {
 
-            }
+        RealT outside = FCo[window_offset[i]+j] - Z;
 
-            // FE[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) ... (i-D+1,j+D) are 
-            //           already base-paired
-            //
-            //         = SUM [ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]   if i+2<=j,
-            //                FN(i,j)]
-            //
-            //           (assuming 0 < i <= j < L)
+        // compute ScoreIsolated() + FN(i,j) -- do nothing
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
-                RealT outside = FEo[offset[i]+j] - Z;
+        // compute SUM (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k))
 
-                // compute ScoreBP(i+1,j) + ScoreHelixStacking(i,j+1) + FE[i+1,j-1]
+        bool allowed = true;
+        for (int k = 2; k < D_MAX_HELIX_LENGTH; k++)
+        {
+            if (i + 2*k - 2 > j) break;
+            if (!allow_paired[offset[i+k-1]+j-k+2]) { allowed = false; break; }
+            RealT value = Fast_Exp(outside + ScoreHelix(i-1,j+1,k) + FNi[checkpoint_offset[i+k-1]+j-k+1]);
+            for (int p = 1; p < k; p++)
+                partial[offset[i+p]+j-p+1] += value;
+        }
 
-                if (i+2 <= j && allow_paired[offset[i+1]+j])
-                    posterior[offset[i]+j] += Fast_Exp(outside + ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) + FEi[offset[i+1]+j-1]);
+        // compute FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
 
-                // compute FN(i,j) -- do nothing
+        if (i + 2*D_MAX_HELIX_LENGTH-2 <= j)
+        {
+            if (allowed && allow_paired[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+2]) {
+                RealT value = Fast_Exp(outside + ScoreHelix(i-1,j+1,D_MAX_HELIX_LENGTH) + FEi[checkpoint_offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+1]);
 
+                for (int k = 1; k < D_MAX_HELIX_LENGTH; k++)
+                    partial[offset[i+k]+j-k+1] += value;
             }
+        }
+    }
 
-            // FC[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) are base-paired
-            //           but (i-1,j+2) are not
-            //
-            //         = SUM [ScoreIsolated() + FN(i,j),
-            //                SUM (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k)),
-            //                FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
-            //
-            //           (assuming 0 < i <= j < L)
+#else
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
+    // FC[i,j] = optimal energy for substructure between positions
+    //           i and j such that letters (i,j+1) are base-paired
+    //
+    //         = SUM [ScoreHairpin(i,j),
+    //                SUM (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
+    //                ScoreJunctionA(i,j) + a + c + SUM (i<k<j : FM1[i,k] + FM[k,j])]
+    //
+    //           (assuming 0 < i <= j < L)
+    //
+    // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
+
+    if (0 < i && j < L && allow_paired[offset[i]+j+1])
+    {
 
-                RealT outside = FCo[offset[i]+j] - Z;
+        RealT outside = FCo[window_offset[i]+j] - Z;
 
-                // compute ScoreIsolated() + FN(i,j) -- do nothing
+        // compute ScoreHairpin(i,j) -- do nothing
 
-                // compute SUM (2<=k<D : FN(i+k-1,j-k+1) + ScoreHelix(i-1,j+1,k))
+        // compute SUM (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
 
-                bool allowed = true;
-                for (int k = 2; k < D_MAX_HELIX_LENGTH; k++)
+        for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
+        {
+            if (p > i && !allow_unpaired_position[p]) break;
+            int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
+            for (int q = j; q >= q_min; q--)
+            {
+                if (q < j && !allow_unpaired_position[q+1]) break;
+                if (!allow_paired[offset[p+1]+q]) continue;
+
+                if (p == i && q == j)
                 {
-                    if (i + 2*k - 2 > j) break;
-                    if (!allow_paired[offset[i+k-1]+j-k+2]) { allowed = false; break; }
-                    RealT value = Fast_Exp(outside + ScoreHelix(i-1,j+1,k) + FNi[offset[i+k-1]+j-k+1]);
-                    for (int p = 1; p < k; p++)
-                        posterior[offset[i+p]+j-p+1] += value;
+                    partial[offset[p+1]+q] += Fast_Exp(outside + ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) + FCi[checkpoint_offset[p+1]+q-1]);
                 }
-
-                // compute FE(i+D-1,j-D+1) + ScoreHelix(i-1,j+1,D)]
-
-                if (i + 2*D_MAX_HELIX_LENGTH-2 <= j)
+                else
                 {
-                    if (allowed && allow_paired[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+2]) {
-                        RealT value = Fast_Exp(outside + ScoreHelix(i-1,j+1,D_MAX_HELIX_LENGTH) + FEi[offset[i+D_MAX_HELIX_LENGTH-1]+j-D_MAX_HELIX_LENGTH+1]);
-
-                        for (int k = 1; k < D_MAX_HELIX_LENGTH; k++)
-                            posterior[offset[i+k]+j-k+1] += value;
-                    }
+                    partial[offset[p+1]+q] += Fast_Exp(outside + ScoreSingle(i,j,p,q) + FCi[checkpoint_offset[p+1]+q-1]);
                 }
             }
+        }
 
-#else
+        // compute SUM (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c) -- do nothing
 
-            // FC[i,j] = optimal energy for substructure between positions
-            //           i and j such that letters (i,j+1) are base-paired
-            //
-            //         = SUM [ScoreHairpin(i,j),
-            //                SUM (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1]),
-            //                ScoreJunctionA(i,j) + a + c + SUM (i<k<j : FM1[i,k] + FM[k,j])]
-            //
-            //           (assuming 0 < i <= j < L)
-            //
-            // Multi-branch loops are scored as [a + b * (# unpaired) + c * (# branches)]
+    }
 
-            if (0 < i && j < L && allow_paired[offset[i]+j+1])
-            {
+#endif
 
-                RealT outside = FCo[offset[i]+j] - Z;
+    // FM1[i,j] = optimal energy for substructure belonging to a
+    //            multibranch loop containing a (k+1,j) base pair
+    //            preceded by 5' unpaired nucleotides from i to k
+    //            for some i <= k <= j-2
+    //
+    //          = SUM [FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)  if i+2<=j,
+    //                 FM1[i+1,j] + b                                          if i+2<=j]
+    //
+    //            (assuming 0 < i < i+2 <= j < L)
 
-                // compute ScoreHairpin(i,j) -- do nothing
+    if (0 < i && i+2 <= j && j < L)
+    {
 
-                // compute SUM (i<=p<p+2<=q<=j : ScoreSingle(i,j,p,q) + FC[p+1,q-1])
+        // Compute FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)
 
-                for (int p = i; p <= std::min(i+C_MAX_SINGLE_LENGTH,j); p++)
-                {
-                    if (p > i && !allow_unpaired_position[p]) break;
-                    int q_min = std::max(p+2,p-i+j-C_MAX_SINGLE_LENGTH);
-                    for (int q = j; q >= q_min; q--)
-                    {
-                        if (q < j && !allow_unpaired_position[q+1]) break;
-                        if (!allow_paired[offset[p+1]+q]) continue;
+        if (allow_paired[offset[i+1]+j])
+            partial[offset[i+1]+j] += Fast_Exp(FM1o[window_offset[i]+j] + FCi[checkpoint_offset[i+1]+j-1] + ScoreJunctionMulti(j,i) + ScoreMultiPaired() + ScoreBasePair(i+1,j) - Z);
 
-                        if (p == i && q == j)
-                        {
-                            posterior[offset[p+1]+q] += Fast_Exp(outside + ScoreBasePair(i+1,j) + ScoreHelixStacking(i,j+1) + FCi[offset[p+1]+q-1]);
-                        }
-                        else
-                        {
-                            posterior[offset[p+1]+q] += Fast_Exp(outside + ScoreSingle(i,j,p,q) + FCi[offset[p+1]+q-1]);
-                        }
-                    }
-                }
+        // Compute FM1[i+1,j] + b -- do nothing
 
-                // compute SUM (i<k<j : FM1[i,k] + FM[k,j] + ScoreJunctionA(i,j) + a + c) -- do nothing
+    }
 
-            }
+    // FM[i,j] = optimal energy for substructure belonging to a
+    //           multibranch loop which contains at least one 
+    //           helix
+    //
+    //         = SUM [SUM (i<k<j : FM1[i,k] + FM[k,j]),
+    //                FM[i,j-1] + b,
+    //                FM1[i,j]]
+    //
+    //            (assuming 0 < i < i+2 <= j < L)
 
-#endif
+    // Compute SUM (i<k<j : FM1[i,k] + FM[k,j]) -- do nothing
 
-            // FM1[i,j] = optimal energy for substructure belonging to a
-            //            multibranch loop containing a (k+1,j) base pair
-            //            preceded by 5' unpaired nucleotides from i to k
-            //            for some i <= k <= j-2
-            //
-            //          = SUM [FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)  if i+2<=j,
-            //                 FM1[i+1,j] + b                                          if i+2<=j]
-            //
-            //            (assuming 0 < i < i+2 <= j < L)
+    // Compute FM[i,j-1] + b -- do nothing
 
-            if (0 < i && i+2 <= j && j < L)
-            {
+    // Compute FM1[i,j] -- do nothing
+}
 
-                // Compute FC[i+1,j-1] + ScoreJunctionA(j,i) + c + ScoreBP(i+1,j)
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::ComputePosteriorRows()
+//
+// Add the base-pairing probabilities contributed by the cells at the
+// rows first...last to the posteriors in the checkpointed run.  The
+// cells at row i add to those at the rows i...i+CHECKPOINT, so the
+// blocks of CHECKPOINT rows two blocks apart are taken in parallel,
+// first the even blocks and then the odd ones, and the result does
+// not depend on the order in which the threads run.
+//////////////////////////////////////////////////////////////////////
 
-                if (allow_paired[offset[i+1]+j])
-                    posterior[offset[i+1]+j] += Fast_Exp(FM1o[offset[i]+j] + FCi[offset[i+1]+j-1] + ScoreJunctionMulti(j,i) + ScoreMultiPaired() + ScoreBasePair(i+1,j) - Z);
+template<class RealT>
+void InferenceEngine<RealT>::ComputePosteriorRows(int first, int last, RealT Z)
+{
+    if (num_threads <= 1)
+    {
+        for (int i = first; i <= last; i++)
+            for (int j = i; j <= std::min(L, i+SPAN); j++)
+                ComputePosteriorCell(i, j, Z, posterior);
+        return;
+    }
 
-                // Compute FM1[i+1,j] + b -- do nothing
+    const int blocks = (last-first) / CHECKPOINT + 1;
+    for (int parity = 0; parity < 2; parity++)
+    {
+        auto worker = [&](int t) {
+            for (int b = parity + 2*t; b < blocks; b += 2*num_threads)
+                for (int i = first + b*CHECKPOINT; i <= std::min(last, first + (b+1)*CHECKPOINT - 1); i++)
+                    for (int j = i; j <= std::min(L, i+SPAN); j++)
+                        ComputePosteriorCell(i, j, Z, posterior);
+        };
+        std::vector<std::thread> workers;
+        for (int t = 1; t < num_threads; t++)
+            workers.emplace_back(worker, t);
+        worker(0);
+        for (auto &w : workers)
+            w.join();
+    }
+}
 
-            }
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::ComputePosterior()
+// 
+// Combine the results of the inside and outside algorithms
+// in order to compute posterior probabilities of base pairing.
+//////////////////////////////////////////////////////////////////////
 
-            // FM[i,j] = optimal energy for substructure belonging to a
-            //           multibranch loop which contains at least one 
-            //           helix
-            //
-            //         = SUM [SUM (i<k<j : FM1[i,k] + FM[k,j]),
-            //                FM[i,j-1] + b,
-            //                FM1[i,j]]
-            //
-            //            (assuming 0 < i < i+2 <= j < L)
+template<class RealT>
+void InferenceEngine<RealT>::ComputePosterior()
+{
+    //double starting_time = GetSystemTime();
 
-            // Compute SUM (i<k<j : FM1[i,k] + FM[k,j]) -- do nothing
+    // the partition function is taken from F5o as in the checkpointed
+    // run, where F5i[L] is not known until the end, so that both give
+    // the same posteriors
+    const RealT Z = F5o[0];
 
-            // Compute FM[i,j-1] + b -- do nothing
+    // in the checkpointed run, ComputeOutside() has already added the
+    // terms of the cells and of F5, as their values are not kept
 
-            // Compute FM1[i,j] -- do nothing
-        }
+    if (checkpoint_interval < 0 && num_threads <= 1)
+    {
+        // the rows are visited in the same order as in the checkpointed run
+        posterior.clear();
+        posterior.resize(SIZE, RealT(0));
+        for (int i = 0; i <= L; i++)
+            for (int j = i; j <= std::min(L, i+SPAN); j++)
+                ComputePosteriorCell(i, j, Z, posterior);
+    }
+    else if (checkpoint_interval < 0)
+    {
+        posterior.clear();
+        posterior.resize(SIZE, RealT(0));
+
+        // each thread accumulates into its own buffer, and the buffers
+        // are summed in a fixed order so that the result is reproducible
+        std::vector<std::vector<RealT>> partial(num_threads-1, std::vector<RealT>(SIZE, RealT(0)));
+        auto worker = [&](int t) {
+            std::vector<RealT> &buffer = t == 0 ? posterior : partial[t-1];
+            for (int i = L-t; i >= 0; i -= num_threads)
+                for (int j = i; j <= std::min(L, i+SPAN); j++)
+                    ComputePosteriorCell(i, j, Z, buffer);
+        };
+        std::vector<std::thread> workers;
+        for (int t = 1; t < num_threads; t++)
+            workers.emplace_back(worker, t);
+        worker(0);
+        for (auto &w : workers)
+            w.join();
+
+        for (int t = 1; t < num_threads; t++)
+            for (int k = 0; k < SIZE; k++)
+                posterior[k] += partial[t-1][k];
     }
 
-    for (int j = 1; j <= L; j++)
+    for (int j = 1; j <= L && checkpoint_interval < 0; j++)
     {
 
         // F5[j] = optimal energy for substructure between positions 0 and j
@@ -3801,7 +4596,7 @@ void InferenceEngine<RealT>::ComputePosterior()
 
         // compute SUM (0<=k<j : F5[k] + FC[k+1,j-1] + ScoreExternalPaired() + ScoreBP(k+1,j) + ScoreJunctionA(j,k))
 
-        for (int k = 0; k < j; k++)
+        for (int k = std::max(0, j-SPAN-2); k < j; k++)
         {
             if (allow_paired[offset[k+1]+j])
                 posterior[offset[k+1]+j] += Fast_Exp(outside + F5i[k] + FCi[offset[k+1]+j-1] + ScoreExternalPaired() + ScoreBasePair(k+1,j) + ScoreJunctionExternal(j,k));
@@ -3810,11 +4605,24 @@ void InferenceEngine<RealT>::ComputePosterior()
 
     for (int i = 1; i <= L; i++)
     {
-        for (int j = i+1; j <= L; j++)
+        for (int j = i+1; j <= std::min(L, i+BAND); j++)
         {
             posterior[offset[i]+j] = Clip(posterior[offset[i]+j], RealT(0), RealT(1));
         }
     }
+
+    // the checkpointed run is only for the posteriors, so the matrices
+    // are released before the decoding
+    if (checkpoint_interval >= 0)
+    {
+        FCi.clear(); FCi.shrink_to_fit();
+        FMi.clear(); FMi.shrink_to_fit();
+        FM1i.clear(); FM1i.shrink_to_fit();
+#if COLUMN_MAJOR_FM2
+        FMi_col.clear(); FMi_col.shrink_to_fit();
+#endif
+        FM2o.clear(); FM2o.shrink_to_fit();
+    }
 }
 
 //////////////////////////////////////////////////////////////////////
@@ -3835,6 +4643,9 @@ std::vector<int> InferenceEngine<RealT>::PredictPairingsPosterior(const float ga
     RealT* unpaired_posterior  = new RealT[L+1];
     RealT* score               = new RealT[SIZE];
     int* traceback             = new int[SIZE];
+#if COLUMN_MAJOR_FM2
+    RealT* score_col           = new RealT[SIZE];
+#endif
 
     // compute the scores for unpaired nucleotides
     if (!GCE)
@@ -3842,8 +4653,8 @@ std::vector<int> InferenceEngine<RealT>::PredictPairingsPosterior(const float ga
         for (int i = 1; i <= L; i++)
         {
             unpaired_posterior[i] = RealT(1);
-            for (int j = 1; j < i; j++) unpaired_posterior[i] -= posterior[offset[j]+i];
-            for (int j = i+1; j <= L; j++) unpaired_posterior[i] -= posterior[offset[i]+j];
+            for (int j = std::max(1, i-BAND); j < i; j++) unpaired_posterior[i] -= posterior[offset[j]+i];
+            for (int j = i+1; j <= std::min(L, i+BAND); j++) unpaired_posterior[i] -= posterior[offset[i]+j];
         }
 
         for (int i = 1; i <= L; i++) unpaired_posterior[i] /= 2 * gamma;
@@ -3852,13 +4663,16 @@ std::vector<int> InferenceEngine<RealT>::PredictPairingsPosterior(const float ga
     // initialize matrices
 
     std::fill(score, score+SIZE, RealT(-1.0));
+#if COLUMN_MAJOR_FM2
+    std::fill(score_col, score_col+SIZE, RealT(-1.0));
+#endif
     std::fill(traceback, traceback+SIZE, -1);
 
     // dynamic programming
 
     for (int i = L; i >= 0; i--)
     {
-        for (int j = i; j <= L; j++)
+        for (int j = i; j <= std::min(L, i+BAND); j++)
         {
             RealT &this_score = score[offset[i]+j];
             int &this_traceback = traceback[offset[i]+j];
@@ -3901,6 +4715,10 @@ std::vector<int> InferenceEngine<RealT>::PredictPairingsPosterior(const float ga
                     for (int k = i+1; k < j; k++)
                         UPDATE_MAX(this_score, this_traceback, score[offset[i]+k] + score[offset[k]+j], k+4);	
 
+#elif COLUMN_MAJOR_FM2
+
+                    Fast_MaxPlus(&(score[offset[i]+i+1]), &(score_col[column_offset[j]+i+1]), j-i-1, i+1+4, this_score, this_traceback);
+
 #else
 
                     RealT *p1 = &(score[offset[i]+i+1]);
@@ -3909,13 +4727,40 @@ std::vector<int> InferenceEngine<RealT>::PredictPairingsPosterior(const float ga
                     {
                         UPDATE_MAX(this_score, this_traceback, (*p1) + (*p2), k+4);
                         ++p1;
-                        p2 += L-k;
+                        p2 += offset[k+1]-offset[k];
                     }
 
 #endif
                 }
             }
+#if COLUMN_MAJOR_FM2
+            score_col[column_offset[j]+i] = this_score;
+#endif
+        }
+    }
+
+    // the cells (0,j) beyond the band are replaced by the scores of the
+    // prefixes, which split off their last segment (k,j) within the band
+
+    std::vector<RealT> prefix_score(L+1, RealT(-1.0));
+    std::vector<int> prefix_traceback(L+1, -1);
+
+    for (int j = 0; j <= L; j++)
+    {
+        RealT &this_score = prefix_score[j];
+        int &this_traceback = prefix_traceback[j];
+
+        if (j <= BAND)
+        {
+            this_score = score[offset[0]+j];
+            this_traceback = traceback[offset[0]+j];
+            continue;
         }
+
+        if (allow_unpaired_position[j])
+            UPDATE_MAX(this_score, this_traceback, (GCE ? RealT(0) : unpaired_posterior[j]) + prefix_score[j-1], 2);
+        for (int k = j-BAND; k < j; k++)
+            UPDATE_MAX(this_score, this_traceback, prefix_score[k] + score[offset[k]+j], k+4);
     }
 
 #if SHOW_TIMINGS
@@ -3936,8 +4781,9 @@ std::vector<int> InferenceEngine<RealT>::PredictPairingsPosterior(const float ga
         traceback_queue.pop();
         const int i = t.first;
         const int j = t.second;
+        const int this_traceback = i == 0 ? prefix_traceback[j] : traceback[offset[i]+j];
 
-        switch (traceback[offset[i]+j])
+        switch (this_traceback)
         {
             case -1:
                 Assert(false, "Should not get here.");
@@ -3957,7 +4803,7 @@ std::vector<int> InferenceEngine<RealT>::PredictPairingsPosterior(const float ga
                 break;
             default:
             {
-                const int k = traceback[offset[i]+j] - 4;
+                const int k = this_traceback - 4;
                 traceback_queue.push(std::make_pair(i,k));
                 traceback_queue.push(std::make_pair(k,j));
             }
@@ -3965,6 +4811,13 @@ std::vector<int> InferenceEngine<RealT>::PredictPairingsPosterior(const float ga
         }
     }
 
+    delete [] unpaired_posterior;
+    delete [] score;
+    delete [] traceback;
+#if COLUMN_MAJOR_FM2
+    delete [] score_col;
+#endif
+
     return solution;
 }
 
@@ -3983,6 +4836,227 @@ RealT *InferenceEngine<RealT>::GetPosterior(const RealT posterior_cutoff) const
     return ret;
 }
 
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::GetPosterior()
+//
+// Return the posterior probability of the pair (i,j), 1 <= i < j <= L,
+// which is zero for the pairs beyond the band.
+//////////////////////////////////////////////////////////////////////
+
+template<class RealT>
+RealT InferenceEngine<RealT>::GetPosterior(int i, int j) const
+{
+    return j - i <= BAND ? posterior[offset[i]+j] : RealT(0);
+}
+
+//////////////////////////////////////////////////////////////////////
+// InferenceEngine::EvaluateStructure()
+//
+// Return the score of the structure of sstruct, i.e. the Viterbi
+// score under the constraints which fix that structure, by visiting
+// each of its loops once instead of running the dynamic programming.
+// The loops are decomposed as the Viterbi traceback does, and the
+// score is the Turner energy plus the dot product of the feature
+// counts with the parameters.  The counts are added to cnt if given.
+//
+// Only the arrays of length L are used, so LoadSequence() need not
+// be called.  Positions whose pairing is not given are unpaired, and
+// so are those of the pairs that UseConstraints() leaves unpaired,
+// i.e. too close or non-complementary ones.
+// NEG_INF is returned if the grammar cannot parse the structure,
+// e.g. for pseudoknots, too short hairpins or too long single-branch
+// loops.  Neither the loss nor the constraints are scored.
+//////////////////////////////////////////////////////////////////////
+
+template<class RealT>
+RealT InferenceEngine<RealT>::EvaluateStructure(const SStruct &sstruct, FeatureCounts<RealT>* cnt /* = nullptr */)
+{
+    cache_initialized = false;
+    EncodeSequence(sstruct);
+    std::vector<int> mapping(sstruct.GetMapping());
+
+    // check the base pairs
+    for (int i = 1; i <= L; i++)
+    {
+        const int j = mapping[i];
+        if (j <= i) continue;
+        if (j > L || mapping[j] != i) return RealT(NEG_INF);
+        if (j-i <= C_MIN_HAIRPIN_LENGTH || (!allow_noncomplementary && !IsComplementary(i,j)))
+            mapping[i] = mapping[j] = SStruct::UNPAIRED;
+    }
+    std::vector<int> stack;
+    for (int i = 1; i <= L; i++)
+    {
+        const int j = mapping[i];
+        if (j <= 0) continue;
+        if (j > i)
+        {
+            if (C_MAX_SPAN >= 0 && j-i > C_MAX_SPAN) return RealT(NEG_INF);
+            stack.push_back(j);
+        }
+        else
+        {
+            if (stack.empty() || stack.back() != i) return RealT(NEG_INF);
+            stack.pop_back();
+        }
+    }
+
+    eval_counts_.clear();
+    counts_ = &eval_counts_;
+    ClearLengthCounts();
+    double energy = 0.0;
+#ifdef HAVE_VIENNA20
+    const short *S = turner_params_ ? &turner_S_[0] : nullptr;
+#endif
+
+    // external loop; F5[j] = F5[j-1] + ScoreExternalUnpaired(j) or
+    // F5[k] + FC[k+1,j-1] + ScoreExternalPaired() + ScoreBP(k+1,j) + ScoreJunctionA(j,k)
+
+    std::vector<int> helices;
+    for (int k = 1; k <= L; k++)
+    {
+        const int l = mapping[k];
+        if (l > k)
+        {
+            CountExternalPaired(1);
+            CountBasePair(k,l,1);
+            CountJunctionExternal(l,k-1,1);
+#ifdef HAVE_VIENNA20
+            if (S)
+                energy += VIENNA::E_ExtLoop(md_.pair[S[l]][S[k]], S[l+1], S[k-1], turner_params_.get()) / -100.;
+#endif
+            helices.push_back(k);
+            k = l;
+        }
+        else
+            CountExternalUnpaired(k,1);
+    }
+
+    // the helix whose outermost pair is (i,j) and the loop it closes;
+    // the outermost pair itself is counted by the enclosing loop
+
+    std::vector<int> branches;
+    while (!helices.empty())
+    {
+        int i = helices.back();
+        int j = mapping[i];
+        helices.pop_back();
+
+        // stacking pairs, FE[i,j-1] = ScoreBP(i+1,j-1) + ScoreHelixStacking(i,j) + FE[i+1,j-2]
+        int n = 1;
+        while (mapping[i+1] == j-1)
+        {
+            CountBasePair(i+1,j-1,1);
+            CountHelixStacking(i,j,1);
+#ifdef HAVE_VIENNA20
+            if (S)
+                energy += EnergySingle(0, 0, md_.pair[S[i]][S[j]], md_.pair[S[j-1]][S[i+1]], S[i+1], S[j-1], S[i], S[j]) / -100.;
+#endif
+            ++i; --j; ++n;
+        }
+#if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
+        if (n == 1)
+            CountIsolated(1);
+#if PARAMS_HELIX_LENGTH
+        else
+            cache_score_helix_length[std::min(n, D_MAX_HELIX_LENGTH)].second += 1;
+#endif
+#endif
+
+        // the loop closed by (i,j), which is FN[i,j-1] (or FC[i,j-1])
+        branches.clear();
+        for (int k = i+1; k < j; k++)
+        {
+            if (mapping[k] > k)
+            {
+                branches.push_back(k);
+                k = mapping[k];
+            }
+        }
+
+        if (branches.empty())
+        {
+            // hairpin loop
+            if (j-1-i < C_MIN_HAIRPIN_LENGTH) return RealT(NEG_INF);
+            CountHairpin(i,j-1,1);
+#ifdef HAVE_VIENNA20
+            if (S)
+                energy += VIENNA::E_Hairpin(j-1-i, md_.pair[S[i]][S[j]], S[i+1], S[j-1], &turner_sequence_[i-1], turner_params_.get()) / -100.;
+#endif
+        }
+        else if (branches.size() == 1)
+        {
+            // single-branch loop, ScoreSingle(i,j-1,p,q) with p = k-1 and q = l
+            const int k = branches[0];
+            const int l = mapping[k];
+            const int l1 = k-1-i;
+            const int l2 = j-1-l;
+            if (l1+l2 > C_MAX_SINGLE_LENGTH) return RealT(NEG_INF);
+            CountSingleLength(l1,l2,1);
+            CountBasePair(k,l,1);
+            CountJunctionB(i,j-1,1);
+            CountJunctionB(l,k-1,1);
+            CountSingleNucleotides(i,j-1,k-1,l,1);
+#ifdef HAVE_VIENNA20
+            if (S)
+                energy += EnergySingle(l1, l2, md_.pair[S[i]][S[j]], md_.pair[S[l]][S[k]], S[i+1], S[j-1], S[k-1], S[l+1]) / -100.;
+#endif
+            helices.push_back(k);
+        }
+        else
+        {
+            // multi-branch loop, where each branch (k,l) is FM1[k-1,l]
+            CountJunctionMulti(i,j-1,1);
+            CountMultiPaired(1);
+            CountMultiBase(1);
+#ifdef HAVE_VIENNA20
+            if (S)
+                energy += (turner_params_->MLclosing + VIENNA::E_MLstem(md_.pair[S[i]][S[j]], S[i+1], S[j-1], turner_params_.get())) / -100.;
+#endif
+            int u = i+1;
+            for (auto k : branches)
+            {
+                const int l = mapping[k];
+                for (; u < k; u++)
+                {
+                    CountMultiUnpaired(u,1);
+#ifdef HAVE_VIENNA20
+                    if (S)
+                        energy += turner_params_->MLbase / -100.;
+#endif
+                }
+                CountJunctionMulti(l,k-1,1);
+                CountMultiPaired(1);
+                CountBasePair(k,l,1);
+#ifdef HAVE_VIENNA20
+                if (S)
+                    energy += VIENNA::E_MLstem(md_.pair[S[l]][S[k]], S[l+1], S[k-1], turner_params_.get()) / -100.;
+#endif
+                helices.push_back(k);
+                u = l+1;
+            }
+            for (; u < j; u++)
+            {
+                CountMultiUnpaired(u,1);
+#ifdef HAVE_VIENNA20
+                if (S)
+                    energy += turner_params_->MLbase / -100.;
+#endif
+            }
+        }
+    }
+    FinalizeLengthCounts();
+
+    double score = energy;
+    for (auto k : eval_counts_)
+        score += eval_counts_[k] * find_param(params_, k);
+    if (cnt)
+        for (auto k : eval_counts_)
+            (*cnt)[k] += eval_counts_[k];
+
+    return RealT(score);
+}
+
 template 
 class InferenceEngine<param_value_type>;
 
@@ -15,6 +15,8 @@
 #include "Config.hpp"
 #include "SStruct.hpp"
 #include "FeatureMap.hpp"
+#include "FeatureCounts.hpp"
+#include "ParameterView.hpp"
 #include "Utilities.hpp"
 #include "LogSpace.hpp"
 #include <iostream>
@@ -43,33 +45,67 @@ private:
     const int C_MIN_HAIRPIN_LENGTH;
     const int C_MAX_HAIRPIN_NUCLEOTIDES_LENGTH;
     const int C_MAX_SPAN;
+    int num_threads;
+    int checkpoint_interval;                         // see UseCheckpoints()
     bool cache_initialized;
     FeatureMap* fm_;
-    const std::vector<RealT>* params_;
+    ParameterView<RealT> params_;
 #ifdef PARAMS_VIENNA_COMPAT
     const std::vector<RealT>* params_base_; // vienna params
 #endif
     //std::vector<RealT>* counts_;
-    std::unordered_map<size_t,RealT>* counts_;
+    FeatureCounts<RealT>* counts_;
+    FeatureCounts<RealT> eval_counts_;               // counts of the structure given to EvaluateStructure()
 
-    // dimensions
-    int L, SIZE;
+    // dimensions; the cells (i,j) with j-i <= SPAN are filled, and the
+    // matrices store those with j-i <= BAND
+    int L, SIZE, SPAN, BAND;
+
+    // in the checkpointed inside/outside run, FCi, FMi, FEi and FNi keep
+    // their rows only at the checkpoints of CHECKPOINT rows, INTERVAL
+    // rows apart, and at the rows being recomputed, and the outside
+    // matrices but FM2o keep only the last WINDOW rows (INTERVAL+WINDOW
+    // rows with several threads); see ComputeInside() and ComputeOutside()
+    int INTERVAL, CHECKPOINT, WINDOW;
 
     // sequence data
     std::vector<NUCL> s;
     std::vector<int> offset;
+    std::vector<int> column_offset;
+    std::vector<int> junction_code;                  // (s[i],s[i+1]) numbered, see EncodeSequence()
+    std::vector<int> junction_position;              // a position of each code
+    std::vector<int> checkpoint_offset;              // FCi, FMi, FEi and FNi
+    std::vector<int> window_offset;                  // FCo, FMo, FM1o, FEo and FNo
     std::vector<int> allow_unpaired_position;
-    std::vector<int> allow_unpaired, allow_paired;
+    std::vector<int> unpaired_end;                   // s[i+1...j] may be unpaired iff j <= unpaired_end[i]
+    std::vector<bool> allow_paired;
     std::vector<RealT> loss_unpaired_position;
-    std::vector<RealT> loss_unpaired, loss_paired;
+    std::vector<RealT> loss_unpaired;                // allocated by UseLoss() only
     RealT loss_const;
     std::vector<float> reactivity_unpaired_position;
-    std::vector<float> reactivity_unpaired, reactivity_paired;
+
+    // the loss and the soft constraints of base pairs, which are
+    // computed from the per-position data by ScoreBasePairUncached()
+    enum LOSS_TYPE { NO_LOSS, LOSS_CONTRAFOLD, LOSS_BASE_PAIR, LOSS_POSITION, LOSS_REACTIVITY };
+    LOSS_TYPE loss_type;
+    std::vector<int> loss_mapping;
+    std::vector<float> loss_reactivity;
+    RealT loss_pos_w, loss_neg_w;
+    std::vector<float> reactivity_paired_position;   // allocated by UseSoftConstraints() only
+    RealT reactivity_scale;
 
 #ifdef HAVE_VIENNA20
     bool with_turner_;
     VIENNA::vrna_md_t md_;
-    VIENNA::vrna_fold_compound_t *vc_;
+    std::shared_ptr<VIENNA::vrna_param_t> turner_params_; // shared by all engines, see SharedTurnerParameters()
+    std::vector<short> turner_S_;                 // ViennaRNA sequence encoding
+    std::string turner_sequence_;
+
+    // Turner parameters for single-branch loops, see LoadTurnerParameters()
+    std::vector<int> turner_stack, turner_int11, turner_int21, turner_int22;
+    std::vector<int> turner_mismatch_i, turner_mismatch_1n_i, turner_mismatch_23_i;
+    std::vector<int> turner_bulge, turner_internal, turner_ninio;
+    int turner_internal_23, turner_terminal_au;
 #endif
 
     enum TRACEBACK_TYPE {
@@ -101,8 +137,15 @@ private:
     // dynamic programming matrices
     std::vector<int> FCt, F5t, FMt, FM1t;            // traceback
     std::vector<RealT> FCv, F5v, FMv, FM1v;          // Viterbi
+#if COLUMN_MAJOR_FM2
+    std::vector<RealT> FMv_col;                      // Viterbi, column-major
+#endif
     std::vector<RealT> FCi, F5i, FMi, FM1i;          // inside
+#if COLUMN_MAJOR_FM2
+    std::vector<RealT> FMi_col;                      // inside, column-major
+#endif
     std::vector<RealT> FCo, F5o, FMo, FM1o;          // outside
+    std::vector<RealT> FM2o;
 
 #if PARAMS_HELIX_LENGTH || PARAMS_ISOLATED_BASE_PAIR
     std::vector<int> FEt, FNt;
@@ -126,11 +169,21 @@ private:
 
     // cache
     std::vector<std::vector<std::pair<RealT,RealT>>> cache_score_single;
-    std::vector<std::pair<RealT,RealT> > cache_score_helix_sums;
+    std::vector<std::pair<RealT,RealT> > cache_score_helix_sums;   // along the diagonals, see InitializeCache()
+    std::vector<RealT> cache_score_base_pair, cache_score_helix_stacking;
+    std::vector<RealT> cache_score_junction_hairpin, cache_score_junction_b;   // [junction_code x junction_code]
+    std::vector<RealT> cache_score_junction_multi, cache_score_junction_external;
+#ifdef HAVE_VIENNA20
+    std::vector<RealT> cache_energy_hairpin;
+#endif
 
-    int ComputeRowOffset(int i, int N) const;
+    void ComputeOffsets();
     bool IsComplementary(int i, int j) const;
 
+    bool AllowUnpaired(int i, int j) const;
+    RealT LossPaired(int i, int j) const;
+    RealT ReactivityPaired(int i, int j) const;
+
     RealT ScoreUnpairedPosition(int i) const;
     RealT ScoreUnpaired(int i, int j) const;
     RealT ScoreIsolated() const;
@@ -140,16 +193,22 @@ private:
     RealT ScoreExternalPaired() const;
     RealT ScoreExternalUnpaired(int i) const;
     RealT ScoreHelixStacking(int i, int j) const;
+    RealT ScoreHelixStackingUncached(int i, int j) const;
 
     RealT ScoreJunctionA(int i, int j) const;
     RealT ScoreJunctionMulti(int i, int j) const;
+    RealT ScoreJunctionMultiUncached(int i, int j) const;
     RealT ScoreJunctionExternal(int i, int j) const;
+    RealT ScoreJunctionExternalUncached(int i, int j) const;
     RealT ScoreJunctionB(int i, int j) const;
+    RealT ScoreJunctionBUncached(int i, int j) const;
     RealT ScoreJunctionHairpin(int i, int j) const;
+    RealT ScoreJunctionHairpinUncached(int i, int j) const;
     RealT ScoreJunctionInternal(int i, int j) const;
     RealT ScoreJunctionInternal1N(int i, int j) const;
     RealT ScoreJunctionInternal23(int i, int j) const;
     RealT ScoreBasePair(int i, int j) const;
+    RealT ScoreBasePairUncached(int i, int j) const;
     RealT ScoreHairpin(int i, int j) const;
     RealT ScoreHelix(int i, int j, int m) const;
     RealT ScoreSingleNucleotides(int i, int j, int p, int q) const;
@@ -178,13 +237,31 @@ private:
     void CountHelix(int i, int j, int m, RealT value);
     void CountSingleNucleotides(int i, int j, int p, int q, RealT value);
     void CountSingle(int i, int j, int p, int q, RealT value);
+    void CountSingleLength(int l1, int l2, RealT value);
 
     int EncodeTraceback(int i, int j) const;
     std::pair<int,int> DecodeTraceback(int s) const;
 
+#ifdef HAVE_VIENNA20
+    void LoadTurnerParameters();
+    int EnergySingle(int l1, int l2, int type, int type2, int si1, int sj1, int sp1, int sq1) const;
+#endif
+
+    void EncodeSequence(const SStruct &sstruct);
+
     void ClearCounts();
+    void ClearLengthCounts();
     void InitializeCache();
     void FinalizeCounts();
+    void FinalizeLengthCounts();
+
+    void ComputeViterbiCell(int i, int j, std::vector<int> &candidates);
+    void ComputeInsideCell(int i, int j);
+    void ComputeOutsideCell(int i, int j);
+    void ComputeInsideRows(int first, int last);
+    void ComputeOutsideRows(int first, int last);
+    void ComputePosteriorCell(int i, int j, RealT Z, std::vector<RealT> &partial);
+    void ComputePosteriorRows(int first, int last, RealT Z);
 
 public:
 
@@ -204,6 +281,7 @@ public:
     // load parameter values
     void LoadValues(FeatureMap* fm, const std::vector<param_value_type>* params, 
                     const std::vector<param_value_type>* params_base=nullptr);
+    void LoadValues(FeatureMap* fm, const ParameterView<param_value_type>& params);
 
     // load loss function
     void UseLoss(const std::vector<int> &true_mapping, RealT example_loss);
@@ -215,22 +293,32 @@ public:
     void UseConstraints(const std::vector<int> &true_mapping);
     void UseSoftConstraints(const std::vector<float> &reactivity_pair, RealT scale_reactivity=1.0);
 
+    // use multiple threads for the dynamic programming
+    void UseThreads(int num_threads);
+
+    // recompute the inside matrices to save memory in the posterior computation
+    void UseCheckpoints(int interval);
+
     // Viterbi inference
     void ComputeViterbi();
     RealT GetViterbiScore() const;
     std::vector<int> PredictPairingsViterbi() const;
     //std::vector<RealT> ComputeViterbiFeatureCounts();
-    std::unordered_map<size_t,RealT> ComputeViterbiFeatureCounts();
+    void ComputeViterbiFeatureCounts(FeatureCounts<RealT>& cnt);
 
     // MEA inference
     void ComputeInside();
     RealT ComputeLogPartitionCoefficient() const;
     void ComputeOutside();
     //std::vector<RealT> ComputeFeatureCountExpectations();
-    std::unordered_map<size_t,RealT> ComputeFeatureCountExpectations();
+    void ComputeFeatureCountExpectations(FeatureCounts<RealT>& cnt);
     void ComputePosterior();
     template <int GCE> std::vector<int> PredictPairingsPosterior(const float gamma) const;
     RealT *GetPosterior(const RealT posterior_cutoff) const;
+    RealT GetPosterior(int i, int j) const;
+
+    // evaluation of a given structure without the dynamic programming
+    RealT EvaluateStructure(const SStruct &sstruct, FeatureCounts<RealT>* cnt = nullptr);
 };
 
 #endif
@@ -8,6 +8,9 @@
 #define LOGSPACE_HPP
 
 #include "Utilities.hpp"
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 #define NEG_INF -2e20
 
@@ -58,6 +61,60 @@ inline float Fast_Exp(float x)
     return (x > float(46.052) ? float(1e20) : expf(x));
 }
 
+//////////////////////////////////////////////////////////////////////
+// Fast_Exp() for SIMD vectors
+//
+// Exponentiation of a vector of non-positive inputs.  The piecewise
+// polynomials above have an absolute error of up to 5e-05, which
+// adds up when many terms are summed; here x is split as n*log(2)+r
+// with |r| <= log(2)/2, and exp(r) is approximated by a polynomial
+// with a relative error of about 1e-07.  Inputs below -87 give 0.
+//////////////////////////////////////////////////////////////////////
+
+#if defined(__AVX2__)
+
+inline __m256 Fast_Exp(__m256 x)
+{
+    const __m256 underflow = _mm256_cmp_ps(x, _mm256_set1_ps(-87.0f), _CMP_LT_OQ);
+    x = _mm256_max_ps(x, _mm256_set1_ps(-87.0f));
+    const __m256i n = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504088896341f)));
+    const __m256 fn = _mm256_cvtepi32_ps(n);
+    __m256 r = _mm256_sub_ps(x, _mm256_mul_ps(fn, _mm256_set1_ps(0.693359375f)));
+    r = _mm256_sub_ps(r, _mm256_mul_ps(fn, _mm256_set1_ps(-2.12194440e-4f)));
+    __m256 y = _mm256_set1_ps(1.9875691500e-4f);
+    y = _mm256_add_ps(_mm256_mul_ps(y, r), _mm256_set1_ps(1.3981999507e-3f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, r), _mm256_set1_ps(8.3334519073e-3f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, r), _mm256_set1_ps(4.1665795894e-2f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, r), _mm256_set1_ps(1.6666665459e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(y, r), _mm256_set1_ps(5.0000001201e-1f));
+    y = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(y, r), r), _mm256_add_ps(r, _mm256_set1_ps(1.0f)));
+    y = _mm256_mul_ps(y, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23)));
+    return _mm256_andnot_ps(underflow, y);
+}
+
+#elif defined(__SSE2__)
+
+inline __m128 Fast_Exp(__m128 x)
+{
+    const __m128 underflow = _mm_cmplt_ps(x, _mm_set1_ps(-87.0f));
+    x = _mm_max_ps(x, _mm_set1_ps(-87.0f));
+    const __m128i n = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(1.44269504088896341f)));
+    const __m128 fn = _mm_cvtepi32_ps(n);
+    __m128 r = _mm_sub_ps(x, _mm_mul_ps(fn, _mm_set1_ps(0.693359375f)));
+    r = _mm_sub_ps(r, _mm_mul_ps(fn, _mm_set1_ps(-2.12194440e-4f)));
+    __m128 y = _mm_set1_ps(1.9875691500e-4f);
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(1.3981999507e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(8.3334519073e-3f));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(4.1665795894e-2f));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(1.6666665459e-1f));
+    y = _mm_add_ps(_mm_mul_ps(y, r), _mm_set1_ps(5.0000001201e-1f));
+    y = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(y, r), r), _mm_add_ps(r, _mm_set1_ps(1.0f)));
+    y = _mm_mul_ps(y, _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23)));
+    return _mm_andnot_ps(underflow, y);
+}
+
+#endif
+
 //////////////////////////////////////////////////////////////////////
 // Fast_LogExpPlusOne()
 //
@@ -277,6 +334,205 @@ inline void Fast_LogMinusEquals (float &x, float y)
         x = Fast_LogExpMinusOne(x-y) + y;
 }
 
+//////////////////////////////////////////////////////////////////////
+// Fast_MaxPlus()
+//
+// Compute max (0<=k<n : a[k]+b[k]) and replace (best,best_t) with
+// (a[k]+b[k],k+t0) for the first k attaining the maximum if it is
+// strictly larger than best.  This gives the same result as calling
+// UPDATE_MAX for k = 0, 1, ..., n-1 in order.
+//////////////////////////////////////////////////////////////////////
+
+template<class T>
+inline void Fast_MaxPlus(const T *a, const T *b, int n, int t0, T &best, int &best_t)
+{
+    for (int k = 0; k < n; k++)
+    {
+        const T v = a[k]+b[k];
+        if (v > best)
+        {
+            best = v;
+            best_t = k+t0;
+        }
+    }
+}
+
+inline void Fast_MaxPlus(const float *a, const float *b, int n, int t0, float &best, int &best_t)
+{
+    int k = 0;
+
+#if defined(__AVX2__)
+
+    if (n >= 8)
+    {
+        // each lane keeps its own maximum and the first index attaining it
+        __m256 v_best = _mm256_set1_ps(best);
+        __m256i v_t = _mm256_set1_epi32(-1);
+        __m256i v_k = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+        const __m256i v_step = _mm256_set1_epi32(8);
+        for (; k+8 <= n; k += 8)
+        {
+            __m256 v = _mm256_add_ps(_mm256_loadu_ps(a+k), _mm256_loadu_ps(b+k));
+            __m256 gt = _mm256_cmp_ps(v, v_best, _CMP_GT_OQ);
+            v_best = _mm256_blendv_ps(v_best, v, gt);
+            v_t = _mm256_blendv_epi8(v_t, v_k, _mm256_castps_si256(gt));
+            v_k = _mm256_add_epi32(v_k, v_step);
+        }
+
+        float lane_best[8];
+        int lane_t[8];
+        _mm256_storeu_ps(lane_best, v_best);
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(lane_t), v_t);
+        for (int l = 0; l < 8; l++)
+        {
+            if (lane_best[l] > best || (lane_best[l] == best && lane_t[l] >= 0 && lane_t[l]+t0 < best_t))
+            {
+                best = lane_best[l];
+                best_t = lane_t[l]+t0;
+            }
+        }
+    }
+
+#elif defined(__SSE2__)
+
+    if (n >= 4)
+    {
+        // each lane keeps its own maximum and the first index attaining it
+        __m128 v_best = _mm_set1_ps(best);
+        __m128i v_t = _mm_set1_epi32(-1);
+        __m128i v_k = _mm_setr_epi32(0, 1, 2, 3);
+        const __m128i v_step = _mm_set1_epi32(4);
+        for (; k+4 <= n; k += 4)
+        {
+            __m128 v = _mm_add_ps(_mm_loadu_ps(a+k), _mm_loadu_ps(b+k));
+            __m128 gt = _mm_cmpgt_ps(v, v_best);
+            __m128i gt_i = _mm_castps_si128(gt);
+            v_best = _mm_or_ps(_mm_and_ps(gt, v), _mm_andnot_ps(gt, v_best));
+            v_t = _mm_or_si128(_mm_and_si128(gt_i, v_k), _mm_andnot_si128(gt_i, v_t));
+            v_k = _mm_add_epi32(v_k, v_step);
+        }
+
+        float lane_best[4];
+        int lane_t[4];
+        _mm_storeu_ps(lane_best, v_best);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(lane_t), v_t);
+        for (int l = 0; l < 4; l++)
+        {
+            if (lane_best[l] > best || (lane_best[l] == best && lane_t[l] >= 0 && lane_t[l]+t0 < best_t))
+            {
+                best = lane_best[l];
+                best_t = lane_t[l]+t0;
+            }
+        }
+    }
+
+#endif
+
+    for (; k < n; k++)
+    {
+        const float v = a[k]+b[k];
+        if (v > best)
+        {
+            best = v;
+            best_t = k+t0;
+        }
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// Fast_LogSumPlus()
+//
+// Compute log SUM (0<=k<n : exp(a[k]+b[k])).  The maximum term is
+// found first, and the terms are then summed relative to it, which
+// avoids the data-dependent branches of a chain of
+// Fast_LogPlusEquals() calls and vectorizes.
+//////////////////////////////////////////////////////////////////////
+
+template<class T>
+inline T Fast_LogSumPlus(const T *a, const T *b, int n)
+{
+    T m = T(NEG_INF);
+    for (int k = 0; k < n; k++)
+        m = std::max(m, a[k]+b[k]);
+    if (m <= T(NEG_INF/2)) return T(NEG_INF);
+
+    T sum = T(0);
+    for (int k = 0; k < n; k++)
+        sum += exp(a[k]+b[k]-m);
+    return m + T(log(sum));
+}
+
+inline float Fast_LogSumPlus(const float *a, const float *b, int n)
+{
+    float m = float(NEG_INF);
+    int k = 0;
+
+#if defined(__AVX2__)
+
+    if (n >= 8)
+    {
+        __m256 v_m = _mm256_set1_ps(m);
+        for (; k+8 <= n; k += 8)
+            v_m = _mm256_max_ps(v_m, _mm256_add_ps(_mm256_loadu_ps(a+k), _mm256_loadu_ps(b+k)));
+        float lane[8];
+        _mm256_storeu_ps(lane, v_m);
+        for (int l = 0; l < 8; l++) m = std::max(m, lane[l]);
+    }
+
+#elif defined(__SSE2__)
+
+    if (n >= 4)
+    {
+        __m128 v_m = _mm_set1_ps(m);
+        for (; k+4 <= n; k += 4)
+            v_m = _mm_max_ps(v_m, _mm_add_ps(_mm_loadu_ps(a+k), _mm_loadu_ps(b+k)));
+        float lane[4];
+        _mm_storeu_ps(lane, v_m);
+        for (int l = 0; l < 4; l++) m = std::max(m, lane[l]);
+    }
+
+#endif
+
+    for (; k < n; k++)
+        m = std::max(m, a[k]+b[k]);
+    if (m <= float(NEG_INF/2)) return float(NEG_INF);
+
+    float sum = 0.0f;
+    k = 0;
+
+#if defined(__AVX2__)
+
+    if (n >= 8)
+    {
+        const __m256 v_m = _mm256_set1_ps(m);
+        __m256 v_sum = _mm256_setzero_ps();
+        for (; k+8 <= n; k += 8)
+            v_sum = _mm256_add_ps(v_sum, Fast_Exp(_mm256_sub_ps(_mm256_add_ps(_mm256_loadu_ps(a+k), _mm256_loadu_ps(b+k)), v_m)));
+        float lane[8];
+        _mm256_storeu_ps(lane, v_sum);
+        for (int l = 0; l < 8; l++) sum += lane[l];
+    }
+
+#elif defined(__SSE2__)
+
+    if (n >= 4)
+    {
+        const __m128 v_m = _mm_set1_ps(m);
+        __m128 v_sum = _mm_setzero_ps();
+        for (; k+4 <= n; k += 4)
+            v_sum = _mm_add_ps(v_sum, Fast_Exp(_mm_sub_ps(_mm_add_ps(_mm_loadu_ps(a+k), _mm_loadu_ps(b+k)), v_m)));
+        float lane[4];
+        _mm_storeu_ps(lane, v_sum);
+        for (int l = 0; l < 4; l++) sum += lane[l];
+    }
+
+#endif
+
+    for (; k < n; k++)
+        sum += expf(a[k]+b[k]-m);
+    return m + logf(sum);
+}
+
 #endif
 
 // Local Variables:
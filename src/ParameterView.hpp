@@ -0,0 +1,108 @@
+//////////////////////////////////////////////////////////////////////
+// ParameterView.hpp
+//
+// Read access to the parameter values, on which the L1 regularization
+// of AdaGradFobosUpdater may still be pending.
+//////////////////////////////////////////////////////////////////////
+
+#ifndef PARAMETERVIEW_HPP
+#define PARAMETERVIEW_HPP
+
+#include <vector>
+#include <cmath>
+#include <cstddef>
+
+// relaxed atomic access to a plain variable, which the threads of the
+// asynchronous training read and update without locks
+template<class T>
+inline T RelaxedLoad(const T& x)
+{
+    T r;
+    __atomic_load(&x, &r, __ATOMIC_RELAXED);
+    return r;
+}
+
+template<class T>
+inline void RelaxedStore(T& x, T v)
+{
+    __atomic_store(&x, &v, __ATOMIC_RELAXED);
+}
+
+// store v into x if x is still expected; otherwise, load x into expected
+template<class T>
+inline bool RelaxedCompareExchange(T& x, T& expected, T v)
+{
+    return __atomic_compare_exchange(&x, &expected, &v, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+template<class T>
+inline void RelaxedAdd(T& x, T v)
+{
+    T old = RelaxedLoad(x);
+    while (!RelaxedCompareExchange(x, old, old + v))
+        ;
+}
+
+// shrink w toward zero by c
+template<class T>
+inline T clip(T w, T c)
+{
+    if (w>=0.0)
+        return w>c ? w-c : 0.0;
+    else
+        return -clip(-w, c);
+}
+
+//////////////////////////////////////////////////////////////////////
+// class ParameterView
+//
+// The i-th parameter is read as vals[i] clipped toward zero by the
+// L1 regularization owed since it was last regularized, i.e. by
+// (sum_weight-last_sum_weight[i])*eta/sqrt(sum_squared_grad[i])*lambda,
+// which is what AdaGradFobosUpdater would apply to it right now.
+// Without the regularization state, the values are read as they are.
+// The indices out of the vectors are read as zero.
+//////////////////////////////////////////////////////////////////////
+
+template<class T>
+class ParameterView
+{
+public:
+    ParameterView(const std::vector<T>* vals = nullptr)
+        : vals_(vals), sum_squared_grad_(nullptr), last_sum_weight_(nullptr), sum_weight_(nullptr),
+          eta_(0), lambda_(0) { }
+
+    ParameterView(const std::vector<T>* vals, const std::vector<T>* sum_squared_grad,
+                  const std::vector<double>* last_sum_weight, const double* sum_weight, float eta, float lambda)
+        : vals_(vals), sum_squared_grad_(sum_squared_grad), last_sum_weight_(last_sum_weight),
+          sum_weight_(sum_weight), eta_(eta), lambda_(lambda) { }
+
+    size_t size() const { return vals_->size(); }
+
+    T operator[](size_t i) const
+    {
+        if (i >= vals_->size()) return T(0);
+        const T w = RelaxedLoad((*vals_)[i]);
+        if (!sum_weight_ || i >= last_sum_weight_->size()) return w;
+        const auto weight = RelaxedLoad(*sum_weight_) - RelaxedLoad((*last_sum_weight_)[i]);
+        const T g = RelaxedLoad((*sum_squared_grad_)[i]);
+        if (weight>0.0 && g>0.0)
+            return clip(w, static_cast<T>(weight * eta_ / std::sqrt(g) * lambda_));
+        return w;
+    }
+
+private:
+    const std::vector<T>* vals_;
+    const std::vector<T>* sum_squared_grad_;
+    const std::vector<double>* last_sum_weight_;
+    const double* sum_weight_;
+    float eta_;
+    float lambda_;
+};
+
+#endif
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// End:
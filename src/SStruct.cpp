@@ -5,6 +5,11 @@
 #ifdef HAVE_CONFIG_H
 #include "../config.h"
 #endif
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits>
 #include "SStruct.hpp"
 
 enum FileFormat
@@ -194,6 +199,45 @@ void SStruct::LoadFASTA(const std::string &filename)
     reactivity_pair.resize(sequences[0].length(), 0);
 }
 
+//////////////////////////////////////////////////////////////////////
+// SStruct::LoadRecord()
+//
+// Create object from a single sequence record.  Optionally, a
+// parenthesized base-pairing structure may be provided.
+//////////////////////////////////////////////////////////////////////
+
+void SStruct::LoadRecord(const std::string &name, const std::string &sequence, const std::string &parens)
+{
+    // clear any previous data
+    std::vector<std::string>().swap(names);
+    std::vector<std::string>().swap(sequences);
+    std::vector<int>().swap(mapping);
+    std::vector<float>().swap(reactivity_unpair);
+    std::vector<float>().swap(reactivity_pair);
+    type = NO_REACTIVITY;
+
+    names.push_back(name);
+    sequences.push_back(FilterSequence("@" + sequence));
+
+    // sanity-checks
+    if (sequences[0].length() == 1) Error("Zero-length sequence read: %s", name.c_str());
+
+    if (parens.length() == 0)
+        mapping = std::vector<int>(sequences[0].length(), UNKNOWN);
+    else
+    {
+        if (parens.length() != sequence.length())
+            Error("Not all sequences have the same length: %s", name.c_str());
+        mapping = ConvertParensToMapping(FilterParens("@" + parens));
+    }
+
+    reactivity_unpair.resize(sequences[0].length(), 0);
+    reactivity_pair.resize(sequences[0].length(), 0);
+
+    // error-checking
+    ValidateMapping(mapping);
+}
+
 //////////////////////////////////////////////////////////////////////
 // SStruct::LoadRAW()
 //
@@ -519,6 +563,18 @@ std::string SStruct::ConvertMappingToParens(const std::vector<int> &mapping) con
     return parens;
 }
 
+//////////////////////////////////////////////////////////////////////
+// SStruct::GetParens()
+//
+// Return the structure in parenthesized format.
+//////////////////////////////////////////////////////////////////////
+
+std::string SStruct::GetParens() const
+{
+    if (ContainsPseudoknots()) Error("Cannot write structure containing pseudoknots using parenthesized format.");
+    return ConvertMappingToParens(mapping).substr(1);
+}
+
 //////////////////////////////////////////////////////////////////////
 // SStruct::ValidateMapping()
 //
@@ -733,6 +789,420 @@ void SStruct::DiscretizeReactivity(double threshold_unpaired, double threshold_p
     }
 }
 
+//////////////////////////////////////////////////////////////////////
+// SStruct::SaveBinary()
+// SStruct::LoadBinary()
+//
+// Write and read the structure with the reactivity and the type in
+// binary, which is the record of SStructPack.
+//////////////////////////////////////////////////////////////////////
+
+void SStruct::SaveBinary(std::ostream &outfile) const
+{
+    WriteBinary(outfile, type);
+    WriteBinary(outfile, static_cast<unsigned long long>(names.size()));
+    for (size_t k = 0; k < names.size(); k++)
+    {
+        WriteBinary(outfile, names[k]);
+        WriteBinary(outfile, sequences[k]);
+    }
+    WriteBinary(outfile, mapping);
+    WriteBinary(outfile, reactivity_unpair);
+    WriteBinary(outfile, reactivity_pair);
+}
+
+void SStruct::LoadBinary(std::istream &infile)
+{
+    unsigned long long n;
+    ReadBinary(infile, type);
+    ReadBinary(infile, n);
+    names.resize(n);
+    sequences.resize(n);
+    for (size_t k = 0; k < n; k++)
+    {
+        ReadBinary(infile, names[k]);
+        ReadBinary(infile, sequences[k]);
+    }
+    ReadBinary(infile, mapping);
+    ReadBinary(infile, reactivity_unpair);
+    ReadBinary(infile, reactivity_pair);
+}
+
+//////////////////////////////////////////////////////////////////////
+// SStructReader::SStructReader()
+//
+// Open file for reading.  The file format is detected from the
+// first non-blank character.
+//////////////////////////////////////////////////////////////////////
+
+SStructReader::SStructReader(const std::string &filename, int type) :
+    filename(filename),
+    type(type),
+    data(&file),
+    is_fasta(true),
+    done(false),
+    has_pending(false)
+{
+    if (filename == "-")
+        data = &std::cin;
+    else
+    {
+        file.open(filename.c_str());
+        if (file.fail()) Error("Unable to open input file: %s", filename.c_str());
+    }
+
+    while (isspace(data->peek())) data->get();
+
+    if (data->peek() != '>' && data->peek() != EOF)
+    {
+        if (filename == "-") Error("Expected FASTA format on standard input.");
+        is_fasta = false;
+        file.close();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// SStructReader::ReadRecord()
+//
+// Read the header and the sequence lines of the next FASTA record.
+//////////////////////////////////////////////////////////////////////
+
+bool SStructReader::ReadRecord(std::string &name, std::string &sequence)
+{
+    std::string s;
+    while (data->peek() != EOF && data->peek() != '>')
+    {
+        std::getline(*data, s);
+        if (Trim(s).length() != 0) Error("Expected header for FASTA file: %s", filename.c_str());
+    }
+    if (!std::getline(*data, s)) return false;
+
+    name = Trim(s).substr(1);
+    sequence.clear();
+    while (data->peek() != EOF && data->peek() != '>')
+    {
+        std::getline(*data, s);
+        for (size_t i = 0; i < s.length(); i++)
+        {
+            if (isspace(s[i])) continue;
+            sequence += s[i];
+        }
+    }
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// SStructReader::ReadSequenceRecord()
+// SStructReader::ReadStructureRecord()
+//
+// Read the next record, which may have been read ahead.  A record
+// without alphabetic characters is the structure of the preceding
+// sequence, or of the following one if it comes first, as
+// SStruct::LoadFASTA() takes it in either order.
+// ReadSequenceRecord() returns such a leading structure in parens,
+// which is cleared otherwise.  ReadStructureRecord() takes a structure
+// of the given length only, and keeps any other record for the next
+// ReadSequenceRecord(), so that a structure between two sequences
+// belongs to the preceding one if it has the length of that one.
+//////////////////////////////////////////////////////////////////////
+
+static bool IsStructureRecord(const std::string &sequence)
+{
+    for (size_t i = 0; i < sequence.length(); i++)
+        if (isalpha(sequence[i])) return false;
+    return true;
+}
+
+bool SStructReader::ReadSequenceRecord(std::string &name, std::string &sequence, std::string &parens)
+{
+    parens.clear();
+    if (has_pending)
+    {
+        std::swap(name, pending_name);
+        std::swap(sequence, pending_sequence);
+        has_pending = false;
+    }
+    else if (!ReadRecord(name, sequence))
+        return false;
+
+    if (!sequence.empty() && IsStructureRecord(sequence))
+    {
+        std::swap(parens, sequence);
+        if (!ReadRecord(name, sequence) || IsStructureRecord(sequence))
+            Error("Expected a sequence record after the structure record: %s", filename.c_str());
+    }
+    return true;
+}
+
+bool SStructReader::ReadStructureRecord(std::string &parens, size_t length)
+{
+    if (has_pending || !ReadRecord(pending_name, pending_sequence)) return false;
+
+    if (!IsStructureRecord(pending_sequence) || pending_sequence.length() != length)
+    {
+        has_pending = true;
+        return false;
+    }
+    std::swap(parens, pending_sequence);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// SStructReader::Read()
+//
+// Read the next structure.  Only one record is read ahead, so memory
+// usage does not depend on the number of records in the file.
+//////////////////////////////////////////////////////////////////////
+
+bool SStructReader::Read(SStruct &sstruct)
+{
+    if (done) return false;
+    if (!is_fasta)
+    {
+        sstruct.Load(filename, type);
+        done = true;
+        return true;
+    }
+
+    std::string name, sequence, parens;
+    if (!ReadSequenceRecord(name, sequence, parens))
+    {
+        done = true;
+        return false;
+    }
+
+    if (parens.empty())
+        ReadStructureRecord(parens, sequence.length());
+
+    sstruct.LoadRecord(name, sequence, parens);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// SStructReader::ReadStructures()
+//
+// Read the next sequence, which yields an SStruct for each of the
+// structure records following it, or for the one preceding it, or a
+// single SStruct without the structure if there is none.
+//////////////////////////////////////////////////////////////////////
+
+bool SStructReader::ReadStructures(std::vector<SStruct> &sstructs)
+{
+    sstructs.clear();
+    if (done) return false;
+    if (!is_fasta)
+    {
+        sstructs.emplace_back();
+        sstructs.back().Load(filename, type);
+        done = true;
+        return true;
+    }
+
+    std::string name, sequence, parens;
+    if (!ReadSequenceRecord(name, sequence, parens))
+    {
+        done = true;
+        return false;
+    }
+
+    // a structure before the sequence is its only one
+    if (!parens.empty())
+    {
+        sstructs.emplace_back();
+        sstructs.back().LoadRecord(name, sequence, parens);
+        return true;
+    }
+    while (ReadStructureRecord(parens, sequence.length()))
+    {
+        sstructs.emplace_back();
+        sstructs.back().LoadRecord(name, sequence, parens);
+    }
+    if (sstructs.empty())
+    {
+        sstructs.emplace_back();
+        sstructs.back().LoadRecord(name, sequence);
+    }
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// SequenceStreamReader::SequenceStreamReader()
+//
+// Open file for reading, which must be in the FASTA format.
+//////////////////////////////////////////////////////////////////////
+
+SequenceStreamReader::SequenceStreamReader(const std::string &filename) :
+    filename(filename),
+    data(&file)
+{
+    if (filename == "-")
+        data = &std::cin;
+    else
+    {
+        file.open(filename.c_str());
+        if (file.fail()) Error("Unable to open input file: %s", filename.c_str());
+    }
+
+    while (isspace(data->peek())) data->get();
+    if (data->peek() != '>' && data->peek() != EOF)
+        Error("Expected FASTA format: %s", filename.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////
+// SequenceStreamReader::NextRecord()
+//
+// Skip to the header of the next record and read its name.
+//////////////////////////////////////////////////////////////////////
+
+bool SequenceStreamReader::NextRecord(std::string &name)
+{
+    std::string s;
+    while (data->peek() != EOF && data->peek() != '>')
+        data->ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+    if (!std::getline(*data, s)) return false;
+
+    name = Trim(s).substr(1);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////////
+// SequenceStreamReader::Read()
+//
+// Read the bases of the current record, skipping white space, up to
+// the header of the next record.
+//////////////////////////////////////////////////////////////////////
+
+size_t SequenceStreamReader::Read(std::string &sequence, size_t n)
+{
+    size_t k = 0;
+    while (k < n)
+    {
+        const int c = data->peek();
+        if (c == EOF || c == '>') break;
+        data->get();
+        if (isspace(c)) continue;
+        sequence += char(c);
+        k++;
+    }
+    return k;
+}
+
+//////////////////////////////////////////////////////////////////////
+// SStructPack::SStructPack()
+//
+// Map the file into memory.
+//////////////////////////////////////////////////////////////////////
+
+static const char pack_magic[8] = { 'M', 'X', 'F', 'P', 'A', 'C', 'K', '1' };
+
+SStructPack::SStructPack(const std::string &filename) :
+    filename(filename),
+    data(nullptr),
+    size(0),
+    offsets(nullptr),
+    num_structures(0)
+{
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) Error("Unable to open file: %s", filename.c_str());
+    struct stat st;
+    if (fstat(fd, &st) != 0) Error("Unable to open file: %s", filename.c_str());
+    size = st.st_size;
+    if (size > 0)
+    {
+        void *p = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) Error("Unable to map file: %s", filename.c_str());
+        data = static_cast<const char *>(p);
+    }
+    close(fd);
+
+    // the magic number is followed by the number of the offsets, which
+    // are the beginnings of the records and the end of the last one
+    const size_t header = sizeof(pack_magic) + sizeof(unsigned long long);
+    if (size < header || !std::equal(pack_magic, pack_magic + sizeof(pack_magic), data))
+        Error("Not a pack file: %s", filename.c_str());
+    unsigned long long n;
+    std::memcpy(&n, data + sizeof(pack_magic), sizeof(n));
+    if (n == 0 || size < header + n * sizeof(unsigned long long))
+        Error("Broken pack file: %s", filename.c_str());
+    offsets = reinterpret_cast<const unsigned long long *>(data + header);
+    num_structures = n - 1;
+    if (offsets[num_structures] > size)
+        Error("Broken pack file: %s", filename.c_str());
+}
+
+//////////////////////////////////////////////////////////////////////
+// SStructPack::~SStructPack()
+//
+// Unmap the file.
+//////////////////////////////////////////////////////////////////////
+
+SStructPack::~SStructPack()
+{
+    if (data) munmap(const_cast<char *>(data), size);
+}
+
+//////////////////////////////////////////////////////////////////////
+// SStructPack::Load()
+//
+// Load the i-th structure.  It may be called by several threads at
+// once.
+//////////////////////////////////////////////////////////////////////
+
+void SStructPack::Load(size_t i, SStruct &sstruct) const
+{
+    // read the record in place through a stream buffer over the mapping
+    struct RecordBuffer : public std::streambuf
+    {
+        RecordBuffer(const char *begin, const char *end)
+        {
+            char *b = const_cast<char *>(begin);
+            setg(b, b, const_cast<char *>(end));
+        }
+    };
+
+    Assert(i < num_structures, "Index out-of-bounds.");
+    if (offsets[i] > offsets[i+1]) Error("Broken pack file: %s", filename.c_str());
+    RecordBuffer buf(data + offsets[i], data + offsets[i+1]);
+    std::istream is(&buf);
+    try
+    {
+        sstruct.LoadBinary(is);
+    }
+    catch (const std::runtime_error &)
+    {
+        Error("Broken pack file: %s", filename.c_str());
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// SStructPack::Write()
+//
+// Write the structures into a file, leaving the table of the offsets
+// to be filled after the records have been written.
+//////////////////////////////////////////////////////////////////////
+
+void SStructPack::Write(const std::string &filename, const std::vector<SStruct> &sstructs)
+{
+    std::ofstream outfile(filename.c_str(), std::ios::binary);
+    if (outfile.fail()) Error("Unable to open file for writing: %s", filename.c_str());
+
+    outfile.write(pack_magic, sizeof(pack_magic));
+    std::vector<unsigned long long> offsets(sstructs.size()+1, 0);
+    const std::streampos table = outfile.tellp();
+    WriteBinary(outfile, offsets);
+    for (size_t i = 0; i < sstructs.size(); i++)
+    {
+        offsets[i] = outfile.tellp();
+        sstructs[i].SaveBinary(outfile);
+    }
+    offsets[sstructs.size()] = outfile.tellp();
+    outfile.seekp(table);
+    WriteBinary(outfile, offsets);
+    outfile.close();
+    if (outfile.fail()) Error("Unable to write file: %s", filename.c_str());
+}
+
 // Local Variables:
 // mode: C++
 // c-basic-offset: 4
@@ -69,6 +69,9 @@ public:
     void LoadRAW(const std::string &filename);
     void LoadBPSEQ(const std::string &filename, int type = NO_REACTIVITY);
 
+    // load a single record that has already been read from a stream
+    void LoadRecord(const std::string &name, const std::string &sequence, const std::string &parens = "");
+
     // assignment operator
     const SStruct& operator=(const SStruct &rhs);
 
@@ -94,6 +97,10 @@ public:
     // discretize reactivity
     void DiscretizeReactivity(double threshold_unpaired, double threshold_paired);
 
+    // write and read the binary record of SStructPack
+    void SaveBinary(std::ostream &outfile) const;
+    void LoadBinary(std::istream &infile);
+
     //////////////////////////////////////////////////////////////////////
     // Getters
     //////////////////////////////////////////////////////////////////////
@@ -101,6 +108,7 @@ public:
     const std::vector<std::string> &GetNames() const { return names; }
     const std::vector<std::string> &GetSequences() const { return sequences; }
     const std::vector<int> &GetMapping() const { return mapping; }
+    std::string GetParens() const;
     int GetLength() const { return int(mapping.size())-1; }
     int GetNumSequences() const { return int(sequences.size()); }
     //get reactivity
@@ -109,6 +117,101 @@ public:
     int GetType() const { return this->type; }
 };
 
+//////////////////////////////////////////////////////////////////////
+// class SStructReader
+//
+// Read a file one structure at a time.  A multi-record FASTA file
+// (or standard input, given as "-") yields one SStruct per record,
+// each of which may be preceded or followed by a parenthesized
+// structure record.  Any other file format yields a single SStruct.
+//////////////////////////////////////////////////////////////////////
+
+class SStructReader
+{
+    std::string filename;
+    int type;
+    std::ifstream file;
+    std::istream *data;
+    bool is_fasta;
+    bool done;
+
+    // record read ahead while looking for a structure record
+    bool has_pending;
+    std::string pending_name, pending_sequence;
+
+    bool ReadRecord(std::string &name, std::string &sequence);
+    bool ReadSequenceRecord(std::string &name, std::string &sequence, std::string &parens);
+    bool ReadStructureRecord(std::string &parens, size_t length);
+
+public:
+    SStructReader(const std::string &filename, int type = SStruct::NO_REACTIVITY);
+
+    // read the next structure; returns false at the end of the file
+    bool Read(SStruct &sstruct);
+
+    // read the next sequence with each of the structure records that
+    // follow it; returns false at the end of the file
+    bool ReadStructures(std::vector<SStruct> &sstructs);
+};
+
+//////////////////////////////////////////////////////////////////////
+// class SequenceStreamReader
+//
+// Read the sequences of a FASTA file (or standard input, given as
+// "-") in chunks, so that a sequence never has to be held in memory
+// as a whole.  NextRecord() moves to the next record, whose bases
+// are then read by Read() until it returns zero.
+//////////////////////////////////////////////////////////////////////
+
+class SequenceStreamReader
+{
+    std::string filename;
+    std::ifstream file;
+    std::istream *data;
+
+public:
+    SequenceStreamReader(const std::string &filename);
+
+    // move to the next record, skipping the rest of the current one;
+    // returns false at the end of the file
+    bool NextRecord(std::string &name);
+
+    // append up to n bases of the current record to sequence; returns
+    // the number of bases appended
+    size_t Read(std::string &sequence, size_t n);
+};
+
+//////////////////////////////////////////////////////////////////////
+// class SStructPack
+//
+// A file of structures already parsed, which is mapped into memory
+// so that each structure is loaded without parsing any text.  The
+// file consists of a magic number, the table of the offsets of the
+// records, and the records written by SStruct::SaveBinary().
+//////////////////////////////////////////////////////////////////////
+
+class SStructPack
+{
+    std::string filename;
+    const char *data;
+    size_t size;
+    const unsigned long long *offsets;
+    size_t num_structures;
+
+    SStructPack(const SStructPack &) = delete;
+    SStructPack &operator=(const SStructPack &) = delete;
+
+public:
+    SStructPack(const std::string &filename);
+    ~SStructPack();
+
+    size_t GetNumStructures() const { return num_structures; }
+    void Load(size_t i, SStruct &sstruct) const;
+
+    // write the structures into a file
+    static void Write(const std::string &filename, const std::vector<SStruct> &sstructs);
+};
+
 #endif
 
 // Local Variables:
@@ -422,6 +422,28 @@ std::string GetBaseName(const std::string &filename)
     return ((separator_pos == std::string::npos) ? filename : filename.substr(separator_pos + 1));
 }
 
+//////////////////////////////////////////////////////////////////////
+// WriteBinary()
+// ReadBinary()
+//
+// Write and read a string preceded by its length.
+//////////////////////////////////////////////////////////////////////
+
+void WriteBinary(std::ostream &out, const std::string &s)
+{
+    WriteBinary(out, static_cast<unsigned long long>(s.size()));
+    out.write(s.data(), s.size());
+}
+
+void ReadBinary(std::istream &in, std::string &s)
+{
+    unsigned long long n;
+    ReadBinary(in, n);
+    s.resize(n);
+    if (n > 0 && !in.read(&s[0], n))
+        throw std::runtime_error("Unexpected end of binary data");
+}
+
 // Local Variables:
 // mode: C++
 // c-basic-offset: 4
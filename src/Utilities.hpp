@@ -21,9 +21,13 @@
 #include <set>
 #include <sstream>
 #include <stack>
+#include <stdexcept>
 #include <string>
+#include <type_traits>
 #include <sys/time.h>
 #include <vector>
+#include <atomic>
+#include <thread>
 
 typedef unsigned char BYTE;
 typedef char NUCL;
@@ -211,6 +215,38 @@ inline bool IsComplementary(char c, char d);
 std::string GetDirName(const std::string &path);
 std::string GetBaseName(const std::string &path);
 
+// barrier for a fixed number of threads which synchronize frequently
+class SpinBarrier
+{
+    const int num_threads;
+    std::atomic<int> count;
+    std::atomic<int> generation;
+
+public:
+    SpinBarrier(int num_threads) : num_threads(num_threads), count(0), generation(0) {}
+    void Wait();
+};
+
+// call f(i,j) for all 0 <= i <= j <= L with j-i <= D in the increasing
+// (or decreasing, if reverse is set) order of j-i; the cells with the
+// same j-i are split among the threads
+template<class F>
+void ParallelWavefront(int L, int D, int num_threads, bool reverse, const F &f);
+
+// the same for the rows first <= i <= last only
+template<class F>
+void ParallelWavefront(int first, int last, int L, int D, int num_threads, bool reverse, const F &f);
+
+// write and read values in their native binary representation; a vector
+// or a string is preceded by its length.  ReadBinary() throws
+// std::runtime_error if the stream ends before the value.
+template<class T> void WriteBinary(std::ostream &out, const T &x);
+template<class T> void WriteBinary(std::ostream &out, const std::vector<T> &x);
+void WriteBinary(std::ostream &out, const std::string &s);
+template<class T> void ReadBinary(std::istream &in, T &x);
+template<class T> void ReadBinary(std::istream &in, std::vector<T> &x);
+void ReadBinary(std::istream &in, std::string &s);
+
 
 #include "Utilities.ipp"
 
@@ -598,6 +598,110 @@ inline bool IsComplementary(char c, char d)
         (c == 'U' && d == 'G');
 }
 
+
+//////////////////////////////////////////////////////////////////////
+// SpinBarrier::Wait()
+//
+// Block until all threads have reached the barrier.
+//////////////////////////////////////////////////////////////////////
+
+inline void SpinBarrier::Wait()
+{
+    const int g = generation.load(std::memory_order_acquire);
+    if (count.fetch_add(1, std::memory_order_acq_rel) + 1 == num_threads)
+    {
+        count.store(0, std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+    }
+    else
+    {
+        while (generation.load(std::memory_order_acquire) == g)
+            std::this_thread::yield();
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// ParallelWavefront()
+//
+// Process the cells (i,j) with j-i <= D of a triangular DP matrix
+// by anti-diagonals.  Each thread takes a contiguous block of every
+// anti-diagonal, so the assignment of cells to threads is
+// deterministic.
+//////////////////////////////////////////////////////////////////////
+
+template<class F>
+void ParallelWavefront(int L, int D, int num_threads, bool reverse, const F &f)
+{
+    ParallelWavefront(0, L, L, D, num_threads, reverse, f);
+}
+
+template<class F>
+void ParallelWavefront(int first, int last, int L, int D, int num_threads, bool reverse, const F &f)
+{
+    SpinBarrier barrier(num_threads);
+    auto worker = [&](int t)
+    {
+        for (int s = 0; s <= D; s++)
+        {
+            const int d = reverse ? D-s : s;
+            const int n = std::max(0, std::min(last, L-d)-first+1);
+            const int i_end = first + int((long long) n * (t+1) / num_threads);
+            for (int i = first + int((long long) n * t / num_threads); i < i_end; i++)
+                f(i, i+d);
+            barrier.Wait();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int t = 1; t < num_threads; t++)
+        threads.emplace_back(worker, t);
+    worker(0);
+    for (auto &th : threads)
+        th.join();
+}
+
+//////////////////////////////////////////////////////////////////////
+// WriteBinary()
+// ReadBinary()
+//
+// Write and read values in their native binary representation.
+//////////////////////////////////////////////////////////////////////
+
+template<class T>
+void WriteBinary(std::ostream &out, const T &x)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "WriteBinary() needs a trivially copyable type");
+    out.write(reinterpret_cast<const char *>(&x), sizeof(T));
+}
+
+template<class T>
+void WriteBinary(std::ostream &out, const std::vector<T> &x)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "WriteBinary() needs a trivially copyable type");
+    WriteBinary(out, static_cast<unsigned long long>(x.size()));
+    if (!x.empty())
+        out.write(reinterpret_cast<const char *>(&x[0]), sizeof(T) * x.size());
+}
+
+template<class T>
+void ReadBinary(std::istream &in, T &x)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "ReadBinary() needs a trivially copyable type");
+    if (!in.read(reinterpret_cast<char *>(&x), sizeof(T)))
+        throw std::runtime_error("Unexpected end of binary data");
+}
+
+template<class T>
+void ReadBinary(std::istream &in, std::vector<T> &x)
+{
+    static_assert(std::is_trivially_copyable<T>::value, "ReadBinary() needs a trivially copyable type");
+    unsigned long long n;
+    ReadBinary(in, n);
+    x.resize(n);
+    if (n > 0 && !in.read(reinterpret_cast<char *>(&x[0]), sizeof(T) * n))
+        throw std::runtime_error("Unexpected end of binary data");
+}
+
 // Local Variables:
 // mode: C++
 // c-basic-offset: 4
@@ -13,17 +13,6 @@
 #include <cassert>
 #include "adagrad.hpp"
 
-template < class T >
-inline
-T
-clip(T w, T c)
-{
-  if (w>=0.0)
-    return w>c ? w-c : 0.0;
-  else
-    return -clip(-w, c);
-}
-
 #if 0
 AdaGradRDAUpdater::
 AdaGradRDAUpdater(float eta, float lambda, float eps)
@@ -107,35 +96,82 @@ write_to_file(const std::string& filename, const ParameterHash<param_value_type>
 
 AdaGradFobosUpdater::
 AdaGradFobosUpdater(int verbose, FeatureMap& fm, std::vector<param_value_type>& params, float eta, float lambda, float eps)
-  : fm_(fm), params_(params), eta_(eta), lambda_(lambda), eps_(eps), sum_squared_grad_(), verbose_(verbose)
+  : fm_(fm), params_(params), eta_(eta), lambda_(lambda), eps_(eps), sum_squared_grad_(),
+    sum_weight_(0.0), last_sum_weight_(), verbose_(verbose)
 {
 }
 
 void
 AdaGradFobosUpdater::
-update(size_t i, param_value_type grad, float weight)
+resize()
 {
-  assert(i<fm_.size());
   params_.resize(fm_.size(), param_value_type(0));
   sum_squared_grad_.resize(fm_.size(), param_value_type(0));
-  sum_squared_grad_[i] += grad*grad;
-  if (verbose_>2)
-    std::cout << "  " << fm_.name(i) << ": w=" << params_[i] << ", g=" << grad << ", g2s=" << sum_squared_grad_[i];
-  params_[i] -= weight * eta_ / std::sqrt(sum_squared_grad_[i]) * grad;
+  last_sum_weight_.resize(fm_.size(), sum_weight_);
+}
+
+// apply the L1 regularization owed by the i-th parameter since it was
+// last regularized.  sum_squared_grad_[i] is unchanged in the meantime,
+// so clipping once by the summed threshold is the same as clipping at
+// every step.  The owed interval is claimed by advancing
+// last_sum_weight_[i] first, so that the threads regularizing the same
+// parameter at once apply each part of it only once.
+void
+AdaGradFobosUpdater::
+regularize(size_t i)
+{
+  const auto sum_weight = RelaxedLoad(sum_weight_);
+  auto last = RelaxedLoad(last_sum_weight_[i]);
+  do {
+    if (!(sum_weight>last)) return;
+  } while (!RelaxedCompareExchange(last_sum_weight_[i], last, sum_weight));
+
+  const auto weight = sum_weight - last;
+  const auto g = RelaxedLoad(sum_squared_grad_[i]);
+  if (g>0.0)
+    RelaxedStore(params_[i], clip(RelaxedLoad(params_[i]), static_cast<param_value_type>(weight * eta_ / std::sqrt(g) * lambda_)));
+}
+
+// the updates of the same parameter by several threads at once may be
+// lost in part, as in Hogwild.
+void
+AdaGradFobosUpdater::
+update(size_t i, param_value_type grad, float weight)
+{
+  assert(i<params_.size());
+  regularize(i);
+  const auto g = RelaxedLoad(sum_squared_grad_[i]) + grad*grad;
+  RelaxedStore(sum_squared_grad_[i], g);
+  const auto w = RelaxedLoad(params_[i]);
+  const auto d = weight * eta_ / std::sqrt(g) * grad;
+  RelaxedStore(params_[i], static_cast<param_value_type>(w - d));
   if (verbose_>2)
-    std::cout << ", update=" << weight * eta_ / std::sqrt(sum_squared_grad_[i]) * grad << ", w_new=" << params_[i] << std::endl;
+  {
+    std::lock_guard<std::mutex> lock(log_mtx_);
+    std::cout << "  " << fm_.name(i) << ": w=" << w << ", g=" << grad << ", g2s=" << g
+              << ", update=" << d << ", w_new=" << w - d << std::endl;
+  }
 }
 
+// the regularization is only recorded here, and applied lazily to each
+// parameter when it is updated or when flush() is called.  Until then,
+// view() reads the parameters as regularized.
 void
 AdaGradFobosUpdater::
 regularize_all(float weight)
 {
-  params_.resize(fm_.size(), param_value_type(0));
-  sum_squared_grad_.resize(fm_.size(), param_value_type(0));
+  RelaxedAdd(sum_weight_, static_cast<double>(weight));
+}
+
+// apply all the pending regularization before the parameters are
+// written out, which takes time proportional to the number of features.
+void
+AdaGradFobosUpdater::
+flush()
+{
   assert(params_.size()==sum_squared_grad_.size());
   for (size_t i=0; i!=params_.size(); ++i)
-    if (sum_squared_grad_[i]>0.0)
-      params_[i] = clip(params_[i], weight * eta_ / std::sqrt(sum_squared_grad_[i]) * lambda_);
+    regularize(i);
 }
 
 void
@@ -144,6 +180,7 @@ read_from_file(const std::string& filename)
 {
   sum_squared_grad_.clear();
   sum_squared_grad_.resize(params_.size());
+  last_sum_weight_.assign(params_.size(), sum_weight_);
   std::ifstream is(filename.c_str());
   if (!is) throw std::runtime_error(std::string(strerror(errno)) + ": " + filename);
 
@@ -174,27 +211,74 @@ read_from_file(const std::string& filename)
         sum_squared_grad_[i] = 0.0;
       }
   }
+  fm_.merge();
+  resize();
 }
 
 void
 AdaGradFobosUpdater::
-write_to_file(const std::string& filename) const
+write_to_file(const std::string& filename)
 {
-  assert(fm_.size()==params_.size());
-  assert(fm_.size()==sum_squared_grad_.size());
+  flush();
+  assert(params_.size()<=fm_.size());
+  assert(params_.size()==sum_squared_grad_.size());
 
   std::ofstream os(filename.c_str());
   if (!os) throw std::runtime_error(std::string(strerror(errno)) + ": " + filename);
 
   os << 0 << " " << eta_ << " " << lambda_ << " " << eps_ << std::endl;
 
-  std::vector<std::string> keys(params_.size());
-  std::copy(fm_.begin(), fm_.end(), keys.begin());
-  std::vector<size_t> idx(keys.size());
-  std::iota(idx.begin(), idx.end(), 0);
+  // the features never updated are omitted, most of which are
+  // registered in advance by FeatureMap.
+  std::vector<size_t> idx;
+  for (size_t i=0; i!=params_.size(); ++i)
+    if (RelaxedLoad(params_[i])!=0.0 || RelaxedLoad(sum_squared_grad_[i])!=0.0)
+      idx.push_back(i);
   std::sort(idx.begin(), idx.end(),
-            [&](size_t i, size_t j) { return keys[i] < keys[j]; });
+            [&](size_t i, size_t j) { return fm_.name(i) < fm_.name(j); });
   for (auto i: idx)
-    os << keys[i] << " " << params_[i] << " " << 0.0 << " " 
-       << sum_squared_grad_[i]  << std::endl;
+    os << fm_.name(i) << " " << RelaxedLoad(params_[i]) << " " << 0.0 << " " 
+       << RelaxedLoad(sum_squared_grad_[i])  << std::endl;
+}
+
+// all the features are written in the order of their indices, so that
+// reading them into a fresh FeatureMap gives them the same indices.
+void
+AdaGradFobosUpdater::
+write_binary(std::ostream& os)
+{
+  resize();
+  flush();
+  WriteBinary(os, eta_);
+  WriteBinary(os, lambda_);
+  WriteBinary(os, eps_);
+  WriteBinary(os, static_cast<unsigned long long>(fm_.size()));
+  for (size_t i=0; i!=fm_.size(); ++i)
+    WriteBinary(os, fm_.name(i));
+  WriteBinary(os, params_);
+  WriteBinary(os, sum_squared_grad_);
+}
+
+void
+AdaGradFobosUpdater::
+read_binary(std::istream& is)
+{
+  ReadBinary(is, eta_);
+  ReadBinary(is, lambda_);
+  ReadBinary(is, eps_);
+  unsigned long long n;
+  ReadBinary(is, n);
+  std::string fname;
+  for (size_t i=0; i!=n; ++i)
+  {
+    ReadBinary(is, fname);
+    if (fm_.insert_key(fname)!=i)
+      throw std::runtime_error("Inconsistent feature table: " + fname);
+  }
+  fm_.merge();
+  ReadBinary(is, params_);
+  ReadBinary(is, sum_squared_grad_);
+  if (params_.size()!=n || sum_squared_grad_.size()!=n)
+    throw std::runtime_error("Inconsistent feature table");
+  last_sum_weight_.assign(n, sum_weight_);
 }
@@ -3,8 +3,10 @@
 
 #include <string>
 #include <vector>
+#include <mutex>
 #include "Config.hpp"
 #include "FeatureMap.hpp"
+#include "ParameterView.hpp"
 
 #if 0
 class AdaGradRDAUpdater
@@ -37,12 +39,30 @@ class AdaGradFobosUpdater
 public:
   AdaGradFobosUpdater(int verbose, FeatureMap& fm, std::vector<param_value_type>& params, float eta, float lambda, float eps=1e-8);
 
+  // the parameters are updated in place with relaxed atomic operations,
+  // so that several threads may update them at once.  The features
+  // registered since the last resize() must not be updated.
+  void resize();
   void update(size_t i, param_value_type grad, float weight);
   void regularize_all(float weight);
   void proceed_timestamp() { }
 
+  // the parameters with the pending regularization applied on reading
+  ParameterView<param_value_type> view() const
+  {
+    return ParameterView<param_value_type>(&params_, &sum_squared_grad_, &last_sum_weight_, &sum_weight_, eta_, lambda_);
+  }
+
   void read_from_file(const std::string& filename);
-  void write_to_file(const std::string& filename) const;
+  void write_to_file(const std::string& filename);
+
+  // the feature table, the parameters and the squared gradients in binary
+  void write_binary(std::ostream& os);
+  void read_binary(std::istream& is);
+
+private:
+  void regularize(size_t i);
+  void flush();
 
 private:
   FeatureMap& fm_;
@@ -51,7 +71,10 @@ private:
   float lambda_;
   float eps_;
   std::vector<param_value_type> sum_squared_grad_;
+  double sum_weight_;                   // the sum of the weights given to regularize_all()
+  std::vector<double> last_sum_weight_; // sum_weight_ when each parameter was last regularized
   int verbose_;
+  std::mutex log_mtx_;                  // for the log of update() by several threads
 };
 
 #endif //  __INC_SGD_UPDATER_HPP__
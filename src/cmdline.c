@@ -44,6 +44,8 @@ const char *gengetopt_args_info_full_help[] = {
   "      --random-seed=INT         Specify the seed of the random number generator\n                                  (default=`-1')",
   "      --max-span=INT            The maximum distance between bases of base\n                                  pairs  (default=`-1')",
   "  -v, --verbose=INT             Verbose output  (default=`0')",
+  "      --threads=INT             The number of threads  (default=`1')",
+  "      --dp-threads=INT          The number of threads for the dynamic\n                                  programming of each sequence  (default=`1')",
   "\nPrediction mode:",
   "      --predict                 Prediction mode  (default=on)",
   "      --mea=gamma               MEA decoding with gamma  (default=`6.0')",
@@ -51,6 +53,7 @@ const char *gengetopt_args_info_full_help[] = {
   "      --bpseq                   Output predicted results as the BPSEQ format\n                                  (default=off)",
   "      --constraints             Use contraints  (default=off)",
   "      --soft-constraints        Use soft contraints  (default=off)",
+  "      --low-memory[=INT]        Compute the base-pairing probabilities with\n                                  less memory, keeping the inside matrices\n                                  every INT rows and recomputing the rest (0\n                                  for automatic)  (default=`0')",
   "\nTraining mode:",
   "      --train=output-file       Trainining mode (write the trained parameters\n                                  into output-file)",
   "  -i, --max-iter=INT            The maximum number of iterations for training\n                                  (default=`100')",
@@ -66,6 +69,8 @@ const char *gengetopt_args_info_full_help[] = {
   "      --neg-w-reactivity=FLOAT  The weight for negative base-pairs for training\n                                  from unpaired reactivity data  (default=`0')",
   "      --per-bp-loss             Ajust the loss according to the number of base\n                                  pairs  (default=off)",
   "      --lambda=FLOAT            The weight for the L1 regularization term\n                                  (default=`0.0001')",
+  "      --batch-size=INT          The number of examples in a mini-batch (the\n                                  number of threads by default)",
+  "      --async                   Update the parameters asynchronously by each\n                                  thread instead of by mini-batches  (default=off)",
   "      --scale-reactivity=FLOAT  The scale of reactivity  (default=`1.0')",
   "      --threshold-unpaired-reactivity=FLOAT\n                                The threshold of reactiviy for unpaired bases\n                                  (default=`0.0')",
   "      --threshold-paired-reactivity=FLOAT\n                                The threshold of reactiviy for paired bases\n                                  (default=`0.0')",
@@ -73,8 +78,20 @@ const char *gengetopt_args_info_full_help[] = {
   "      --max-single-nucleotides-length=INT\n                                the maximum length of single loop nucleotide\n                                  features  (default=`7')",
   "      --max-hairpin-nucleotides-length=INT\n                                the maximum length of hairpin loop nucleotide\n                                  features  (default=`7')",
   "      --out-param=dirname       Output parameter sets for each step",
+  "      --checkpoint=filename     Write a binary checkpoint into filename during\n                                  training, and resume from it if it exists",
+  "      --checkpoint-interval=INT The number of steps between checkpoints\n                                  (default=`100')",
+  "      --packed-data=filename    The training data packed in pack mode, used\n                                  instead of --structure and --reactivity",
   "\nValidation mode:",
   "      --validate                Validation mode: validate the given structure\n                                  can be parsed  (default=off)",
+  "      --eval                    Evaluation mode: score each of the given\n                                  structures of each sequence  (default=off)",
+  "\nPack mode:",
+  "      --pack=output-file        Pack mode: write the training data given by\n                                  --structure and --reactivity into output-file",
+  "\nLocal folding mode:",
+  "      --local                   Local folding mode: average the base-pairing\n                                  probabilities over sliding windows\n                                  (default=off)",
+  "      --scan                    Scan mode: write the outermost pairs of the\n                                  Viterbi structures of sliding windows with\n                                  their structures  (default=off)",
+  "      --window=INT              The number of bases of each window, of which\n                                  --max-span is the maximum span of base pairs\n                                  (default=`150')",
+  "      --window-step=INT         The number of bases by which the window slides.\n                                  The averages are over every INT-th window\n                                  only; 1 gives the RNAplfold averages over all\n                                  the windows, INT times slower  (default=`10')",
+  "      --cutoff=FLOAT            The minimum averaged base-pairing probability\n                                  to be written  (default=`0.01')",
     0
 };
 
@@ -98,19 +115,36 @@ init_help_array(void)
   gengetopt_args_info_help[14] = gengetopt_args_info_full_help[17];
   gengetopt_args_info_help[15] = gengetopt_args_info_full_help[18];
   gengetopt_args_info_help[16] = gengetopt_args_info_full_help[19];
-  gengetopt_args_info_help[17] = gengetopt_args_info_full_help[22];
-  gengetopt_args_info_help[18] = gengetopt_args_info_full_help[26];
-  gengetopt_args_info_help[19] = gengetopt_args_info_full_help[27];
-  gengetopt_args_info_help[20] = gengetopt_args_info_full_help[31];
-  gengetopt_args_info_help[21] = gengetopt_args_info_full_help[36];
-  gengetopt_args_info_help[22] = gengetopt_args_info_full_help[37];
-  gengetopt_args_info_help[23] = gengetopt_args_info_full_help[39];
-  gengetopt_args_info_help[24] = gengetopt_args_info_full_help[40];
-  gengetopt_args_info_help[25] = 0; 
+  gengetopt_args_info_help[17] = gengetopt_args_info_full_help[20];
+  gengetopt_args_info_help[18] = gengetopt_args_info_full_help[21];
+  gengetopt_args_info_help[19] = gengetopt_args_info_full_help[22];
+  gengetopt_args_info_help[20] = gengetopt_args_info_full_help[25];
+  gengetopt_args_info_help[21] = gengetopt_args_info_full_help[29];
+  gengetopt_args_info_help[22] = gengetopt_args_info_full_help[30];
+  gengetopt_args_info_help[23] = gengetopt_args_info_full_help[34];
+  gengetopt_args_info_help[24] = gengetopt_args_info_full_help[35];
+  gengetopt_args_info_help[25] = gengetopt_args_info_full_help[36];
+  gengetopt_args_info_help[26] = gengetopt_args_info_full_help[41];
+  gengetopt_args_info_help[27] = gengetopt_args_info_full_help[42];
+  gengetopt_args_info_help[28] = gengetopt_args_info_full_help[44];
+  gengetopt_args_info_help[29] = gengetopt_args_info_full_help[45];
+  gengetopt_args_info_help[30] = gengetopt_args_info_full_help[46];
+  gengetopt_args_info_help[31] = gengetopt_args_info_full_help[47];
+  gengetopt_args_info_help[32] = gengetopt_args_info_full_help[48];
+  gengetopt_args_info_help[33] = gengetopt_args_info_full_help[49];
+  gengetopt_args_info_help[34] = gengetopt_args_info_full_help[50];
+  gengetopt_args_info_help[35] = gengetopt_args_info_full_help[51];
+  gengetopt_args_info_help[36] = gengetopt_args_info_full_help[52];
+  gengetopt_args_info_help[37] = gengetopt_args_info_full_help[53];
+  gengetopt_args_info_help[38] = gengetopt_args_info_full_help[54];
+  gengetopt_args_info_help[39] = gengetopt_args_info_full_help[55];
+  gengetopt_args_info_help[40] = gengetopt_args_info_full_help[56];
+  gengetopt_args_info_help[41] = gengetopt_args_info_full_help[57];
+  gengetopt_args_info_help[42] = 0; 
   
 }
 
-const char *gengetopt_args_info_help[26];
+const char *gengetopt_args_info_help[43];
 
 typedef enum {ARG_NO
   , ARG_FLAG
@@ -147,12 +181,15 @@ void clear_given (struct gengetopt_args_info *args_info)
   args_info->random_seed_given = 0 ;
   args_info->max_span_given = 0 ;
   args_info->verbose_given = 0 ;
+  args_info->threads_given = 0 ;
+  args_info->dp_threads_given = 0 ;
   args_info->predict_given = 0 ;
   args_info->mea_given = 0 ;
   args_info->gce_given = 0 ;
   args_info->bpseq_given = 0 ;
   args_info->constraints_given = 0 ;
   args_info->soft_constraints_given = 0 ;
+  args_info->low_memory_given = 0 ;
   args_info->train_given = 0 ;
   args_info->max_iter_given = 0 ;
   args_info->burn_in_given = 0 ;
@@ -167,6 +204,8 @@ void clear_given (struct gengetopt_args_info *args_info)
   args_info->neg_w_reactivity_given = 0 ;
   args_info->per_bp_loss_given = 0 ;
   args_info->lambda_given = 0 ;
+  args_info->batch_size_given = 0 ;
+  args_info->async_given = 0 ;
   args_info->scale_reactivity_given = 0 ;
   args_info->threshold_unpaired_reactivity_given = 0 ;
   args_info->threshold_paired_reactivity_given = 0 ;
@@ -174,7 +213,17 @@ void clear_given (struct gengetopt_args_info *args_info)
   args_info->max_single_nucleotides_length_given = 0 ;
   args_info->max_hairpin_nucleotides_length_given = 0 ;
   args_info->out_param_given = 0 ;
+  args_info->checkpoint_given = 0 ;
+  args_info->checkpoint_interval_given = 0 ;
+  args_info->packed_data_given = 0 ;
   args_info->validate_given = 0 ;
+  args_info->eval_given = 0 ;
+  args_info->pack_given = 0 ;
+  args_info->local_given = 0 ;
+  args_info->scan_given = 0 ;
+  args_info->window_given = 0 ;
+  args_info->window_step_given = 0 ;
+  args_info->cutoff_given = 0 ;
 }
 
 static
@@ -192,6 +241,10 @@ void clear_args (struct gengetopt_args_info *args_info)
   args_info->max_span_orig = NULL;
   args_info->verbose_arg = 0;
   args_info->verbose_orig = NULL;
+  args_info->threads_arg = 1;
+  args_info->threads_orig = NULL;
+  args_info->dp_threads_arg = 1;
+  args_info->dp_threads_orig = NULL;
   args_info->predict_flag = 1;
   args_info->mea_arg = NULL;
   args_info->mea_orig = NULL;
@@ -200,6 +253,8 @@ void clear_args (struct gengetopt_args_info *args_info)
   args_info->bpseq_flag = 0;
   args_info->constraints_flag = 0;
   args_info->soft_constraints_flag = 0;
+  args_info->low_memory_arg = 0;
+  args_info->low_memory_orig = NULL;
   args_info->train_arg = NULL;
   args_info->train_orig = NULL;
   args_info->max_iter_arg = 100;
@@ -227,6 +282,8 @@ void clear_args (struct gengetopt_args_info *args_info)
   args_info->per_bp_loss_flag = 0;
   args_info->lambda_arg = 0.0001;
   args_info->lambda_orig = NULL;
+  args_info->batch_size_orig = NULL;
+  args_info->async_flag = 0;
   args_info->scale_reactivity_arg = 1.0;
   args_info->scale_reactivity_orig = NULL;
   args_info->threshold_unpaired_reactivity_arg = 0.0;
@@ -240,7 +297,24 @@ void clear_args (struct gengetopt_args_info *args_info)
   args_info->max_hairpin_nucleotides_length_orig = NULL;
   args_info->out_param_arg = NULL;
   args_info->out_param_orig = NULL;
+  args_info->checkpoint_arg = NULL;
+  args_info->checkpoint_orig = NULL;
+  args_info->checkpoint_interval_arg = 100;
+  args_info->checkpoint_interval_orig = NULL;
+  args_info->packed_data_arg = NULL;
+  args_info->packed_data_orig = NULL;
   args_info->validate_flag = 0;
+  args_info->eval_flag = 0;
+  args_info->pack_arg = NULL;
+  args_info->pack_orig = NULL;
+  args_info->local_flag = 0;
+  args_info->scan_flag = 0;
+  args_info->window_arg = 150;
+  args_info->window_orig = NULL;
+  args_info->window_step_arg = 10;
+  args_info->window_step_orig = NULL;
+  args_info->cutoff_arg = 0.01;
+  args_info->cutoff_orig = NULL;
   
 }
 
@@ -259,42 +333,57 @@ void init_args_info(struct gengetopt_args_info *args_info)
   args_info->random_seed_help = gengetopt_args_info_full_help[7] ;
   args_info->max_span_help = gengetopt_args_info_full_help[8] ;
   args_info->verbose_help = gengetopt_args_info_full_help[9] ;
-  args_info->predict_help = gengetopt_args_info_full_help[11] ;
-  args_info->mea_help = gengetopt_args_info_full_help[12] ;
+  args_info->threads_help = gengetopt_args_info_full_help[10] ;
+  args_info->dp_threads_help = gengetopt_args_info_full_help[11] ;
+  args_info->predict_help = gengetopt_args_info_full_help[13] ;
+  args_info->mea_help = gengetopt_args_info_full_help[14] ;
   args_info->mea_min = 0;
   args_info->mea_max = 0;
-  args_info->gce_help = gengetopt_args_info_full_help[13] ;
+  args_info->gce_help = gengetopt_args_info_full_help[15] ;
   args_info->gce_min = 0;
   args_info->gce_max = 0;
-  args_info->bpseq_help = gengetopt_args_info_full_help[14] ;
-  args_info->constraints_help = gengetopt_args_info_full_help[15] ;
-  args_info->soft_constraints_help = gengetopt_args_info_full_help[16] ;
-  args_info->train_help = gengetopt_args_info_full_help[18] ;
-  args_info->max_iter_help = gengetopt_args_info_full_help[19] ;
-  args_info->burn_in_help = gengetopt_args_info_full_help[20] ;
-  args_info->weight_weak_label_help = gengetopt_args_info_full_help[21] ;
-  args_info->structure_help = gengetopt_args_info_full_help[22] ;
+  args_info->bpseq_help = gengetopt_args_info_full_help[16] ;
+  args_info->constraints_help = gengetopt_args_info_full_help[17] ;
+  args_info->soft_constraints_help = gengetopt_args_info_full_help[18] ;
+  args_info->low_memory_help = gengetopt_args_info_full_help[19] ;
+  args_info->train_help = gengetopt_args_info_full_help[21] ;
+  args_info->max_iter_help = gengetopt_args_info_full_help[22] ;
+  args_info->burn_in_help = gengetopt_args_info_full_help[23] ;
+  args_info->weight_weak_label_help = gengetopt_args_info_full_help[24] ;
+  args_info->structure_help = gengetopt_args_info_full_help[25] ;
   args_info->structure_min = 0;
   args_info->structure_max = 0;
-  args_info->reactivity_help = gengetopt_args_info_full_help[23] ;
+  args_info->reactivity_help = gengetopt_args_info_full_help[26] ;
   args_info->reactivity_min = 0;
   args_info->reactivity_max = 0;
-  args_info->eta_help = gengetopt_args_info_full_help[24] ;
-  args_info->eta_weak_label_help = gengetopt_args_info_full_help[25] ;
-  args_info->pos_w_help = gengetopt_args_info_full_help[26] ;
-  args_info->neg_w_help = gengetopt_args_info_full_help[27] ;
-  args_info->pos_w_reactivity_help = gengetopt_args_info_full_help[28] ;
-  args_info->neg_w_reactivity_help = gengetopt_args_info_full_help[29] ;
-  args_info->per_bp_loss_help = gengetopt_args_info_full_help[30] ;
-  args_info->lambda_help = gengetopt_args_info_full_help[31] ;
-  args_info->scale_reactivity_help = gengetopt_args_info_full_help[32] ;
-  args_info->threshold_unpaired_reactivity_help = gengetopt_args_info_full_help[33] ;
-  args_info->threshold_paired_reactivity_help = gengetopt_args_info_full_help[34] ;
-  args_info->discretize_reactivity_help = gengetopt_args_info_full_help[35] ;
-  args_info->max_single_nucleotides_length_help = gengetopt_args_info_full_help[36] ;
-  args_info->max_hairpin_nucleotides_length_help = gengetopt_args_info_full_help[37] ;
-  args_info->out_param_help = gengetopt_args_info_full_help[38] ;
-  args_info->validate_help = gengetopt_args_info_full_help[40] ;
+  args_info->eta_help = gengetopt_args_info_full_help[27] ;
+  args_info->eta_weak_label_help = gengetopt_args_info_full_help[28] ;
+  args_info->pos_w_help = gengetopt_args_info_full_help[29] ;
+  args_info->neg_w_help = gengetopt_args_info_full_help[30] ;
+  args_info->pos_w_reactivity_help = gengetopt_args_info_full_help[31] ;
+  args_info->neg_w_reactivity_help = gengetopt_args_info_full_help[32] ;
+  args_info->per_bp_loss_help = gengetopt_args_info_full_help[33] ;
+  args_info->lambda_help = gengetopt_args_info_full_help[34] ;
+  args_info->batch_size_help = gengetopt_args_info_full_help[35] ;
+  args_info->async_help = gengetopt_args_info_full_help[36] ;
+  args_info->scale_reactivity_help = gengetopt_args_info_full_help[37] ;
+  args_info->threshold_unpaired_reactivity_help = gengetopt_args_info_full_help[38] ;
+  args_info->threshold_paired_reactivity_help = gengetopt_args_info_full_help[39] ;
+  args_info->discretize_reactivity_help = gengetopt_args_info_full_help[40] ;
+  args_info->max_single_nucleotides_length_help = gengetopt_args_info_full_help[41] ;
+  args_info->max_hairpin_nucleotides_length_help = gengetopt_args_info_full_help[42] ;
+  args_info->out_param_help = gengetopt_args_info_full_help[43] ;
+  args_info->checkpoint_help = gengetopt_args_info_full_help[44] ;
+  args_info->checkpoint_interval_help = gengetopt_args_info_full_help[45] ;
+  args_info->packed_data_help = gengetopt_args_info_full_help[46] ;
+  args_info->validate_help = gengetopt_args_info_full_help[48] ;
+  args_info->eval_help = gengetopt_args_info_full_help[49] ;
+  args_info->pack_help = gengetopt_args_info_full_help[51] ;
+  args_info->local_help = gengetopt_args_info_full_help[53] ;
+  args_info->scan_help = gengetopt_args_info_full_help[54] ;
+  args_info->window_help = gengetopt_args_info_full_help[55] ;
+  args_info->window_step_help = gengetopt_args_info_full_help[56] ;
+  args_info->cutoff_help = gengetopt_args_info_full_help[57] ;
   
 }
 
@@ -459,10 +548,13 @@ cmdline_parser_release (struct gengetopt_args_info *args_info)
   free_string_field (&(args_info->random_seed_orig));
   free_string_field (&(args_info->max_span_orig));
   free_string_field (&(args_info->verbose_orig));
+  free_string_field (&(args_info->threads_orig));
+  free_string_field (&(args_info->dp_threads_orig));
   free_multiple_field (args_info->mea_given, (void *)(args_info->mea_arg), &(args_info->mea_orig));
   args_info->mea_arg = 0;
   free_multiple_field (args_info->gce_given, (void *)(args_info->gce_arg), &(args_info->gce_orig));
   args_info->gce_arg = 0;
+  free_string_field (&(args_info->low_memory_orig));
   free_string_field (&(args_info->train_arg));
   free_string_field (&(args_info->train_orig));
   free_string_field (&(args_info->max_iter_orig));
@@ -477,6 +569,7 @@ cmdline_parser_release (struct gengetopt_args_info *args_info)
   free_string_field (&(args_info->pos_w_reactivity_orig));
   free_string_field (&(args_info->neg_w_reactivity_orig));
   free_string_field (&(args_info->lambda_orig));
+  free_string_field (&(args_info->batch_size_orig));
   free_string_field (&(args_info->scale_reactivity_orig));
   free_string_field (&(args_info->threshold_unpaired_reactivity_orig));
   free_string_field (&(args_info->threshold_paired_reactivity_orig));
@@ -484,6 +577,16 @@ cmdline_parser_release (struct gengetopt_args_info *args_info)
   free_string_field (&(args_info->max_hairpin_nucleotides_length_orig));
   free_string_field (&(args_info->out_param_arg));
   free_string_field (&(args_info->out_param_orig));
+  free_string_field (&(args_info->checkpoint_arg));
+  free_string_field (&(args_info->checkpoint_orig));
+  free_string_field (&(args_info->checkpoint_interval_orig));
+  free_string_field (&(args_info->packed_data_arg));
+  free_string_field (&(args_info->packed_data_orig));
+  free_string_field (&(args_info->pack_arg));
+  free_string_field (&(args_info->pack_orig));
+  free_string_field (&(args_info->window_orig));
+  free_string_field (&(args_info->window_step_orig));
+  free_string_field (&(args_info->cutoff_orig));
   
   
   for (i = 0; i < args_info->inputs_num; ++i)
@@ -547,6 +650,10 @@ cmdline_parser_dump(FILE *outfile, struct gengetopt_args_info *args_info)
     write_into_file(outfile, "max-span", args_info->max_span_orig, 0);
   if (args_info->verbose_given)
     write_into_file(outfile, "verbose", args_info->verbose_orig, 0);
+  if (args_info->threads_given)
+    write_into_file(outfile, "threads", args_info->threads_orig, 0);
+  if (args_info->dp_threads_given)
+    write_into_file(outfile, "dp-threads", args_info->dp_threads_orig, 0);
   if (args_info->predict_given)
     write_into_file(outfile, "predict", 0, 0 );
   write_multiple_into_file(outfile, args_info->mea_given, "mea", args_info->mea_orig, 0);
@@ -557,6 +664,8 @@ cmdline_parser_dump(FILE *outfile, struct gengetopt_args_info *args_info)
     write_into_file(outfile, "constraints", 0, 0 );
   if (args_info->soft_constraints_given)
     write_into_file(outfile, "soft-constraints", 0, 0 );
+  if (args_info->low_memory_given)
+    write_into_file(outfile, "low-memory", args_info->low_memory_orig, 0);
   if (args_info->train_given)
     write_into_file(outfile, "train", args_info->train_orig, 0);
   if (args_info->max_iter_given)
@@ -583,6 +692,10 @@ cmdline_parser_dump(FILE *outfile, struct gengetopt_args_info *args_info)
     write_into_file(outfile, "per-bp-loss", 0, 0 );
   if (args_info->lambda_given)
     write_into_file(outfile, "lambda", args_info->lambda_orig, 0);
+  if (args_info->batch_size_given)
+    write_into_file(outfile, "batch-size", args_info->batch_size_orig, 0);
+  if (args_info->async_given)
+    write_into_file(outfile, "async", 0, 0 );
   if (args_info->scale_reactivity_given)
     write_into_file(outfile, "scale-reactivity", args_info->scale_reactivity_orig, 0);
   if (args_info->threshold_unpaired_reactivity_given)
@@ -597,8 +710,28 @@ cmdline_parser_dump(FILE *outfile, struct gengetopt_args_info *args_info)
     write_into_file(outfile, "max-hairpin-nucleotides-length", args_info->max_hairpin_nucleotides_length_orig, 0);
   if (args_info->out_param_given)
     write_into_file(outfile, "out-param", args_info->out_param_orig, 0);
+  if (args_info->checkpoint_given)
+    write_into_file(outfile, "checkpoint", args_info->checkpoint_orig, 0);
+  if (args_info->checkpoint_interval_given)
+    write_into_file(outfile, "checkpoint-interval", args_info->checkpoint_interval_orig, 0);
+  if (args_info->packed_data_given)
+    write_into_file(outfile, "packed-data", args_info->packed_data_orig, 0);
   if (args_info->validate_given)
     write_into_file(outfile, "validate", 0, 0 );
+  if (args_info->eval_given)
+    write_into_file(outfile, "eval", 0, 0 );
+  if (args_info->pack_given)
+    write_into_file(outfile, "pack", args_info->pack_orig, 0);
+  if (args_info->local_given)
+    write_into_file(outfile, "local", 0, 0 );
+  if (args_info->scan_given)
+    write_into_file(outfile, "scan", 0, 0 );
+  if (args_info->window_given)
+    write_into_file(outfile, "window", args_info->window_orig, 0);
+  if (args_info->window_step_given)
+    write_into_file(outfile, "window-step", args_info->window_step_orig, 0);
+  if (args_info->cutoff_given)
+    write_into_file(outfile, "cutoff", args_info->cutoff_orig, 0);
   
 
   i = EXIT_SUCCESS;
@@ -1182,12 +1315,15 @@ cmdline_parser_internal (
         { "random-seed",	1, NULL, 0 },
         { "max-span",	1, NULL, 0 },
         { "verbose",	1, NULL, 'v' },
+        { "threads",	1, NULL, 0 },
+        { "dp-threads",	1, NULL, 0 },
         { "predict",	0, NULL, 0 },
         { "mea",	1, NULL, 0 },
         { "gce",	1, NULL, 'g' },
         { "bpseq",	0, NULL, 0 },
         { "constraints",	0, NULL, 0 },
         { "soft-constraints",	0, NULL, 0 },
+        { "low-memory",	2, NULL, 0 },
         { "train",	1, NULL, 0 },
         { "max-iter",	1, NULL, 'i' },
         { "burn-in",	1, NULL, 'b' },
@@ -1202,6 +1338,8 @@ cmdline_parser_internal (
         { "neg-w-reactivity",	1, NULL, 0 },
         { "per-bp-loss",	0, NULL, 0 },
         { "lambda",	1, NULL, 0 },
+        { "batch-size",	1, NULL, 0 },
+        { "async",	0, NULL, 0 },
         { "scale-reactivity",	1, NULL, 0 },
         { "threshold-unpaired-reactivity",	1, NULL, 0 },
         { "threshold-paired-reactivity",	1, NULL, 0 },
@@ -1209,7 +1347,17 @@ cmdline_parser_internal (
         { "max-single-nucleotides-length",	1, NULL, 0 },
         { "max-hairpin-nucleotides-length",	1, NULL, 0 },
         { "out-param",	1, NULL, 0 },
+        { "checkpoint",	1, NULL, 0 },
+        { "checkpoint-interval",	1, NULL, 0 },
+        { "packed-data",	1, NULL, 0 },
         { "validate",	0, NULL, 0 },
+        { "eval",	0, NULL, 0 },
+        { "pack",	1, NULL, 0 },
+        { "local",	0, NULL, 0 },
+        { "scan",	0, NULL, 0 },
+        { "window",	1, NULL, 0 },
+        { "window-step",	1, NULL, 0 },
+        { "cutoff",	1, NULL, 0 },
         { 0,  0, 0, 0 }
       };
 
@@ -1373,6 +1521,34 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* The number of threads.  */
+          else if (strcmp (long_options[option_index].name, "threads") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->threads_arg), 
+                 &(args_info->threads_orig), &(args_info->threads_given),
+                &(local_args_info.threads_given), optarg, 0, "1", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "threads", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* The number of threads for the dynamic programming of each sequence.  */
+          else if (strcmp (long_options[option_index].name, "dp-threads") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->dp_threads_arg), 
+                 &(args_info->dp_threads_orig), &(args_info->dp_threads_given),
+                &(local_args_info.dp_threads_given), optarg, 0, "1", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "dp-threads", '-',
+                additional_error))
+              goto failure;
+          
           }
           /* Prediction mode.  */
           else if (strcmp (long_options[option_index].name, "predict") == 0)
@@ -1432,6 +1608,20 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* Compute the base-pairing probabilities with less memory, keeping the inside matrices every INT rows and recomputing the rest (0 for automatic).  */
+          else if (strcmp (long_options[option_index].name, "low-memory") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->low_memory_arg), 
+                 &(args_info->low_memory_orig), &(args_info->low_memory_given),
+                &(local_args_info.low_memory_given), optarg, 0, "0", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "low-memory", '-',
+                additional_error))
+              goto failure;
+          
           }
           /* Trainining mode (write the trained parameters into output-file).  */
           else if (strcmp (long_options[option_index].name, "train") == 0)
@@ -1570,6 +1760,32 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* The number of examples in a mini-batch (the number of threads by default).  */
+          else if (strcmp (long_options[option_index].name, "batch-size") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->batch_size_arg), 
+                 &(args_info->batch_size_orig), &(args_info->batch_size_given),
+                &(local_args_info.batch_size_given), optarg, 0, 0, ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "batch-size", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Update the parameters asynchronously by each thread instead of by mini-batches.  */
+          else if (strcmp (long_options[option_index].name, "async") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->async_flag), 0, &(args_info->async_given),
+                &(local_args_info.async_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "async", '-',
+                additional_error))
+              goto failure;
+          
           }
           /* The scale of reactivity.  */
           else if (strcmp (long_options[option_index].name, "scale-reactivity") == 0)
@@ -1666,6 +1882,48 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* Write a binary checkpoint into filename during training, and resume from it if it exists.  */
+          else if (strcmp (long_options[option_index].name, "checkpoint") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->checkpoint_arg), 
+                 &(args_info->checkpoint_orig), &(args_info->checkpoint_given),
+                &(local_args_info.checkpoint_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "checkpoint", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* The number of steps between checkpoints.  */
+          else if (strcmp (long_options[option_index].name, "checkpoint-interval") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->checkpoint_interval_arg), 
+                 &(args_info->checkpoint_interval_orig), &(args_info->checkpoint_interval_given),
+                &(local_args_info.checkpoint_interval_given), optarg, 0, "100", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "checkpoint-interval", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* The training data packed in pack mode, used instead of --structure and --reactivity.  */
+          else if (strcmp (long_options[option_index].name, "packed-data") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->packed_data_arg), 
+                 &(args_info->packed_data_orig), &(args_info->packed_data_given),
+                &(local_args_info.packed_data_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "packed-data", '-',
+                additional_error))
+              goto failure;
+          
           }
           /* Validation mode: validate the given structure can be parsed.  */
           else if (strcmp (long_options[option_index].name, "validate") == 0)
@@ -1678,6 +1936,98 @@ cmdline_parser_internal (
                 additional_error))
               goto failure;
           
+          }
+          /* Evaluation mode: score each of the given structures of each sequence.  */
+          else if (strcmp (long_options[option_index].name, "eval") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->eval_flag), 0, &(args_info->eval_given),
+                &(local_args_info.eval_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "eval", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Pack mode: write the training data given by --structure and --reactivity into output-file.  */
+          else if (strcmp (long_options[option_index].name, "pack") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->pack_arg), 
+                 &(args_info->pack_orig), &(args_info->pack_given),
+                &(local_args_info.pack_given), optarg, 0, 0, ARG_STRING,
+                check_ambiguity, override, 0, 0,
+                "pack", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Local folding mode: average the base-pairing probabilities over sliding windows.  */
+          else if (strcmp (long_options[option_index].name, "local") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->local_flag), 0, &(args_info->local_given),
+                &(local_args_info.local_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "local", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* Scan mode: write the outermost pairs of the Viterbi structures of sliding windows with their structures.  */
+          else if (strcmp (long_options[option_index].name, "scan") == 0)
+          {
+          
+          
+            if (update_arg((void *)&(args_info->scan_flag), 0, &(args_info->scan_given),
+                &(local_args_info.scan_given), optarg, 0, 0, ARG_FLAG,
+                check_ambiguity, override, 1, 0, "scan", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* The number of bases of each window, of which --max-span is the maximum span of base pairs.  */
+          else if (strcmp (long_options[option_index].name, "window") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->window_arg), 
+                 &(args_info->window_orig), &(args_info->window_given),
+                &(local_args_info.window_given), optarg, 0, "150", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "window", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* The number of bases by which the window slides.  */
+          else if (strcmp (long_options[option_index].name, "window-step") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->window_step_arg), 
+                 &(args_info->window_step_orig), &(args_info->window_step_given),
+                &(local_args_info.window_step_given), optarg, 0, "10", ARG_INT,
+                check_ambiguity, override, 0, 0,
+                "window-step", '-',
+                additional_error))
+              goto failure;
+          
+          }
+          /* The minimum averaged base-pairing probability to be written.  */
+          else if (strcmp (long_options[option_index].name, "cutoff") == 0)
+          {
+          
+          
+            if (update_arg( (void *)&(args_info->cutoff_arg), 
+                 &(args_info->cutoff_orig), &(args_info->cutoff_given),
+                &(local_args_info.cutoff_given), optarg, 0, "0.01", ARG_FLOAT,
+                check_ambiguity, override, 0, 0,
+                "cutoff", '-',
+                additional_error))
+              goto failure;
+          
           }
           
           break;
@@ -58,6 +58,12 @@ struct gengetopt_args_info
   int verbose_arg;	/**< @brief Verbose output (default='0').  */
   char * verbose_orig;	/**< @brief Verbose output original value given at command line.  */
   const char *verbose_help; /**< @brief Verbose output help description.  */
+  int threads_arg;	/**< @brief The number of threads (default='1').  */
+  char * threads_orig;	/**< @brief The number of threads original value given at command line.  */
+  const char *threads_help; /**< @brief The number of threads help description.  */
+  int dp_threads_arg;	/**< @brief The number of threads for the dynamic programming of each sequence (default='1').  */
+  char * dp_threads_orig;	/**< @brief The number of threads for the dynamic programming of each sequence original value given at command line.  */
+  const char *dp_threads_help; /**< @brief The number of threads for the dynamic programming of each sequence help description.  */
   int predict_flag;	/**< @brief Prediction mode (default=on).  */
   const char *predict_help; /**< @brief Prediction mode help description.  */
   float* mea_arg;	/**< @brief MEA decoding with gamma (default='6.0').  */
@@ -76,6 +82,9 @@ struct gengetopt_args_info
   const char *constraints_help; /**< @brief Use contraints help description.  */
   int soft_constraints_flag;	/**< @brief Use soft contraints (default=off).  */
   const char *soft_constraints_help; /**< @brief Use soft contraints help description.  */
+  int low_memory_arg;	/**< @brief Compute the base-pairing probabilities with less memory, keeping the inside matrices every INT rows and recomputing the rest (0 for automatic) (default='0').  */
+  char * low_memory_orig;	/**< @brief Compute the base-pairing probabilities with less memory, keeping the inside matrices every INT rows and recomputing the rest (0 for automatic) original value given at command line.  */
+  const char *low_memory_help; /**< @brief Compute the base-pairing probabilities with less memory, keeping the inside matrices every INT rows and recomputing the rest (0 for automatic) help description.  */
   char * train_arg;	/**< @brief Trainining mode (write the trained parameters into output-file).  */
   char * train_orig;	/**< @brief Trainining mode (write the trained parameters into output-file) original value given at command line.  */
   const char *train_help; /**< @brief Trainining mode (write the trained parameters into output-file) help description.  */
@@ -121,6 +130,11 @@ struct gengetopt_args_info
   float lambda_arg;	/**< @brief The weight for the L1 regularization term (default='0.0001').  */
   char * lambda_orig;	/**< @brief The weight for the L1 regularization term original value given at command line.  */
   const char *lambda_help; /**< @brief The weight for the L1 regularization term help description.  */
+  int batch_size_arg;	/**< @brief The number of examples in a mini-batch (the number of threads by default).  */
+  char * batch_size_orig;	/**< @brief The number of examples in a mini-batch (the number of threads by default) original value given at command line.  */
+  const char *batch_size_help; /**< @brief The number of examples in a mini-batch (the number of threads by default) help description.  */
+  int async_flag;	/**< @brief Update the parameters asynchronously by each thread instead of by mini-batches (default=off).  */
+  const char *async_help; /**< @brief Update the parameters asynchronously by each thread instead of by mini-batches help description.  */
   float scale_reactivity_arg;	/**< @brief The scale of reactivity (default='1.0').  */
   char * scale_reactivity_orig;	/**< @brief The scale of reactivity original value given at command line.  */
   const char *scale_reactivity_help; /**< @brief The scale of reactivity help description.  */
@@ -141,8 +155,35 @@ struct gengetopt_args_info
   char * out_param_arg;	/**< @brief Output parameter sets for each step.  */
   char * out_param_orig;	/**< @brief Output parameter sets for each step original value given at command line.  */
   const char *out_param_help; /**< @brief Output parameter sets for each step help description.  */
+  char * checkpoint_arg;	/**< @brief Write a binary checkpoint into filename during training, and resume from it if it exists.  */
+  char * checkpoint_orig;	/**< @brief Write a binary checkpoint into filename during training, and resume from it if it exists original value given at command line.  */
+  const char *checkpoint_help; /**< @brief Write a binary checkpoint into filename during training, and resume from it if it exists help description.  */
+  int checkpoint_interval_arg;	/**< @brief The number of steps between checkpoints (default='100').  */
+  char * checkpoint_interval_orig;	/**< @brief The number of steps between checkpoints original value given at command line.  */
+  const char *checkpoint_interval_help; /**< @brief The number of steps between checkpoints help description.  */
+  char * packed_data_arg;	/**< @brief The training data packed in pack mode, used instead of --structure and --reactivity.  */
+  char * packed_data_orig;	/**< @brief The training data packed in pack mode, used instead of --structure and --reactivity original value given at command line.  */
+  const char *packed_data_help; /**< @brief The training data packed in pack mode, used instead of --structure and --reactivity help description.  */
   int validate_flag;	/**< @brief Validation mode: validate the given structure can be parsed (default=off).  */
   const char *validate_help; /**< @brief Validation mode: validate the given structure can be parsed help description.  */
+  int eval_flag;	/**< @brief Evaluation mode: score each of the given structures of each sequence (default=off).  */
+  const char *eval_help; /**< @brief Evaluation mode: score each of the given structures of each sequence help description.  */
+  char * pack_arg;	/**< @brief Pack mode: write the training data given by --structure and --reactivity into output-file.  */
+  char * pack_orig;	/**< @brief Pack mode: write the training data given by --structure and --reactivity into output-file original value given at command line.  */
+  const char *pack_help; /**< @brief Pack mode: write the training data given by --structure and --reactivity into output-file help description.  */
+  int local_flag;	/**< @brief Local folding mode: average the base-pairing probabilities over sliding windows (default=off).  */
+  const char *local_help; /**< @brief Local folding mode: average the base-pairing probabilities over sliding windows help description.  */
+  int scan_flag;	/**< @brief Scan mode: write the outermost pairs of the Viterbi structures of sliding windows with their structures (default=off).  */
+  const char *scan_help; /**< @brief Scan mode: write the outermost pairs of the Viterbi structures of sliding windows with their structures help description.  */
+  int window_arg;	/**< @brief The number of bases of each window, of which --max-span is the maximum span of base pairs (default='150').  */
+  char * window_orig;	/**< @brief The number of bases of each window, of which --max-span is the maximum span of base pairs original value given at command line.  */
+  const char *window_help; /**< @brief The number of bases of each window, of which --max-span is the maximum span of base pairs help description.  */
+  int window_step_arg;	/**< @brief The number of bases by which the window slides. The averages are over every INT-th window only; 1 gives the RNAplfold averages over all the windows, INT times slower (default='10').  */
+  char * window_step_orig;	/**< @brief The number of bases by which the window slides. The averages are over every INT-th window only; 1 gives the RNAplfold averages over all the windows, INT times slower original value given at command line.  */
+  const char *window_step_help; /**< @brief The number of bases by which the window slides. The averages are over every INT-th window only; 1 gives the RNAplfold averages over all the windows, INT times slower help description.  */
+  float cutoff_arg;	/**< @brief The minimum averaged base-pairing probability to be written (default='0.01').  */
+  char * cutoff_orig;	/**< @brief The minimum averaged base-pairing probability to be written original value given at command line.  */
+  const char *cutoff_help; /**< @brief The minimum averaged base-pairing probability to be written help description.  */
   
   unsigned int help_given ;	/**< @brief Whether help was given.  */
   unsigned int full_help_given ;	/**< @brief Whether full-help was given.  */
@@ -154,12 +195,15 @@ struct gengetopt_args_info
   unsigned int random_seed_given ;	/**< @brief Whether random-seed was given.  */
   unsigned int max_span_given ;	/**< @brief Whether max-span was given.  */
   unsigned int verbose_given ;	/**< @brief Whether verbose was given.  */
+  unsigned int threads_given ;	/**< @brief Whether threads was given.  */
+  unsigned int dp_threads_given ;	/**< @brief Whether dp-threads was given.  */
   unsigned int predict_given ;	/**< @brief Whether predict was given.  */
   unsigned int mea_given ;	/**< @brief Whether mea was given.  */
   unsigned int gce_given ;	/**< @brief Whether gce was given.  */
   unsigned int bpseq_given ;	/**< @brief Whether bpseq was given.  */
   unsigned int constraints_given ;	/**< @brief Whether constraints was given.  */
   unsigned int soft_constraints_given ;	/**< @brief Whether soft-constraints was given.  */
+  unsigned int low_memory_given ;	/**< @brief Whether low-memory was given.  */
   unsigned int train_given ;	/**< @brief Whether train was given.  */
   unsigned int max_iter_given ;	/**< @brief Whether max-iter was given.  */
   unsigned int burn_in_given ;	/**< @brief Whether burn-in was given.  */
@@ -174,6 +218,8 @@ struct gengetopt_args_info
   unsigned int neg_w_reactivity_given ;	/**< @brief Whether neg-w-reactivity was given.  */
   unsigned int per_bp_loss_given ;	/**< @brief Whether per-bp-loss was given.  */
   unsigned int lambda_given ;	/**< @brief Whether lambda was given.  */
+  unsigned int batch_size_given ;	/**< @brief Whether batch-size was given.  */
+  unsigned int async_given ;	/**< @brief Whether async was given.  */
   unsigned int scale_reactivity_given ;	/**< @brief Whether scale-reactivity was given.  */
   unsigned int threshold_unpaired_reactivity_given ;	/**< @brief Whether threshold-unpaired-reactivity was given.  */
   unsigned int threshold_paired_reactivity_given ;	/**< @brief Whether threshold-paired-reactivity was given.  */
@@ -181,7 +227,17 @@ struct gengetopt_args_info
   unsigned int max_single_nucleotides_length_given ;	/**< @brief Whether max-single-nucleotides-length was given.  */
   unsigned int max_hairpin_nucleotides_length_given ;	/**< @brief Whether max-hairpin-nucleotides-length was given.  */
   unsigned int out_param_given ;	/**< @brief Whether out-param was given.  */
+  unsigned int checkpoint_given ;	/**< @brief Whether checkpoint was given.  */
+  unsigned int checkpoint_interval_given ;	/**< @brief Whether checkpoint-interval was given.  */
+  unsigned int packed_data_given ;	/**< @brief Whether packed-data was given.  */
   unsigned int validate_given ;	/**< @brief Whether validate was given.  */
+  unsigned int eval_given ;	/**< @brief Whether eval was given.  */
+  unsigned int pack_given ;	/**< @brief Whether pack was given.  */
+  unsigned int local_given ;	/**< @brief Whether local was given.  */
+  unsigned int scan_given ;	/**< @brief Whether scan was given.  */
+  unsigned int window_given ;	/**< @brief Whether window was given.  */
+  unsigned int window_step_given ;	/**< @brief Whether window-step was given.  */
+  unsigned int cutoff_given ;	/**< @brief Whether cutoff was given.  */
 
   char **inputs ; /**< @brief unamed options (options without names) */
   unsigned inputs_num ; /**< @brief unamed options number */
@@ -10,11 +10,25 @@
 #include <random>
 #include <cassert>
 #include <ctime>
+#include <csignal>
+#include <cstdio>
+#include <sstream>
+#include <map>
+#include <algorithm>
+#include <numeric>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <memory>
 #include "cmdline.h"
 #include "Config.hpp"
 #include "Utilities.hpp"
 #include "InferenceEngine.hpp"
 #include "FeatureMap.hpp"
+#include "FeatureCounts.hpp"
+#include "ParameterView.hpp"
 #include "SStruct.hpp"
 #include "adagrad.hpp"
 
@@ -22,10 +36,203 @@ extern std::unordered_map<std::string, param_value_type> default_params_compleme
 extern std::unordered_map<std::string, param_value_type> trained_params_complementary;
 extern std::unordered_map<std::string, param_value_type> default_params_noncomplementary;
 
+// call f(0), ..., f(n-1) on up to the given number of threads.  The first
+// exception thrown by f stops handing out the rest and is rethrown here.
+template < class F >
+static void
+parallel_for(size_t n, int threads, F f)
+{
+  if (threads<=1 || n<=1)
+  {
+    for (size_t e=0; e!=n; ++e)
+      f(e);
+    return;
+  }
+
+  std::mutex mtx;
+  size_t next = 0;
+  std::exception_ptr error;
+  std::vector<std::thread> workers;
+  for (int th=0; th!=std::min<int>(threads, n); ++th)
+  {
+    workers.emplace_back([&]() {
+        while (true)
+        {
+          size_t e;
+          {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (error || next==n) return;
+            e = next++;
+          }
+          try
+          {
+            f(e);
+          }
+          catch (...)
+          {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!error) error = std::current_exception();
+            return;
+          }
+        }
+      });
+  }
+  for (auto& w : workers)
+    w.join();
+  if (error)
+    std::rethrow_exception(error);
+}
+
+// the same as above, but the calls are handed out in the decreasing order
+// of cost(i), i.e. the longest processing time first, so that the threads
+// idle behind a few expensive calls at the end as little as possible.
+template < class F, class C >
+static void
+parallel_for(size_t n, int threads, F f, C cost)
+{
+  if (threads<=1 || n<=1)
+  {
+    parallel_for(n, threads, f);
+    return;
+  }
+
+  std::vector<double> c(n);
+  for (size_t e=0; e!=n; ++e)
+    c[e] = cost(e);
+  std::vector<size_t> order(n);
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return c[a]>c[b]; });
+  parallel_for(n, threads, [&](size_t e) { f(order[e]); });
+}
+
+// whether the pairing of every position is given, so that the
+// structure can be scored without the dynamic programming
+static bool
+fully_given(const SStruct& s)
+{
+  const auto& mapping = s.GetMapping();
+  return std::none_of(mapping.begin()+1, mapping.end(), [](int m) { return m<0; });
+}
+
+// set by SIGTERM, on which training stops after writing a checkpoint
+static volatile std::sig_atomic_t terminate_requested = 0;
+
+static void
+request_termination(int)
+{
+  terminate_requested = 1;
+}
+
+// writes files in the background, one at a time.  Each file is written
+// under a temporary name and then renamed, so that it always holds the
+// whole data of a completed write.
+class BackgroundWriter
+{
+public:
+  BackgroundWriter() : th_(), error_() { }
+  ~BackgroundWriter() { if (th_.joinable()) th_.join(); }
+
+  void write(const std::string& filename, std::string data)
+  {
+    wait();
+    th_ = std::thread([this, filename](const std::string& data) {
+        try
+        {
+          const auto tmp = filename + ".tmp";
+          std::ofstream os(tmp.c_str(), std::ios::binary);
+          if (!os) throw std::runtime_error(std::string(strerror(errno)) + ": " + tmp);
+          os.write(data.data(), data.size());
+          os.close();
+          if (!os) throw std::runtime_error(std::string(strerror(errno)) + ": " + tmp);
+          if (std::rename(tmp.c_str(), filename.c_str())!=0)
+            throw std::runtime_error(std::string(strerror(errno)) + ": " + filename);
+        }
+        catch (...)
+        {
+          error_ = std::current_exception();
+        }
+      }, std::move(data));
+  }
+
+  // wait for the last write, and rethrow its error if any
+  void wait()
+  {
+    if (th_.joinable()) th_.join();
+    if (error_)
+    {
+      auto e = error_;
+      error_ = nullptr;
+      std::rethrow_exception(e);
+    }
+  }
+
+private:
+  std::thread th_;
+  std::exception_ptr error_;
+};
+
+// the windows of W bases that slide every step bases along a sequence
+// read in chunks, where the last window ends at the end of the sequence
+// and the sequence shorter than W is a single window.  Only the bases
+// from the start of the last window are kept.
+class SlidingWindows
+{
+public:
+  SlidingWindows(SequenceStreamReader& reader, int W, int step)
+    : reader_(reader), W_(W), step_(step), buf_(), buf_start_(1), start_(0), length_(-1), done_(false) { }
+
+  // the next window, which starts at the position start with the bases
+  // seq, and last is set if it ends at the end of the sequence.  Returns
+  // false after the last window.
+  bool next(int& start, std::string& seq, bool& last)
+  {
+    if (done_) return false;
+    int a = 1;
+    if (start_>0)
+    {
+      buf_.erase(0, start_-buf_start_);
+      buf_start_ = start_;
+      a = start_+step_;
+    }
+
+    // read up to the base following the window to see if it is the last
+    const int end = a+W_;
+    while (length_<0 && buf_start_+int(buf_.size())<=end)
+      if (reader_.Read(buf_, end-buf_start_-buf_.size()+1)==0)
+        length_ = buf_start_+buf_.size()-1;
+    if (length_>=0 && a+W_-1>=length_)
+    {
+      a = std::max(1, length_-W_+1);
+      done_ = true;
+    }
+    if (a>int(buf_start_+buf_.size()-1))
+      return false;
+
+    start_ = start = a;
+    seq = buf_.substr(a-buf_start_, W_);
+    last = done_;
+    return true;
+  }
+
+  // the length of the sequence, which is known after the last window
+  int length() const { return length_; }
+
+private:
+  SequenceStreamReader& reader_;
+  const int W_;
+  const int step_;
+  std::string buf_;
+  int buf_start_;
+  int start_;
+  int length_;
+  bool done_;
+};
+
 class MXfold
 {
 public:
-  MXfold() : train_mode_(false), mea_(false), gce_(false), validation_mode_(false) { }
+  MXfold() : train_mode_(false), mea_(false), gce_(false), validation_mode_(false), eval_mode_(false),
+             local_mode_(false), scan_mode_(false) { }
 
   MXfold& parse_options(int& argc, char**& argv);
 
@@ -33,6 +240,12 @@ public:
   {
     if (validation_mode_)
       return verbose_==0 ? validate() : count_features();
+    if (eval_mode_)
+      return evaluate();
+    if (!pack_file_.empty())
+      return pack();
+    if (local_mode_ || scan_mode_)
+      return local();
     if (train_mode_)
       return train();
     else
@@ -42,10 +255,82 @@ public:
 private:
   int train();
   int predict();
+  void predict(InferenceEngine<param_value_type>& inference_engine, const SStruct& sstruct, FeatureMap* fm,
+               std::ostream& os, std::ostream& es) const;
   int validate();
   int count_features();
+  int evaluate();
+  int pack();
+  int local();
+  void local(std::vector<std::unique_ptr<InferenceEngine<param_value_type>>>& engines, int span,
+             SequenceStreamReader& reader, const std::string& name, std::ostream& os) const;
+  void scan(std::vector<std::unique_ptr<InferenceEngine<param_value_type>>>& engines, int span,
+            SequenceStreamReader& reader, const std::string& name, std::ostream& os) const;
+  double estimate_cost(const SStruct& s) const;
   std::pair<uint,uint> read_data(std::vector<SStruct>& data, const std::vector<std::string>& lists, int type) const;
-  std::pair<std::unordered_map<size_t,param_value_type>,float> compute_gradients(const SStruct& s, FeatureMap* fm, const std::vector<param_value_type>* params);
+  std::pair<uint,uint> read_packed_data(std::vector<SStruct>& data) const;
+
+  // the progress of training, which is saved in a checkpoint together
+  // with the random number generator and the optimizer
+  struct TrainingState
+  {
+    uint t;                     // epoch
+    uint k;                     // step
+    size_t pos;                 // the number of the examples of this epoch already used
+    float loss;                 // the loss of this epoch so far
+    std::vector<uint> idx;      // the order of the examples in this epoch
+
+    TrainingState() : t(0), k(0), pos(0), loss(0.0), idx() { }
+  };
+  std::string write_checkpoint(const TrainingState& st, const std::mt19937& rnd, size_t n_data,
+                               AdaGradFobosUpdater& optimizer) const;
+  bool read_checkpoint(TrainingState& st, std::mt19937& rnd, size_t n_data,
+                       AdaGradFobosUpdater& optimizer) const;
+
+  // feature counts of a reference structure that is fully given by the
+  // constraints, which do not depend on the parameters.  Its score is
+  // the dot product of the counts with the parameters plus the offset
+  // that is not parameterized, i.e. the Turner energy.
+  struct ReferenceCounts
+  {
+    bool cached;
+    std::vector<std::pair<uint,param_value_type>> counts;
+    param_value_type offset;
+    int np;
+
+    ReferenceCounts() : cached(false), counts(), offset(0), np(1) { }
+    param_value_type score(const ParameterView<param_value_type>& params) const
+    {
+      param_value_type r = offset;
+      for (const auto& c : counts)
+        r += c.second * params[c.first];
+      return r;
+    }
+  };
+
+  // Viterbi parses of a training example for the reference structure
+  // and for the loss-augmented prediction.  engine1 is left empty when
+  // the reference structure is taken from the cache.
+  struct ViterbiParses
+  {
+    std::unique_ptr<InferenceEngine<param_value_type>> engine1;
+    std::unique_ptr<InferenceEngine<param_value_type>> engine0;
+    const ReferenceCounts* ref;
+    param_value_type score1;
+    int np;
+    double starting_time;
+  };
+  void parse_reference(const SStruct& s, FeatureMap* fm, const ParameterView<param_value_type>& params,
+                       ViterbiParses& vp) const;
+  void cache_references(const std::vector<SStruct>& data, FeatureMap& fm,
+                        const ParameterView<param_value_type>& params, std::vector<ReferenceCounts>& refs) const;
+  void compute_viterbi(const SStruct& s, const ReferenceCounts& ref, FeatureMap* fm,
+                       const ParameterView<param_value_type>& params, ViterbiParses& vp) const;
+  float compute_gradients(const SStruct& s, ViterbiParses& vp, FeatureCounts<param_value_type>& grad,
+                          std::ostream& os) const;
+  void train_async(const std::vector<SStruct>& data, const std::vector<ReferenceCounts>& refs, uint n_str,
+                   FeatureMap& fm, std::vector<param_value_type>& params, AdaGradFobosUpdater& optimizer,
+                   TrainingState& st) const;
 
 private:
   bool train_mode_;
@@ -56,6 +341,8 @@ private:
   bool with_turner_;
   std::vector<std::string> data_list_;
   std::vector<std::string> data_weak_list_;
+  std::string packed_data_;
+  std::string pack_file_;
   bool mea_;
   bool gce_;
   std::vector<float> gamma_;
@@ -79,10 +366,23 @@ private:
   int max_hairpin_nucleotides_length;
   //bool use_bp_context_;
   int verbose_;
+  int threads_;
+  int dp_threads_;
+  int batch_size_;
+  bool async_;
   std::string out_param_;
+  std::string checkpoint_file_;
+  int checkpoint_interval_;
   bool validation_mode_;
+  bool eval_mode_;
+  bool local_mode_;
+  bool scan_mode_;
+  int window_;
+  int window_step_;
+  float cutoff_;
   bool use_constraints_;
   bool use_soft_constraints_;
+  int low_memory_;
   std::vector<std::string> args_;
 };
 
@@ -134,6 +434,16 @@ MXfold::parse_options(int& argc, char**& argv)
   if (args_info.out_param_given)
     out_param_ = args_info.out_param_arg;
 
+  if (args_info.packed_data_given)
+    packed_data_ = args_info.packed_data_arg;
+
+  if (args_info.pack_given)
+    pack_file_ = args_info.pack_arg;
+
+  if (args_info.checkpoint_given)
+    checkpoint_file_ = args_info.checkpoint_arg;
+  checkpoint_interval_ = std::max(1, args_info.checkpoint_interval_arg);
+
   with_turner_ = args_info.without_turner_flag!=1;
   noncomplementary_ = args_info.noncomplementary_flag==1;
   output_bpseq_ = args_info.bpseq_flag==1;
@@ -156,14 +466,26 @@ MXfold::parse_options(int& argc, char**& argv)
   max_single_nucleotides_length = args_info.max_single_nucleotides_length_arg;
   max_hairpin_nucleotides_length = args_info.max_hairpin_nucleotides_length_arg;
   verbose_ = args_info.verbose_arg;
+  threads_ = std::max(1, args_info.threads_arg);
+  dp_threads_ = std::max(1, args_info.dp_threads_arg);
+  batch_size_ = args_info.batch_size_given ? std::max(1, args_info.batch_size_arg) : threads_;
+  async_ = args_info.async_flag==1;
   use_constraints_ = args_info.constraints_flag==1;
   use_soft_constraints_ = args_info.soft_constraints_flag==1;
+  low_memory_ = args_info.low_memory_given ? std::max(0, args_info.low_memory_arg) : -1;
   validation_mode_ = args_info.validate_flag==1;
+  eval_mode_ = args_info.eval_flag==1;
+  local_mode_ = args_info.local_flag==1;
+  scan_mode_ = args_info.scan_flag==1;
+  window_ = std::max(1, args_info.window_arg);
+  window_step_ = std::max(1, args_info.window_step_arg);
+  cutoff_ = args_info.cutoff_arg;
 
   srand(args_info.random_seed_arg<0 ? time(0) : args_info.random_seed_arg);
 
-  if ((!train_mode_ && args_info.inputs_num==0) ||
-      (train_mode_ && data_list_.empty() && data_weak_list_.empty() && args_info.inputs_num==0)) 
+  if ((!train_mode_ && pack_file_.empty() && args_info.inputs_num==0) ||
+      (train_mode_ && data_list_.empty() && data_weak_list_.empty() && packed_data_.empty() && args_info.inputs_num==0) ||
+      (!pack_file_.empty() && data_list_.empty() && data_weak_list_.empty())) 
   {
     cmdline_parser_print_help();
     cmdline_parser_free(&args_info);
@@ -190,36 +512,51 @@ read_data(std::vector<SStruct>& data, const std::vector<std::string>& lists, int
     if (!is) throw std::runtime_error(std::string(strerror(errno)) + ": " + l);
     std::string f;
     while (is >> f)
-    {
       data.emplace_back(f, type);
-      if (type!=SStruct::NO_REACTIVITY && discretize_reactivity_)
-        data.back().DiscretizeReactivity(threshold_unpaired_reactivity_, threshold_paired_reactivity_);
-    }
   }
   pos.second = data.size();
   return pos;
 }
 
-//std::vector<param_value_type>
-std::pair<std::unordered_map<size_t,param_value_type>,float>
+// the structures of the packed data precede the reactivity data as
+// written by pack(), so that they are laid out as read by read_data().
+std::pair<uint,uint>
 MXfold::
-compute_gradients(const SStruct& s, FeatureMap* fm, const std::vector<param_value_type>* params)
+read_packed_data(std::vector<SStruct>& data) const
 {
-  double starting_time = GetSystemTime();
-  //std::vector<param_value_type> grad(params->size(), 0.0);
-  std::unordered_map<size_t,param_value_type> grad;
-  int np=1;
+  SStructPack pack(packed_data_);
+  data.resize(pack.GetNumStructures());
+  parallel_for(data.size(), threads_, [&](size_t i) { pack.Load(i, data[i]); });
+
+  uint n_str = 0;
+  while (n_str<data.size() && data[n_str].GetType()==SStruct::NO_REACTIVITY)
+    ++n_str;
+  for (uint i=n_str; i!=data.size(); ++i)
+    if (data[i].GetType()==SStruct::NO_REACTIVITY)
+      throw std::runtime_error("Structures after reactivity data: " + packed_data_);
+  return std::make_pair(n_str, uint(data.size()));
+}
 
-  // count the occurence of parameters in the correct structure
+// the Viterbi parses only read the feature map and the parameters,
+// so that they can be computed for several examples at once.
+void
+MXfold::
+parse_reference(const SStruct& s, FeatureMap* fm, const ParameterView<param_value_type>& params,
+                ViterbiParses& vp) const
+{
+  vp.np = 1;
+
+  // parse the correct structure
   auto max_single_length = DEFAULT_C_MAX_SINGLE_LENGTH;
   auto max_span = -1;
   if (s.GetType() == SStruct::NO_REACTIVITY)
     max_single_length = std::max<int>(s.GetLength()/2., DEFAULT_C_MAX_SINGLE_LENGTH);
   else
     max_span = max_span_;
-  InferenceEngine<param_value_type> inference_engine1(with_turner_, noncomplementary_,
-                                                      max_single_length, max_single_nucleotides_length,
-                                                      DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length, max_span);
+  vp.engine1.reset(new InferenceEngine<param_value_type>(with_turner_, noncomplementary_,
+                                                         max_single_length, max_single_nucleotides_length,
+                                                         DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length, max_span));
+  auto& inference_engine1 = *vp.engine1;
   inference_engine1.LoadValues(fm, params);
   inference_engine1.LoadSequence(s);
   if (s.GetType() == SStruct::NO_REACTIVITY || discretize_reactivity_)
@@ -228,7 +565,7 @@ compute_gradients(const SStruct& s, FeatureMap* fm, const std::vector<param_valu
     inference_engine1.ComputeViterbi();
     if (per_bp_loss_)
       for (auto m : s.GetMapping())
-        if (m != SStruct::UNKNOWN && m != SStruct::UNPAIRED) ++np;
+        if (m != SStruct::UNKNOWN && m != SStruct::UNPAIRED) ++vp.np;
   }
   else
   {
@@ -239,19 +576,91 @@ compute_gradients(const SStruct& s, FeatureMap* fm, const std::vector<param_valu
       SStruct solution(s);
       solution.SetMapping(inference_engine1.PredictPairingsViterbi());
       for (auto m : solution.GetMapping())
-        if (m != SStruct::UNKNOWN && m != SStruct::UNPAIRED) ++np;
+        if (m != SStruct::UNKNOWN && m != SStruct::UNPAIRED) ++vp.np;
     }
   }
+}
 
-  auto loss1 = inference_engine1.GetViterbiScore();
-  auto corr = inference_engine1.ComputeViterbiFeatureCounts();
-  for (auto e : corr)
-    grad.emplace(e.first, static_cast<param_value_type>(0)).first->second -= e.second;
+// the reference structure of an example whose constraints leave no
+// position unknown is fixed, and so are its feature counts.  They are
+// extracted once here by walking its loops instead of parsing it again
+// at every step.  The examples whose reference structure cannot be
+// parsed as it is, e.g. those with pseudoknots, are left to be parsed
+// at every step.
+void
+MXfold::
+cache_references(const std::vector<SStruct>& data, FeatureMap& fm,
+                 const ParameterView<param_value_type>& params, std::vector<ReferenceCounts>& refs) const
+{
+  refs.assign(data.size(), ReferenceCounts());
+  parallel_for(data.size(), threads_, [&](size_t i) {
+      const auto& s = data[i];
+      if (s.GetType() != SStruct::NO_REACTIVITY && !discretize_reactivity_) return;
+      if (!fully_given(s)) return;
+
+      auto max_single_length = DEFAULT_C_MAX_SINGLE_LENGTH;
+      auto max_span = -1;
+      if (s.GetType() == SStruct::NO_REACTIVITY)
+        max_single_length = std::max<int>(s.GetLength()/2., DEFAULT_C_MAX_SINGLE_LENGTH);
+      else
+        max_span = max_span_;
+      InferenceEngine<param_value_type> inference_engine1(with_turner_, noncomplementary_,
+                                                          max_single_length, max_single_nucleotides_length,
+                                                          DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length, max_span);
+      inference_engine1.LoadValues(&fm, params);
+      FeatureCounts<param_value_type> cnt(fm.size());
+      const auto score = inference_engine1.EvaluateStructure(s, &cnt);
+      if (score <= param_value_type(NEG_INF/2)) return;
+
+      auto& ref = refs[i];
+      for (auto j : cnt)
+        if (cnt[j]!=0.0)
+          ref.counts.emplace_back(j, cnt[j]);
+      std::sort(ref.counts.begin(), ref.counts.end());
+      ref.counts.shrink_to_fit();
+      ref.offset = score - ref.score(params);
+      ref.np = 1;
+      if (per_bp_loss_)
+        for (auto m : s.GetMapping())
+          if (m != SStruct::UNKNOWN && m != SStruct::UNPAIRED) ++ref.np;
+      ref.cached = true;
+    });
+  fm.merge();
 
-  // count the occurence of parameters in the predicted structure
-  InferenceEngine<param_value_type> inference_engine0(with_turner_, noncomplementary_,
-                                                      DEFAULT_C_MAX_SINGLE_LENGTH, max_single_nucleotides_length,
-                                                      DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length, max_span_);
+  if (verbose_>0)
+  {
+    const auto n = std::count_if(refs.begin(), refs.end(), [](const ReferenceCounts& r) { return r.cached; });
+    std::cout << "Cached the reference structures of " << n << "/" << data.size() << " examples" << std::endl;
+  }
+}
+
+void
+MXfold::
+compute_viterbi(const SStruct& s, const ReferenceCounts& ref, FeatureMap* fm,
+                const ParameterView<param_value_type>& params, ViterbiParses& vp) const
+{
+  vp.starting_time = GetSystemTime();
+
+  // parse the correct structure unless it has been cached
+  if (ref.cached)
+  {
+    vp.ref = &ref;
+    vp.score1 = ref.score(params);
+    vp.np = ref.np;
+  }
+  else
+  {
+    vp.ref = nullptr;
+    parse_reference(s, fm, params, vp);
+    vp.score1 = vp.engine1->GetViterbiScore();
+  }
+
+  // parse the predicted structure
+  vp.engine0.reset(new InferenceEngine<param_value_type>(with_turner_, noncomplementary_,
+                                                         DEFAULT_C_MAX_SINGLE_LENGTH, max_single_nucleotides_length,
+                                                         DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length, max_span_));
+  auto& inference_engine0 = *vp.engine0;
+  const auto np = vp.np;
   inference_engine0.LoadValues(fm, params);
   inference_engine0.LoadSequence(s);
   switch (s.GetType())
@@ -269,33 +678,61 @@ compute_gradients(const SStruct& s, FeatureMap* fm, const std::vector<param_valu
       assert(!"unreachable");
       break;
   }
-
   inference_engine0.ComputeViterbi();
+}
+
+// counting the features may register new ones into the feature map,
+// which FeatureMap keeps aside until merge() so that other threads can
+// parse and count at the same time.  The gradient is stored into grad,
+// and the log is written into os.
+float
+MXfold::
+compute_gradients(const SStruct& s, ViterbiParses& vp, FeatureCounts<param_value_type>& grad,
+                  std::ostream& os) const
+{
+  auto& inference_engine0 = *vp.engine0;
+  const auto np = vp.np;
+  grad.clear();
+
+  // count the occurence of parameters in the correct structure
+  auto loss1 = vp.score1;
+  if (vp.ref)
+  {
+    for (const auto& c : vp.ref->counts)
+      grad[c.first] = -c.second;
+  }
+  else
+  {
+    vp.engine1->ComputeViterbiFeatureCounts(grad);
+    for (auto i : grad)
+      grad[i] = -grad[i];
+  }
+
+  // count the occurence of parameters in the predicted structure
   auto loss0 = inference_engine0.GetViterbiScore();
-  auto pred = inference_engine0.ComputeViterbiFeatureCounts();
-  for (auto e : pred)
-    grad.emplace(e.first, static_cast<param_value_type>(0)).first->second += e.second;
+  inference_engine0.ComputeViterbiFeatureCounts(grad);
 
   if (verbose_>0)
   {
-    std::cout << "Loss: " << loss0-loss1 << ", "
-              << "pos_w: " << pos_w_/np << ", " << "neg_w: " << neg_w_/np << ", "
-              << "Time: " << GetSystemTime() - starting_time << "sec" << std::endl;
+    os << "Loss: " << loss0-loss1 << ", "
+       << "pos_w: " << pos_w_/np << ", " << "neg_w: " << neg_w_/np << ", "
+       << "Time: " << GetSystemTime() - vp.starting_time << "sec" << std::endl;
   }
   if (verbose_>1)
   {
     SStruct solution1(s);
-    solution1.SetMapping(inference_engine1.PredictPairingsViterbi());
-    solution1.WriteParens(std::cout);
+    if (!vp.ref)
+      solution1.SetMapping(vp.engine1->PredictPairingsViterbi());
+    solution1.WriteParens(os);
 
     SStruct solution0(s);
     solution0.SetMapping(inference_engine0.PredictPairingsViterbi());
-    solution0.WriteParens(std::cout);
+    solution0.WriteParens(os);
 
-    std::cout << std::endl;
+    os << std::endl;
   }
 
-  return std::make_pair(std::move(grad), loss0-loss1);
+  return loss0-loss1;
 }
 
 int
@@ -306,94 +743,372 @@ MXfold::train()
 
   // read traing data
   std::vector<SStruct> data;
-  auto pos_str = read_data(data, data_list_, SStruct::NO_REACTIVITY);
-  auto pos_weak = read_data(data, data_weak_list_, SStruct::REACTIVITY_PAIRED);
+  std::pair<uint,uint> pos_str, pos_weak;
+  if (!packed_data_.empty())
+  {
+    pos_weak = read_packed_data(data);
+    pos_str = std::make_pair(0u, pos_weak.first);
+  }
+  else
+  {
+    pos_str = read_data(data, data_list_, SStruct::NO_REACTIVITY);
+    pos_weak = read_data(data, data_weak_list_, SStruct::REACTIVITY_PAIRED);
+  }
+  if (discretize_reactivity_)
+    for (auto& s : data)
+      if (s.GetType()!=SStruct::NO_REACTIVITY)
+        s.DiscretizeReactivity(threshold_unpaired_reactivity_, threshold_paired_reactivity_);
 
   FeatureMap fm;
   std::vector<param_value_type> params;
   //AdaGradRDAUpdater optimizer(eta0_, lambda_);
   AdaGradFobosUpdater optimizer(verbose_, fm, params, eta0_, lambda_);
-  if (!param_file_.empty())
+
+  // resume from the checkpoint if it exists
+  TrainingState st;
+  if (!checkpoint_file_.empty() && read_checkpoint(st, rnd, data.size(), optimizer))
+  {
+    if (verbose_>0)
+      std::cout << "Resumed from " << checkpoint_file_ << " at epoch " << st.t << ", step " << st.k << std::endl;
+  }
+  else if (!param_file_.empty())
   {
     params = fm.read_from_file(param_file_);
     optimizer.read_from_file(param_file_);
   }
 
+  // gradients of the examples in a mini-batch and of the mini-batch,
+  // which are reused through the training
+  const size_t max_batch_size = async_ ? 0 : std::min<size_t>(batch_size_, data.size());
+  std::vector<FeatureCounts<param_value_type>> grads(max_batch_size, FeatureCounts<param_value_type>(fm.size()));
+  FeatureCounts<param_value_type> grad(fm.size());
+  std::vector<float> losses(max_batch_size);
+
+  // feature counts of the reference structures, reused through the training
+  std::vector<ReferenceCounts> refs;
+  cache_references(data, fm, optimizer.view(), refs);
+
+  // the checkpoints are written in the background while training goes on,
+  // and once more when SIGTERM arrives before training is terminated.
+  BackgroundWriter writer;
+  auto checkpoint = [&]() {
+    if (checkpoint_file_.empty()) return;
+    writer.write(checkpoint_file_, write_checkpoint(st, rnd, data.size(), optimizer));
+    if (terminate_requested)
+    {
+      writer.wait();
+      std::cerr << "Terminated at epoch " << st.t << ", step " << st.k
+                << "; the checkpoint has been written into " << checkpoint_file_ << std::endl;
+      std::signal(SIGTERM, SIG_DFL);
+      std::raise(SIGTERM);
+    }
+  };
+  if (!checkpoint_file_.empty())
+    std::signal(SIGTERM, request_termination);
+
   // run max-margin training
-  for (uint t=0, k=0; t!=t_max_; ++t)
+  while (st.t!=t_max_)
   {
-    float loss = 0.0;
-
-    if (verbose_>0)
-      std::cout << std::endl << "=== Start Epoch " << t << " ===" << std::endl;
+    if (st.pos==0)
+    {
+      if (verbose_>0)
+        std::cout << std::endl << "=== Start Epoch " << st.t << " ===" << std::endl;
 
-    std::vector<uint> idx(t<t_burn_in_ ? pos_str.second : pos_weak.second);
-    std::iota(idx.begin(), idx.end(), 0);
-    std::shuffle(idx.begin(), idx.end(), rnd);
+      st.loss = 0.0;
+      st.idx.resize(st.t<t_burn_in_ ? pos_str.second : pos_weak.second);
+      std::iota(st.idx.begin(), st.idx.end(), 0);
+      std::shuffle(st.idx.begin(), st.idx.end(), rnd);
+    }
+    else if (verbose_>0)
+      std::cout << std::endl << "=== Resume Epoch " << st.t << " ===" << std::endl;
+    const auto& idx = st.idx;
 
-    for (auto i : idx)
+    if (async_)
     {
-      // restart if calculated results exist
-      if (/*restart_ &&*/ !out_param_.empty())
+      train_async(data, refs, pos_str.second, fm, params, optimizer, st);
+      if (terminate_requested)
+        checkpoint();
+    }
+    else
+      for (size_t b=st.pos; b<idx.size(); b+=batch_size_)
       {
-        std::ifstream is1(SPrintF("%s/%d.param", out_param_.c_str(), k));
-        std::ifstream is2(SPrintF("%s/%d.param", out_param_.c_str(), k+1));
-        if (is1 && is2) { k++; continue; }
-        if (is1 && !is2)
+        // parse the examples in this mini-batch and count their features in
+        // parallel, reading the parameters as regularized
+        const auto view = optimizer.view();
+        const size_t n = std::min<size_t>(batch_size_, idx.size()-b);
+        std::vector<std::string> logs(n);
+        parallel_for(n, threads_, [&](size_t e) {
+            const auto i = idx[b+e];
+            ViterbiParses vp;
+            compute_viterbi(data[i], refs[i], &fm, view, vp);
+            std::ostringstream os;
+            losses[e] = compute_gradients(data[i], vp, grads[e], os);
+            logs[e] = os.str();
+          }, [&](size_t e) { return estimate_cost(data[idx[b+e]]); });
+        fm.merge();
+        optimizer.resize();
+
+        // gradient, reduced in the batch order so that the result does not
+        // depend on the number of threads
+        grad.clear();
+        double eta_w_sum = 0.0;
+        for (size_t e=0; e!=n; ++e)
         {
-          is1.close();
-          params = fm.read_from_file(SPrintF("%s/%d.param", out_param_.c_str(), k));
-          optimizer.read_from_file(SPrintF("%s/%d.param", out_param_.c_str(), k));
-          k++;
-          continue;
+          const auto i = idx[b+e];
+
+          // weight for this instance
+          bool is_weak_label = i>=pos_str.second;
+          auto w = is_weak_label ? weight_weak_labeled_ : 1.0;
+          auto eta_w = is_weak_label ? eta0_weak_labeled_/eta0_ : 1.0;
+          eta_w_sum += eta_w;
+
+          if (verbose_>0)
+            std::cout << "Step: " << st.k << ", Seq: " << data[i].GetNames()[0] << ", " << logs[e];
+          st.loss += losses[e];
+          for (auto j : grads[e])
+            grad[j] += grads[e][j]*w;
         }
-      }
-
-      // weight for this instance
-      bool is_weak_label = i>=pos_str.second;
-      auto w = is_weak_label ? weight_weak_labeled_ : 1.0;
-      auto eta_w = is_weak_label ? eta0_weak_labeled_/eta0_ : 1.0;
 
-      // gradient
-      if (verbose_>0)
-        std::cout << "Step: " << k << ", Seq: " << data[i].GetNames()[0] << ", ";
-      const auto ret = compute_gradients(data[i], &fm, &params);
-      const auto& grad = ret.first;
-      loss += ret.second;
+        // update
+        for (auto j : grad)
+          if (grad[j]!=0.0)
+            optimizer.update(j, grad[j], eta_w_sum/n);
 
-      // update
-      for (auto g : grad)
-        if (g.second!=0.0)
-          optimizer.update(g.first, g.second*w, eta_w);
+        // regularize with the weights of all the examples in the mini-batch
+        optimizer.regularize_all(eta_w_sum);
 
-      // regularize
-      optimizer.regularize_all(eta_w);
+        optimizer.proceed_timestamp();
+        if (verbose_>2 && !out_param_.empty())
+        {
+          //fm.write_to_file(SPrintF("%s/%d.param", out_param_.c_str(), k++), params);
+          optimizer.write_to_file(SPrintF("%s/%d.param", out_param_.c_str(), st.k));
+        }
 
-      optimizer.proceed_timestamp();
-      if (verbose_>2 && !out_param_.empty())
-      {
-        //fm.write_to_file(SPrintF("%s/%d.param", out_param_.c_str(), k++), params);
-        optimizer.write_to_file(SPrintF("%s/%d.param", out_param_.c_str(), k));
+        st.k++;
+        st.pos = b+n;
+        if (terminate_requested || st.k%checkpoint_interval_==0)
+          checkpoint();
       }
 
-      k++;
-    }
-
     if (!out_param_.empty())
     {
       //fm.write_to_file(SPrintF("%s/%d.param", out_param_.c_str(), k++), params);
-      optimizer.write_to_file(SPrintF("%s/Epoch%d.param", out_param_.c_str(), t));
+      optimizer.write_to_file(SPrintF("%s/Epoch%d.param", out_param_.c_str(), st.t));
     }
 
     if (verbose_>0)
       std::cout << std::endl 
-                << "=== Finish Epoch " << t 
-                << ", Loss = " << loss << " ===" 
+                << "=== Finish Epoch " << st.t 
+                << ", Loss = " << st.loss << " ===" 
                 << std::endl;
+
+    st.t++;
+    st.pos = 0;
+    st.idx.clear();
+    checkpoint();
   }
 
   //fm.write_to_file(out_file_, params);
   optimizer.write_to_file(out_file_);
+  writer.wait();
+  if (!checkpoint_file_.empty())
+    std::signal(SIGTERM, SIG_DFL);
+
+  return 0;
+}
+
+// Hogwild-style asynchronous training: each thread parses an example
+// against the shared parameters, which the other threads may be
+// updating at the same time, and then applies its update to them
+// without waiting for the others.  The parameters are read and updated
+// in place with relaxed atomic operations, so that they are sized once
+// here; the updates of the features registered meanwhile are kept by
+// each thread until the feature map is merged after the threads finish.
+// The threads stop taking the examples when SIGTERM arrives, so that
+// the examples before st.pos are exactly those already used.
+void
+MXfold::
+train_async(const std::vector<SStruct>& data, const std::vector<ReferenceCounts>& refs, uint n_str,
+            FeatureMap& fm, std::vector<param_value_type>& params, AdaGradFobosUpdater& optimizer,
+            TrainingState& st) const
+{
+  const auto& idx = st.idx;
+  std::mutex mtx;                       // for the log, the dumps and the error
+  std::atomic<size_t> next(st.pos);
+  std::atomic<uint> k(st.k);
+  std::atomic<bool> failed(false);
+  std::exception_ptr error;
+
+  fm.merge();
+  optimizer.resize();
+  const auto n_params = params.size();
+  const auto view = optimizer.view();
+
+  // the updates of the features out of the parameters, and the losses
+  struct Deferred { size_t j; double g; double w; };
+  std::vector<std::vector<Deferred>> deferred(threads_);
+  std::vector<float> losses(threads_, 0.0);
+
+  std::vector<std::thread> workers;
+  for (int th=0; th!=threads_; ++th)
+  {
+    workers.emplace_back([&, th]() {
+        FeatureCounts<param_value_type> grad(fm.size());
+        try
+        {
+          while (!terminate_requested && !failed)
+          {
+            const size_t e = next++;
+            if (e>=idx.size()) break;
+            const auto i = idx[e];
+
+            ViterbiParses vp;
+            compute_viterbi(data[i], refs[i], &fm, view, vp);
+            std::ostringstream os;
+            const auto l = compute_gradients(data[i], vp, grad, os);
+
+            // weight for this instance
+            bool is_weak_label = i>=n_str;
+            auto w = is_weak_label ? weight_weak_labeled_ : 1.0;
+            auto eta_w = is_weak_label ? eta0_weak_labeled_/eta0_ : 1.0;
+
+            const auto step = k++;
+            if (verbose_>0)
+            {
+              std::lock_guard<std::mutex> lock(mtx);
+              std::cout << "Step: " << step << ", Seq: " << data[i].GetNames()[0] << ", " << os.str();
+            }
+            losses[th] += l;
+
+            // update
+            for (auto j : grad)
+              if (grad[j]!=0.0)
+              {
+                if (j<n_params)
+                  optimizer.update(j, grad[j]*w, eta_w);
+                else
+                  deferred[th].push_back({j, grad[j]*w, eta_w});
+              }
+
+            // regularize
+            optimizer.regularize_all(eta_w);
+
+            optimizer.proceed_timestamp();
+            if (verbose_>2 && !out_param_.empty())
+            {
+              std::lock_guard<std::mutex> lock(mtx);
+              optimizer.write_to_file(SPrintF("%s/%d.param", out_param_.c_str(), step));
+            }
+          }
+        }
+        catch (...)
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          if (!error) error = std::current_exception();
+          failed = true;
+        }
+      });
+  }
+
+  for (auto& w : workers)
+    w.join();
+  fm.merge();
+  optimizer.resize();
+  if (error)
+    std::rethrow_exception(error);
+
+  for (int th=0; th!=threads_; ++th)
+  {
+    for (const auto& d : deferred[th])
+      optimizer.update(d.j, d.g, d.w);
+    st.loss += losses[th];
+  }
+  st.k = k;
+  st.pos = std::min<size_t>(next, idx.size());
+}
+
+// the checkpoint consists of the training state, the state of the random
+// number generator and that of the optimizer, i.e. the feature table, the
+// parameters and the squared gradients.
+static const char checkpoint_magic[8] = { 'M', 'X', 'F', 'C', 'K', 'P', 'T', '1' };
+
+std::string
+MXfold::
+write_checkpoint(const TrainingState& st, const std::mt19937& rnd, size_t n_data,
+                 AdaGradFobosUpdater& optimizer) const
+{
+  std::ostringstream os;
+  os.write(checkpoint_magic, sizeof(checkpoint_magic));
+  WriteBinary(os, static_cast<unsigned long long>(n_data));
+  WriteBinary(os, st.t);
+  WriteBinary(os, st.k);
+  WriteBinary(os, static_cast<unsigned long long>(st.pos));
+  WriteBinary(os, st.loss);
+  WriteBinary(os, st.idx);
+  std::ostringstream r;
+  r << rnd;
+  WriteBinary(os, r.str());
+  optimizer.write_binary(os);
+  return os.str();
+}
+
+// returns false if there is no checkpoint.  The feature map of the
+// optimizer must be the one just constructed.
+bool
+MXfold::
+read_checkpoint(TrainingState& st, std::mt19937& rnd, size_t n_data,
+                AdaGradFobosUpdater& optimizer) const
+{
+  std::ifstream ifs(checkpoint_file_.c_str(), std::ios::binary);
+  if (!ifs) return false;
+  std::ostringstream buf;
+  buf << ifs.rdbuf();
+  std::istringstream is(buf.str());
+
+  char magic[sizeof(checkpoint_magic)];
+  if (!is.read(magic, sizeof(magic)) || !std::equal(magic, magic+sizeof(magic), checkpoint_magic))
+    throw std::runtime_error("Not a checkpoint: " + checkpoint_file_);
+  unsigned long long n, pos;
+  ReadBinary(is, n);
+  if (n!=n_data)
+    throw std::runtime_error("The checkpoint is not of this training data: " + checkpoint_file_);
+  ReadBinary(is, st.t);
+  ReadBinary(is, st.k);
+  ReadBinary(is, pos);
+  st.pos = pos;
+  ReadBinary(is, st.loss);
+  ReadBinary(is, st.idx);
+  std::string r;
+  ReadBinary(is, r);
+  std::istringstream(r) >> rnd;
+  optimizer.read_binary(is);
+  return true;
+}
+
+// the time to parse a sequence, which is cubic in its length unless the
+// span of the base pairs is limited.
+double
+MXfold::
+estimate_cost(const SStruct& s) const
+{
+  const double L = s.GetLength();
+  const double W = max_span_>0 ? std::min<double>(L, max_span_) : L;
+  return L*W*W;
+}
+
+// the training data are packed as they are read, i.e. before the
+// reactivity is discretized, so that they can be trained with any options.
+int
+MXfold::pack()
+{
+  std::vector<SStruct> data;
+  auto pos_str = read_data(data, data_list_, SStruct::NO_REACTIVITY);
+  auto pos_weak = read_data(data, data_weak_list_, SStruct::REACTIVITY_PAIRED);
+  SStructPack::Write(pack_file_, data);
+
+  if (verbose_>0)
+    std::cout << "Packed " << pos_str.second-pos_str.first << " structures and "
+              << pos_weak.second-pos_weak.first << " reactivity data into " << pack_file_ << std::endl;
 
   return 0;
 }
@@ -402,8 +1117,8 @@ int
 MXfold::predict()
 {
   // set parameters
-  FeatureMap fm, fm2;
-  std::vector<param_value_type> params, params2;
+  FeatureMap fm;
+  std::vector<param_value_type> params;
 
   if (!param_file_.empty())
     params = fm.read_from_file(param_file_);
@@ -419,68 +1134,427 @@ MXfold::predict()
       params = fm.load_from_hash(trained_params_complementary);
 
   // predict ss
-  InferenceEngine<param_value_type> inference_engine(with_turner_, noncomplementary_,
-                                                     DEFAULT_C_MAX_SINGLE_LENGTH, max_single_nucleotides_length,
-                                                     DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length, max_span_);
-  inference_engine.LoadValues(&fm, &params);
+  if (threads_==1)
+  {
+    InferenceEngine<param_value_type> inference_engine(with_turner_, noncomplementary_,
+                                                       DEFAULT_C_MAX_SINGLE_LENGTH, max_single_nucleotides_length,
+                                                       DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length, max_span_);
+    inference_engine.LoadValues(&fm, &params);
+    inference_engine.UseThreads(dp_threads_);
+    inference_engine.UseCheckpoints(low_memory_);
 
-  for (auto s : args_)
+    for (auto s : args_)
+    {
+      SStructReader reader(s, use_soft_constraints_ ? SStruct::REACTIVITY_PAIRED : SStruct::NO_REACTIVITY);
+      SStruct sstruct;
+      while (reader.Read(sstruct))
+        predict(inference_engine, sstruct, &fm, std::cout, std::cerr);
+    }
+
+    return 0;
+  }
+
+  // the input files are read one record at a time by the workers
+  size_t next_arg = 0;
+  std::unique_ptr<SStructReader> reader;
+  auto read_next = [&](SStruct& sstruct) {
+    while (true)
+    {
+      if (!reader)
+      {
+        if (next_arg==args_.size()) return false;
+        reader.reset(new SStructReader(args_[next_arg++],
+                                       use_soft_constraints_ ? SStruct::REACTIVITY_PAIRED : SStruct::NO_REACTIVITY));
+      }
+      if (reader->Read(sstruct)) return true;
+      reader.reset();
+    }
+  };
+
+  // each worker owns its inference engine sharing the read-only parameters,
+  // and the results are written in the input order through a reorder buffer.
+  // The records within the window are read ahead, and the most expensive
+  // of them is taken first.
+  std::mutex mtx;
+  std::condition_variable cv;
+  std::map<size_t, std::pair<std::string,std::string>> done;
+  std::multimap<double, std::pair<size_t, SStruct>> pending;
+  const size_t window = 4*threads_;
+  size_t next_job = 0, next_out = 0;
+  bool exhausted = false;
+  std::exception_ptr error;
+
+  std::vector<std::thread> workers;
+  for (int t=0; t!=threads_; ++t)
   {
-    SStruct sstruct;
-    sstruct.Load(s, use_soft_constraints_ ? SStruct::REACTIVITY_PAIRED : SStruct::NO_REACTIVITY);
-    inference_engine.LoadSequence(sstruct);
-    if (use_constraints_)
-      inference_engine.UseConstraints(sstruct.GetMapping());
-    if (use_soft_constraints_)
-      inference_engine.UseSoftConstraints(sstruct.GetReactivityPair(), scale_reactivity_);
+    workers.emplace_back([&]() {
+        InferenceEngine<param_value_type> inference_engine(with_turner_, noncomplementary_,
+                                                           DEFAULT_C_MAX_SINGLE_LENGTH, max_single_nucleotides_length,
+                                                           DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length, max_span_);
+        inference_engine.LoadValues(&fm, &params);
+        inference_engine.UseThreads(dp_threads_);
+        inference_engine.UseCheckpoints(low_memory_);
+        while (true)
+        {
+          size_t i;
+          SStruct sstruct;
+          {
+            std::unique_lock<std::mutex> lock(mtx);
+            while (true)
+            {
+              if (error) return;
+              if (!exhausted && next_job<next_out+window)
+              {
+                if (read_next(sstruct))
+                {
+                  const auto c = estimate_cost(sstruct);
+                  pending.emplace(c, std::make_pair(next_job++, std::move(sstruct)));
+                }
+                else
+                {
+                  exhausted = true;
+                  cv.notify_all();
+                }
+                continue;
+              }
+              if (!pending.empty()) break;
+              if (exhausted) return;
+              cv.wait(lock);
+            }
+            auto p = std::prev(pending.end());
+            i = p->second.first;
+            sstruct = std::move(p->second.second);
+            pending.erase(p);
+          }
+
+          std::ostringstream os, es;
+          try
+          {
+            predict(inference_engine, sstruct, &fm, os, es);
+          }
+          catch (...)
+          {
+            std::lock_guard<std::mutex> lock(mtx);
+            if (!error) error = std::current_exception();
+            cv.notify_all();
+            return;
+          }
+
+          {
+            std::lock_guard<std::mutex> lock(mtx);
+            done.emplace(i, std::make_pair(os.str(), es.str()));
+          }
+          cv.notify_all();
+        }
+      });
+  }
 
-    SStruct solution(sstruct);
-    if (!mea_ && !gce_)
+  {
+    std::unique_lock<std::mutex> lock(mtx);
+    while (true)
     {
-      inference_engine.ComputeViterbi();
-      solution.SetMapping(inference_engine.PredictPairingsViterbi());
+      cv.wait(lock, [&]() { return error || done.count(next_out)>0 || (exhausted && next_out==next_job); });
+      if (error || done.count(next_out)==0) break;
+      auto p = done.find(next_out);
+      auto res = std::move(p->second);
+      done.erase(p);
+      lock.unlock();
+      std::cout << res.first << std::flush;
+      std::cerr << res.second;
+      lock.lock();
+      ++next_out;
+      cv.notify_all();
     }
+  }
+
+  for (auto& w : workers)
+    w.join();
+  if (error)
+    std::rethrow_exception(error);
+
+  return 0;
+}
+
+void
+MXfold::
+predict(InferenceEngine<param_value_type>& inference_engine, const SStruct& sstruct, FeatureMap* fm,
+        std::ostream& os, std::ostream& es) const
+{
+  std::vector<param_value_type> params2;
+
+  inference_engine.LoadSequence(sstruct);
+  if (use_constraints_)
+    inference_engine.UseConstraints(sstruct.GetMapping());
+  if (use_soft_constraints_)
+    inference_engine.UseSoftConstraints(sstruct.GetReactivityPair(), scale_reactivity_);
+
+  SStruct solution(sstruct);
+  if (!mea_ && !gce_)
+  {
+    inference_engine.ComputeViterbi();
+    solution.SetMapping(inference_engine.PredictPairingsViterbi());
+  }
+  else
+  {
+    inference_engine.ComputeInside();
+    inference_engine.ComputeOutside();
+    inference_engine.ComputePosterior();
+    if (mea_)
+      solution.SetMapping(inference_engine.PredictPairingsPosterior<0>(gamma_[0]));
     else
+      solution.SetMapping(inference_engine.PredictPairingsPosterior<1>(gamma_[0]));
+  }
+
+  if (output_bpseq_)
+    solution.WriteBPSEQ(os);
+  else
+    solution.WriteParens(os);
+
+  if (verbose_>0)
+  {
+    if (!mea_ && !gce_)
     {
-      inference_engine.ComputeInside();
-      inference_engine.ComputeOutside();
-      inference_engine.ComputePosterior();
-      if (mea_)
-        solution.SetMapping(inference_engine.PredictPairingsPosterior<0>(gamma_[0]));
-      else
-        solution.SetMapping(inference_engine.PredictPairingsPosterior<1>(gamma_[0]));
+      auto v = inference_engine.GetViterbiScore();
+      es << "Viterbi score: " <<  v;
+
+      if (with_turner_)
+      {
+        InferenceEngine<param_value_type> inference_engine2(true, noncomplementary_,
+                                                            DEFAULT_C_MAX_SINGLE_LENGTH, max_single_nucleotides_length,
+                                                            DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length, max_span_);
+        inference_engine2.LoadValues(fm, &params2);
+        auto e = inference_engine2.EvaluateStructure(solution);
+        es << " ( " << v-e << " + " << e << " )";
+      }
+      es << std::endl;
     }
+  }
+}
 
-    if (output_bpseq_)
-      solution.WriteBPSEQ(std::cout);
+// Local folding and scan modes: the windows sliding along each
+// sequence are folded independently, up to one per thread at a time,
+// and the results are written as soon as the windows have passed them.
+// The sequences are read in chunks, so that neither a sequence nor a
+// matrix over its length is held in memory.
+int
+MXfold::local()
+{
+  // set parameters
+  FeatureMap fm;
+  std::vector<param_value_type> params;
+
+  if (!param_file_.empty())
+    params = fm.read_from_file(param_file_);
+  else if (!with_turner_)
+    if (noncomplementary_)
+      params = fm.load_from_hash(default_params_noncomplementary);
+    else
+      params = fm.load_from_hash(default_params_complementary);
+  else
+    if (noncomplementary_)
+      params = fm.load_from_hash(default_params_noncomplementary);
     else
-      solution.WriteParens(std::cout);
+      params = fm.load_from_hash(trained_params_complementary);
 
-    if (verbose_>0)
+  // the span defaults to the window size for the local folding, and to
+  // the half of it for the scan, whose windows overlap by the span
+  const int span = scan_mode_ ?
+    (max_span_>0 ? std::min(max_span_, window_-1) : window_/2) :
+    (max_span_>0 ? std::min(max_span_, window_) : window_);
+  std::vector<std::unique_ptr<InferenceEngine<param_value_type>>> engines;
+  for (int t=0; t!=threads_; ++t)
+  {
+    engines.emplace_back(new InferenceEngine<param_value_type>(with_turner_, noncomplementary_,
+                                                               DEFAULT_C_MAX_SINGLE_LENGTH, max_single_nucleotides_length,
+                                                               DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length, span));
+    engines.back()->LoadValues(&fm, &params);
+    engines.back()->UseThreads(dp_threads_);
+  }
+
+  for (auto s : args_)
+  {
+    SequenceStreamReader reader(s);
+    std::string name;
+    while (reader.NextRecord(name))
+      if (scan_mode_)
+        scan(engines, span, reader, name, std::cout);
+      else
+        local(engines, span, reader, name, std::cout);
+  }
+
+  return 0;
+}
+
+// writes a line for each position i: i, the averaged probability that
+// i is unpaired, and j:p for each pair (i,j), i<j, whose averaged
+// probability p is at least the cutoff.  The windows start every
+// window_step_ bases, so the default of 10 averages over a tenth of
+// the windows containing each pair; with 1, the averages are those of
+// RNAplfold over all of them, as each window is folded on its own.
+// Only the sums over the windows for the positions not yet written
+// are kept.
+void
+MXfold::
+local(std::vector<std::unique_ptr<InferenceEngine<param_value_type>>>& engines, int span,
+      SequenceStreamReader& reader, const std::string& name, std::ostream& os) const
+{
+  const int W = window_;
+  const int S = std::min(span, W-1);
+  const int step = std::min(window_step_, W);
+  SlidingWindows windows(reader, W, step);
+
+  // the sums and the numbers of the windows for each position and for
+  // each pair (i,i+d), 1<=d<=S, kept in a ring over the positions
+  const int R = W + (engines.size()-1)*step;
+  std::vector<float> sum_unpaired(R, 0.0f), sum_pair(R*S, 0.0f);
+  std::vector<int> n_unpaired(R, 0), n_pair(R*S, 0);
+  std::vector<float> unpaired(W);
+
+  os << ">" << name << std::endl;
+  const auto precision = os.precision(4);
+  int next = 1;
+  auto write = [&](int end) {
+    for (; next<end; ++next)
     {
-      if (!mea_ && !gce_)
+      const int r = next % R;
+      os << next << " " << sum_unpaired[r]/n_unpaired[r];
+      for (int d=1; d<=S; ++d)
       {
-        auto v = inference_engine.GetViterbiScore();
-        std::cerr << "Viterbi score: " <<  v;
+        auto& p = sum_pair[r*S+d-1];
+        auto& n = n_pair[r*S+d-1];
+        if (n>0 && p/n>=cutoff_)
+          os << " " << next+d << ":" << p/n;
+        p = 0.0f;
+        n = 0;
+      }
+      os << "\n";
+      sum_unpaired[r] = 0.0f;
+      n_unpaired[r] = 0;
+    }
+  };
 
-        if (with_turner_)
+  std::vector<int> starts(engines.size());
+  std::vector<std::string> seqs(engines.size());
+  while (true)
+  {
+    // the next windows, one for each engine
+    size_t n = 0;
+    bool last;
+    while (n<engines.size() && windows.next(starts[n], seqs[n], last))
+      ++n;
+    if (n==0) break;
+
+    // no window after these reaches before the first of them
+    write(starts[0]);
+
+    parallel_for(n, threads_, [&](size_t k) {
+        SStruct window;
+        window.LoadRecord(name, seqs[k]);
+        engines[k]->LoadSequence(window);
+        engines[k]->ComputeInside();
+        engines[k]->ComputeOutside();
+        engines[k]->ComputePosterior();
+      });
+
+    // the windows are summed in order, so that the result does not
+    // depend on the number of threads
+    for (size_t k=0; k!=n; ++k)
+    {
+      const int s = starts[k];
+      const int len = seqs[k].size();
+      std::fill(unpaired.begin(), unpaired.end(), 1.0f);
+      for (int i=1; i<=len; ++i)
+      {
+        const int r = (s+i-1) % R;
+        for (int d=1; d<=S && i+d<=len; ++d)
         {
-          InferenceEngine<param_value_type> inference_engine2(true, noncomplementary_,
-                                                              DEFAULT_C_MAX_SINGLE_LENGTH, max_single_nucleotides_length,
-                                                              DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length, max_span_);
-          inference_engine2.LoadValues(&fm, &params2);
-          inference_engine2.LoadSequence(sstruct);
-          inference_engine2.UseConstraints(solution.GetMapping());
-          inference_engine2.ComputeViterbi();
-          auto e = inference_engine2.GetViterbiScore();
-          std::cerr << " ( " << v-e << " + " << e << " )";
+          const float p = engines[k]->GetPosterior(i, i+d);
+          sum_pair[r*S+d-1] += p;
+          n_pair[r*S+d-1]++;
+          unpaired[i-1] -= p;
+          unpaired[i+d-1] -= p;
         }
-        std::cerr << std::endl;
+        sum_unpaired[r] += std::max(0.0f, unpaired[i-1]);
+        n_unpaired[r]++;
       }
     }
+    os << std::flush;
   }
+  write(windows.length()+1);
 
-  return 0;
+  os.precision(precision);
+  os << std::flush;
+}
+
+// writes a line "i j score structure" for each of the outermost pairs
+// (i,j) of the Viterbi structures of the windows, with the score of
+// the structure of the bases from i to j on its own.  The windows of
+// window_ bases overlap by the span, so that each window writes the
+// pairs starting within its first window_-span bases, whose structures
+// are within the window, and the last window writes the rest.
+void
+MXfold::
+scan(std::vector<std::unique_ptr<InferenceEngine<param_value_type>>>& engines, int span,
+     SequenceStreamReader& reader, const std::string& name, std::ostream& os) const
+{
+  const int step = window_-span;
+  SlidingWindows windows(reader, window_, step);
+
+  struct Structure
+  {
+    int i, j;
+    param_value_type score;
+    std::string parens;
+  };
+
+  os << ">" << name << std::endl;
+  int covered = 1;
+  std::vector<int> starts(engines.size());
+  std::vector<std::string> seqs(engines.size());
+  std::vector<std::vector<Structure>> loops(engines.size());
+  std::vector<bool> lasts(engines.size());
+  while (true)
+  {
+    // the next windows, one for each engine
+    size_t n = 0;
+    bool last;
+    while (n<engines.size() && windows.next(starts[n], seqs[n], last))
+      lasts[n++] = last;
+    if (n==0) break;
+
+    parallel_for(n, threads_, [&](size_t k) {
+        SStruct window;
+        window.LoadRecord(name, seqs[k]);
+        engines[k]->LoadSequence(window);
+        engines[k]->ComputeViterbi();
+        const auto mapping = engines[k]->PredictPairingsViterbi();
+
+        loops[k].clear();
+        for (int i=1; i<int(mapping.size()); ++i)
+        {
+          if (mapping[i]<=i) continue;
+          const int j = mapping[i];
+          std::vector<int> m(1, SStruct::UNKNOWN);
+          for (int p=i; p<=j; ++p)
+            m.push_back(mapping[p]>0 ? mapping[p]-i+1 : SStruct::UNPAIRED);
+          SStruct s;
+          s.LoadRecord(name, seqs[k].substr(i-1, j-i+1));
+          s.SetMapping(m);
+          loops[k].push_back({ starts[k]+i-1, starts[k]+j-1, engines[k]->EvaluateStructure(s), s.GetParens() });
+          i = j;
+        }
+      });
+
+    for (size_t k=0; k!=n; ++k)
+    {
+      const int end = lasts[k] ? starts[k]+int(seqs[k].size())-1 : starts[k]+step-1;
+      for (const auto& l : loops[k])
+        if (l.i>=covered && l.i<=end)
+          os << l.i << " " << l.j << " " << l.score << " " << l.parens << "\n";
+      covered = end+1;
+    }
+    os << std::flush;
+  }
 }
 
 int
@@ -512,13 +1586,19 @@ MXfold::validate()
                                                        std::max<int>(sstruct.GetLength()/2., DEFAULT_C_MAX_SINGLE_LENGTH), max_single_nucleotides_length,
                                                        DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length);
     inference_engine.LoadValues(&fm, &params);
-    inference_engine.LoadSequence(sstruct);
-    inference_engine.UseConstraints(sstruct.GetMapping());
-    inference_engine.ComputeViterbi();
-    auto score = inference_engine.GetViterbiScore();
+    param_value_type score;
+    if (fully_given(sstruct))
+      score = inference_engine.EvaluateStructure(sstruct);
+    else
+    {
+      inference_engine.LoadSequence(sstruct);
+      inference_engine.UseConstraints(sstruct.GetMapping());
+      inference_engine.ComputeViterbi();
+      score = inference_engine.GetViterbiScore();
+    }
     std::cout << sstruct.GetNames()[0] << " "
-              << (score>NEG_INF ? "OK" : "NG") << std::endl;
-    if (score==NEG_INF)
+              << (score>param_value_type(NEG_INF/2) ? "OK" : "NG") << std::endl;
+    if (score<=param_value_type(NEG_INF/2))
     {
       sstruct.WriteParens(std::cout); // for debug
       std::cout << std::endl;
@@ -549,7 +1629,7 @@ MXfold::count_features()
     else
       params = fm.load_from_hash(trained_params_complementary);
 
-  std::unordered_map<size_t, param_value_type> cnt;
+  FeatureCounts<param_value_type> cnt(fm.size());
   for (auto s : args_)
   {
     SStruct sstruct;
@@ -559,22 +1639,103 @@ MXfold::count_features()
                                                        std::max<int>(sstruct.GetLength()/2., DEFAULT_C_MAX_SINGLE_LENGTH), max_single_nucleotides_length,
                                                        DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length);
     inference_engine.LoadValues(&fm, &params);
+    if (fully_given(sstruct))
+    {
+      inference_engine.EvaluateStructure(sstruct, &cnt);
+      continue;
+    }
     inference_engine.LoadSequence(sstruct);
     inference_engine.UseConstraints(sstruct.GetMapping());
     inference_engine.ComputeViterbi();
-    auto corr = inference_engine.ComputeViterbiFeatureCounts();
-    for (auto p=corr.begin(); p!=corr.end(); ++p)
-      if (p->second!=0.0)
-        cnt.emplace(p->first, 0.0).first->second += p->second;
+    inference_engine.ComputeViterbiFeatureCounts(cnt);
   }
 
   std::vector<size_t> idx;
-  for (auto e : cnt)
-    idx.emplace_back(e.first);
+  for (auto i : cnt)
+    if (cnt[i]!=0.0)
+      idx.emplace_back(i);
   std::sort(idx.begin(), idx.end(),
             [&](size_t i, size_t j) { return fm.name(i) < fm.name(j); } );
   for (auto i : idx)
-    std::cout << fm.name(i) << " " << cnt.find(i)->second << std::endl;
+    std::cout << fm.name(i) << " " << cnt[i] << std::endl;
+
+  return 0;
+}
+
+// score each of the structure records following a sequence, e.g.
+//   >name
+//   SEQUENCE
+//   >structure
+//   ((...))..
+//   >structure
+//   (.....)..
+// or the single structure record preceding a sequence
+int
+MXfold::evaluate()
+{
+  // set parameters
+  FeatureMap fm;
+  std::vector<param_value_type> params, params2;
+
+  if (!param_file_.empty())
+    params = fm.read_from_file(param_file_);
+  else if (!with_turner_)
+    if (noncomplementary_)
+      params = fm.load_from_hash(default_params_noncomplementary);
+    else
+      params = fm.load_from_hash(default_params_complementary);
+  else
+    if (noncomplementary_)
+      params = fm.load_from_hash(default_params_noncomplementary);
+    else
+      params = fm.load_from_hash(trained_params_complementary);
+
+  for (auto s : args_)
+  {
+    SStructReader reader(s);
+    std::vector<SStruct> sstructs;
+    while (reader.ReadStructures(sstructs))
+    {
+      const auto& sstruct = sstructs.front();
+      InferenceEngine<param_value_type> inference_engine(with_turner_, noncomplementary_,
+                                                         std::max<int>(sstruct.GetLength()/2., DEFAULT_C_MAX_SINGLE_LENGTH), max_single_nucleotides_length,
+                                                         DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length, max_span_);
+      inference_engine.LoadValues(&fm, &params);
+      std::unique_ptr<InferenceEngine<param_value_type>> inference_engine2;
+      if (verbose_>0 && with_turner_)
+      {
+        inference_engine2.reset(new InferenceEngine<param_value_type>(true, noncomplementary_,
+                                                                      std::max<int>(sstruct.GetLength()/2., DEFAULT_C_MAX_SINGLE_LENGTH), max_single_nucleotides_length,
+                                                                      DEFAULT_C_MIN_HAIRPIN_LENGTH, max_hairpin_nucleotides_length, max_span_));
+        inference_engine2->LoadValues(&fm, &params2);
+      }
+
+      std::cout << ">" << sstruct.GetNames()[0] << std::endl
+                << sstruct.GetSequences()[0].substr(1) << std::endl;
+      for (const auto& t : sstructs)
+      {
+        if (t.ContainsPseudoknots())
+        {
+          std::cout << "pseudoknotted NG" << std::endl;
+          continue;
+        }
+        std::cout << t.GetParens() << " ";
+        auto v = fully_given(t) ? inference_engine.EvaluateStructure(t) : param_value_type(NEG_INF);
+        if (v<=param_value_type(NEG_INF/2))
+        {
+          std::cout << "NG" << std::endl;
+          continue;
+        }
+        std::cout << v;
+        if (inference_engine2)
+        {
+          auto e = inference_engine2->EvaluateStructure(t);
+          std::cout << " ( " << v-e << " + " << e << " )";
+        }
+        std::cout << std::endl;
+      }
+    }
+  }
 
   return 0;
 }
@@ -0,0 +1,116 @@
+//////////////////////////////////////////////////////////////////////
+// LogSpaceTest.cpp
+//
+// Accuracy test of Fast_LogSumPlus() against a chain of
+// Fast_LogPlusEquals() calls and a double-precision reference.
+//////////////////////////////////////////////////////////////////////
+
+#include "LogSpace.hpp"
+#include <random>
+
+namespace {
+
+// log SUM (0<=k<n : exp(a[k]+b[k])) in double precision, where the
+// terms at or below NEG_INF/2 count as zero
+template<class T>
+double Reference(const T *a, const T *b, int n)
+{
+    double m = NEG_INF;
+    for (int k = 0; k < n; k++)
+        if (double(a[k])+double(b[k]) > double(NEG_INF/2))
+            m = std::max(m, double(a[k])+double(b[k]));
+    if (m <= double(NEG_INF/2)) return NEG_INF;
+
+    double sum = 0;
+    for (int k = 0; k < n; k++)
+        if (double(a[k])+double(b[k]) > double(NEG_INF/2))
+            sum += exp(double(a[k])+double(b[k])-m);
+    return m + log(sum);
+}
+
+template<class T>
+T Chain(const T *a, const T *b, int n)
+{
+    T x = T(NEG_INF);
+    for (int k = 0; k < n; k++)
+        Fast_LogPlusEquals(x, a[k]+b[k]);
+    return x;
+}
+
+// compare Fast_LogSumPlus() on random inputs of every length up to
+// max_n, with a fraction of the lanes set to NEG_INF, and return the
+// number of failures
+template<class T>
+int Check(const char *name, std::mt19937 &rng, int max_n, int trials, double tol_ref, double tol_chain)
+{
+    std::uniform_real_distribution<double> value(-25.0, 5.0);
+    std::uniform_real_distribution<double> coin(0.0, 1.0);
+    int failures = 0;
+    double max_ref = 0, max_chain = 0;
+
+    for (int n = 0; n <= max_n; n++)
+    {
+        for (int t = 0; t < trials; t++)
+        {
+            // few, many, all or none of the lanes at NEG_INF
+            const double p_inf = t % 3 == 0 ? 0.1 : t % 3 == 1 ? 0.7 : (t % 2 ? 1.0 : 0.0);
+            std::vector<T> a(n+1), b(n+1);
+            for (int k = 1; k <= n; k++)
+            {
+                a[k] = coin(rng) < p_inf ? T(NEG_INF) : T(value(rng));
+                b[k] = coin(rng) < p_inf/2 ? T(NEG_INF) : T(value(rng));
+            }
+
+            // the terms start off the vector alignment as in the inside pass
+            const T fast = Fast_LogSumPlus(a.data()+1, b.data()+1, n);
+            const T chain = Chain(a.data()+1, b.data()+1, n);
+            const double ref = Reference(a.data()+1, b.data()+1, n);
+
+            if (ref <= double(NEG_INF/2))
+            {
+                if (fast > T(NEG_INF/2) || chain > T(NEG_INF/2))
+                {
+                    std::cerr << name << ": n=" << n << ": expected NEG_INF, got "
+                              << fast << " (chain " << chain << ")" << std::endl;
+                    failures++;
+                }
+                continue;
+            }
+
+            const double d_ref = std::abs(double(fast)-ref);
+            const double d_chain = std::abs(double(fast)-double(chain));
+            max_ref = std::max(max_ref, d_ref);
+            max_chain = std::max(max_chain, d_chain);
+            if (!(d_ref <= tol_ref) || !(d_chain <= tol_chain))
+            {
+                std::cerr << name << ": n=" << n << ": Fast_LogSumPlus " << fast
+                          << ", chain " << chain << ", reference " << ref << std::endl;
+                failures++;
+            }
+        }
+    }
+
+    std::cout << name << ": max error " << max_ref << " from the reference, "
+              << max_chain << " from the chain, " << failures << " failures" << std::endl;
+    return failures;
+}
+
+}
+
+int main()
+{
+    std::mt19937 rng(20170424);
+    int failures = 0;
+
+    // the chain of float Fast_LogPlusEquals() calls uses piecewise
+    // polynomials with an absolute error of about 5e-05 per call
+    failures += Check<float>("float", rng, 67, 200, 1e-5, 5e-4);
+    failures += Check<double>("double", rng, 67, 50, 1e-12, 1e-12);
+
+    return failures == 0 ? 0 : 1;
+}
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// End:
@@ -0,0 +1,86 @@
+//////////////////////////////////////////////////////////////////////
+// TurnerTest.cpp
+//
+// Regression test of the Turner energies of structures whose first
+// base pairs, against the energies computed from the sequence
+// encoding of a vrna_fold_compound as the original code did.
+//////////////////////////////////////////////////////////////////////
+
+#include "InferenceEngine.hpp"
+#include <cmath>
+
+namespace {
+
+// the Turner score (-kcal/mol) of a structure of one helix closed by a
+// hairpin, decomposed as EvaluateStructure() does
+double Reference(const std::string &seq, const std::vector<int> &mapping)
+{
+    VIENNA::vrna_md_t md;
+    vrna_md_set_default(&md);
+    VIENNA::vrna_fold_compound_t *vc = vrna_fold_compound(seq.c_str(), &md, 0);
+    const short *S = vc->sequence_encoding;
+    VIENNA::vrna_param_t *P = vc->params;
+
+    int i = 1;
+    while (mapping[i] <= 0) i++;
+    int j = mapping[i];
+    double energy = VIENNA::E_ExtLoop(md.pair[S[j]][S[i]], S[j+1], S[i-1], P);
+    while (mapping[i+1] == j-1)
+    {
+        energy += VIENNA::E_IntLoop(0, 0, md.pair[S[i]][S[j]], md.pair[S[j-1]][S[i+1]],
+                                    S[i+1], S[j-1], S[i], S[j], P);
+        ++i; --j;
+    }
+    energy += VIENNA::E_Hairpin(j-1-i, md.pair[S[i]][S[j]], S[i+1], S[j-1], &seq[i-1], P);
+
+    vrna_fold_compound_free(vc);
+    return energy / -100.;
+}
+
+// compare the score of the structure by EvaluateStructure() and by the
+// Viterbi parse constrained to it with the reference, and return the
+// number of failures
+int Check(const std::string &seq, const std::string &parens)
+{
+    SStruct s;
+    s.LoadRecord("test", seq, parens);
+    const double ref = Reference(seq, s.GetMapping());
+
+    FeatureMap fm;
+    std::vector<param_value_type> params;
+    InferenceEngine<param_value_type> engine(true, false);
+    engine.LoadValues(&fm, &params);
+    const double eval = engine.EvaluateStructure(s);
+
+    engine.LoadSequence(s);
+    engine.UseConstraints(s.GetMapping());
+    engine.ComputeViterbi();
+    const double viterbi = engine.GetViterbiScore();
+
+    std::cout << seq << " " << parens << ": reference " << ref
+              << ", EvaluateStructure " << eval << ", Viterbi " << viterbi << std::endl;
+    return std::abs(eval-ref) <= 1e-4 && std::abs(viterbi-ref) <= 1e-4 ? 0 : 1;
+}
+
+}
+
+int main()
+{
+    int failures = 0;
+
+    // the exterior pairs starting at position 1 take S[0] as their 3'
+    // mismatch, which vrna_seq_encode() sets to S[L]
+    failures += Check("GGGAAACCCAG", "(((...)))..");
+    failures += Check("GCAUAGAAACUAUGC", "((((((...))))))");
+    failures += Check("CAGUCGAAAGAUUGAC", "(((((....)))))..");
+
+    // and one whose first base is unpaired
+    failures += Check("AGGCAUUUCGAUGCCUA", ".(((((....)))))..");
+
+    return failures == 0 ? 0 : 1;
+}
+
+// Local Variables:
+// mode: C++
+// c-basic-offset: 4
+// End: